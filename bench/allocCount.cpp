@@ -0,0 +1,46 @@
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+#include "bench.h"
+
+/**********************************
+ * Replaces the global operator new of the benchmark runner to count heap
+ * allocations, on every thread. Only the count is kept, so it costs one
+ * relaxed increment per allocation.
+ **********************************/
+static std::atomic<uint64_t> allocations(0);
+
+uint64_t BenchAllocations() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* ptr = malloc(size ? size : 1);
+	if(ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t size) noexcept {
+	free(ptr);
+}
@@ -0,0 +1,76 @@
+/*eslint-env node */
+
+// Per-device delivery (one native -> JS call plus the EventEmitter2 fan-out in
+// index.js for every device) against `registerBatch`, while synthetic device
+// events arrive at a fixed rate.
+//
+//   node bench/batchDelivery.js [events=5000] [ratePerSecond=1000]
+
+var usbDetect = require('../');
+var detection = require('bindings')('detection.node');
+
+var eventCount = parseInt(process.argv[2], 10) || 5000;
+var ratePerSecond = parseInt(process.argv[3], 10) || 1000;
+
+function run(label, subscribe, unsubscribe, next) {
+	var received = { devices: 0, calls: 0 };
+	var droppedBefore = usbDetect.getStats().eventsDropped;
+	var cpuBefore = process.cpuUsage();
+	var startedAt = process.hrtime();
+
+	subscribe(received);
+	detection.queueSyntheticEvents(eventCount, ratePerSecond);
+
+	var deadline = Date.now() + eventCount / ratePerSecond * 1000 + 2000;
+	var timer = setInterval(function() {
+		var dropped = usbDetect.getStats().eventsDropped - droppedBefore;
+		if(received.devices + dropped < eventCount && Date.now() < deadline) {
+			return;
+		}
+
+		clearInterval(timer);
+		unsubscribe();
+
+		var cpu = process.cpuUsage(cpuBefore);
+		var elapsed = process.hrtime(startedAt);
+		console.log(
+			'  ' + label +
+			'  devices=' + received.devices +
+			'  js calls=' + received.calls +
+			'  dropped=' + dropped +
+			'  cpu=' + ((cpu.user + cpu.system) / 1000).toFixed(1) + 'ms' +
+			'  cpu/device=' + ((cpu.user + cpu.system) / Math.max(received.devices, 1)).toFixed(2) + 'us' +
+			'  wall=' + (elapsed[0] * 1000 + elapsed[1] / 1e6).toFixed(0) + 'ms'
+		);
+		next();
+	}, 50);
+}
+
+function onChange(received) {
+	return function() {
+		received.devices++;
+		received.calls++;
+	};
+}
+
+// Synthetic events need the queue to themselves
+usbDetect.stopMonitoring();
+
+console.log('batchDelivery: ' + eventCount + ' events at ' + ratePerSecond + '/s');
+
+var listener;
+run('per-event', function(received) {
+	listener = onChange(received);
+	usbDetect.on('change', listener);
+}, function() {
+	usbDetect.off('change', listener);
+}, function() {
+	run('batched  ', function(received) {
+		usbDetect.registerBatch(function(records) {
+			received.devices += records.length;
+			received.calls++;
+		}, { maxBatch: 256, maxDelayMs: 10 });
+	}, function() {
+		usbDetect.registerBatch(null);
+	}, function() {});
+});
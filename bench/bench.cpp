@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+
+
+uint64_t BenchNowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void BenchSleepMs(int ms) {
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+uint64_t BenchPercentile(std::vector<uint64_t>& samples, double percentile) {
+	if(samples.empty()) {
+		return 0;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	size_t index = (size_t) (percentile / 100.0 * (samples.size() - 1) + 0.5);
+	return samples[index];
+}
+
+void BenchPrintLatency(const char* label, std::vector<uint64_t>& samples) {
+	printf("  %-24s n=%-6zu p50=%10.1f us  p99=%10.1f us  max=%10.1f us\n",
+		label,
+		samples.size(),
+		BenchPercentile(samples, 50) / 1000.0,
+		BenchPercentile(samples, 99) / 1000.0,
+		BenchPercentile(samples, 100) / 1000.0);
+}
+
+void BenchPrintPerOp(const char* label, uint64_t ops, uint64_t elapsedNs) {
+	printf("  %-24s n=%-6llu %10.1f ns/op\n",
+		label,
+		(unsigned long long) ops,
+		ops ? (double) elapsedNs / ops : 0.0);
+}
+
+void BenchPrintPerOpAllocs(const char* label, uint64_t ops, uint64_t elapsedNs, uint64_t allocations) {
+	printf("  %-24s n=%-6llu %10.1f ns/op %10.1f allocs/op\n",
+		label,
+		(unsigned long long) ops,
+		ops ? (double) elapsedNs / ops : 0.0,
+		ops ? (double) allocations / ops : 0.0);
+}
+
+void BenchPrintOps(const char* label, std::vector<uint64_t>& samples, uint64_t allocations) {
+	uint64_t total = 0;
+	for(size_t i = 0; i < samples.size(); i++) {
+		total += samples[i];
+	}
+
+	printf("  %-32s n=%-6zu %10.1f ns/op  p99=%10.1f ns %8.1f allocs/op\n",
+		label,
+		samples.size(),
+		samples.empty() ? 0.0 : (double) total / samples.size(),
+		(double) BenchPercentile(samples, 99),
+		samples.empty() ? 0.0 : (double) allocations / samples.size());
+}
+
+int BenchArgInt(int argc, char** argv, int index, int fallback) {
+	if(index < argc) {
+		return atoi(argv[index]);
+	}
+	return fallback;
+}
@@ -0,0 +1,33 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+#include <vector>
+
+/**********************************
+ * Helpers shared by the detection_bench suites
+ **********************************/
+typedef int (*BenchSuiteFunc_t)(int argc, char** argv);
+
+typedef struct {
+	const char* name;
+	const char* description;
+	BenchSuiteFunc_t run;
+} BenchSuite_t;
+
+uint64_t BenchNowNs();
+void BenchSleepMs(int ms);
+// Sorts `samples` in place
+uint64_t BenchPercentile(std::vector<uint64_t>& samples, double percentile);
+void BenchPrintLatency(const char* label, std::vector<uint64_t>& samples);
+// Average cost of `ops` operations that took `elapsedNs` together
+void BenchPrintPerOp(const char* label, uint64_t ops, uint64_t elapsedNs);
+// Same, with the heap allocations they made
+void BenchPrintPerOpAllocs(const char* label, uint64_t ops, uint64_t elapsedNs, uint64_t allocations);
+// Mean, p99 and allocations of one operation, from one sample per operation
+void BenchPrintOps(const char* label, std::vector<uint64_t>& samples, uint64_t allocations);
+// Heap allocations of the process so far, counted by allocCount.cpp
+uint64_t BenchAllocations();
+int BenchArgInt(int argc, char** argv, int index, int fallback);
+
+#endif
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "../src/debounce.h"
+
+/**********************************
+ * Replays a trace of flapping devices through the debouncer on a
+ * simulated clock. Every device bounces add/remove a few times,
+ * `intervalMs` apart, like a bad cable. Half of them were plugged in
+ * before the trace starts, so theirs begins with a remove. Prints how many
+ * events would still reach the JS callbacks, and how many emits of
+ * index.js that is, for a few windows. The state a consumer builds from
+ * the delivered events has to end up the same as from all of them.
+ **********************************/
+// Emits index.js makes for one added, removed and mounted device
+#define EMITS_ADDED 9
+#define EMITS_REMOVED 6
+#define EMITS_MOUNTED 3
+
+typedef struct {
+	uint64_t atNs;
+	DeviceEvent_t event;
+} TraceEvent_t;
+
+static std::vector<TraceEvent_t> CreateFlapTrace(int devices, int bounces, int intervalMs) {
+	std::vector<TraceEvent_t> trace;
+
+	for(int d = 0; d < devices; d++) {
+		std::shared_ptr<ListResultItem_t> item = std::make_shared<ListResultItem_t>();
+		item->vendorId = 0x1000 + d % 16;
+		item->productId = d;
+		item->devNode = "/dev/flap" + std::to_string(d);
+		DeviceRecord_t record = item;
+
+		// Spread the devices out, and let them flap a different number of times
+		uint64_t atNs = (uint64_t) ((d * 7) % 1000) * 1000000ULL;
+		bool wasPresent = d % 2 == 1;
+		int count = 1 + 2 * (d % bounces);
+
+		for(int n = 0; n < count; n++) {
+			TraceEvent_t traced;
+			traced.atNs = atNs + (uint64_t) n * intervalMs * 1000000ULL;
+			traced.event.type = (n % 2 == 0) == wasPresent ? DeviceEvent_Removed : DeviceEvent_Added;
+			traced.event.record = record;
+			traced.event.seq = 0;
+			trace.push_back(traced);
+		}
+	}
+
+	std::stable_sort(trace.begin(), trace.end(), [](const TraceEvent_t& a, const TraceEvent_t& b) {
+		return a.atNs < b.atNs;
+	});
+
+	return trace;
+}
+
+typedef struct {
+	uint64_t delivered;
+	uint64_t emits;
+	// Present devices, as a consumer of the events sees them
+	std::map<std::string, bool> present;
+} FlapConsumer_t;
+
+static void Consume(FlapConsumer_t* consumer, const DeviceEvent_t& event) {
+	consumer->delivered++;
+	consumer->emits += event.type == DeviceEvent_Added ? EMITS_ADDED : event.type == DeviceEvent_Removed ? EMITS_REMOVED : EMITS_MOUNTED;
+	consumer->present[event.record->devNode] = event.type != DeviceEvent_Removed;
+}
+
+static void InitConsumer(FlapConsumer_t* consumer, const std::vector<TraceEvent_t>& trace) {
+	consumer->delivered = consumer->emits = 0;
+	consumer->present.clear();
+
+	// Whoever starts with a remove was there already
+	for(size_t i = 0; i < trace.size(); i++) {
+		const std::string& devNode = trace[i].event.record->devNode;
+		if(consumer->present.find(devNode) == consumer->present.end()) {
+			consumer->present[devNode] = trace[i].event.type == DeviceEvent_Removed;
+		}
+	}
+}
+
+int BenchDebounce(int argc, char** argv) {
+	int devices = BenchArgInt(argc, argv, 1, 64);
+	int bounces = BenchArgInt(argc, argv, 2, 20);
+	int intervalMs = BenchArgInt(argc, argv, 3, 20);
+	static const int windowsMs[] = { 0, 10, 50, 250, 1000 };
+	std::vector<TraceEvent_t> trace = CreateFlapTrace(devices, bounces, intervalMs);
+	FlapConsumer_t expected;
+	int errors = 0;
+
+	printf("debounce: %d devices, up to %d bounces %d ms apart, %llu events\n",
+		devices,
+		bounces,
+		intervalMs,
+		(unsigned long long) trace.size());
+
+	InitConsumer(&expected, trace);
+	for(size_t i = 0; i < trace.size(); i++) {
+		Consume(&expected, trace[i].event);
+	}
+
+	for(size_t w = 0; w < sizeof(windowsMs) / sizeof(windowsMs[0]); w++) {
+		Debouncer_t debouncer;
+		FlapConsumer_t consumer;
+		DeviceEvent_t event;
+		char label[32];
+
+		DebouncerInit(&debouncer, (uint64_t) windowsMs[w] * 1000000ULL);
+		InitConsumer(&consumer, trace);
+
+		uint64_t start = BenchNowNs();
+		for(size_t i = 0; i < trace.size(); i++) {
+			if(debouncer.windowNs == 0) {
+				Consume(&consumer, trace[i].event);
+				continue;
+			}
+
+			// What the timer would have released by now
+			while(DebouncerPop(&debouncer, &event, trace[i].atNs)) {
+				Consume(&consumer, event);
+			}
+			DebouncerPush(&debouncer, trace[i].event, trace[i].atNs);
+		}
+		while(DebouncerPop(&debouncer, &event, UINT64_MAX)) {
+			Consume(&consumer, event);
+		}
+		uint64_t elapsedNs = BenchNowNs() - start;
+
+		if(consumer.present != expected.present || consumer.delivered + debouncer.suppressed != trace.size()) {
+			errors++;
+		}
+
+		snprintf(label, sizeof(label), "window %d ms", windowsMs[w]);
+		BenchPrintPerOp(label, trace.size(), elapsedNs);
+		printf("  %-24s callbacks=%llu suppressed=%llu emits=%llu avoided=%llu\n",
+			"",
+			(unsigned long long) consumer.delivered,
+			(unsigned long long) debouncer.suppressed,
+			(unsigned long long) consumer.emits,
+			(unsigned long long) (expected.emits - consumer.emits));
+	}
+
+	printf("  %-24s errors=%d\n", "", errors);
+
+	return errors == 0 ? 0 : 1;
+}
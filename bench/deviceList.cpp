@@ -0,0 +1,242 @@
+#include <map>
+#include <stdio.h>
+#include <string>
+
+#include "bench.h"
+#include "../src/deviceList.h"
+
+/**********************************
+ * Compares the device registry with the std::map keyed by devNode it
+ * replaced, where every find() scanned all devices. The synthetic devices
+ * spread over 500 vendors with 10 products each, so a vendor query
+ * matches 0.2% of them and a vendor/product query a tenth of that.
+ **********************************/
+#define BENCH_VENDORS 500
+#define BENCH_PRODUCTS 10
+
+/* Mirror of deviceList.cpp before the indexes and the shared records:
+   every find() deep copied the matching records, strings included */
+typedef struct {
+	int locationId;
+	int vendorId;
+	int productId;
+	std::string deviceName;
+	std::string manufacturer;
+	std::string serialNumber;
+	int deviceAddress;
+	std::string devNode;
+	std::string mountPath;
+} LegacyResultItem_t;
+
+static std::map<std::string, LegacyResultItem_t*> legacyMap;
+
+static LegacyResultItem_t* CreateLegacyItem(const ListResultItem_t* item) {
+	LegacyResultItem_t* legacy = new LegacyResultItem_t();
+
+	legacy->locationId = item->locationId;
+	legacy->vendorId = item->vendorId;
+	legacy->productId = item->productId;
+	legacy->deviceName = item->deviceName.str();
+	legacy->manufacturer = item->manufacturer.str();
+	legacy->serialNumber = item->serialNumber;
+	legacy->deviceAddress = item->deviceAddress;
+	legacy->devNode = item->devNode;
+	legacy->mountPath = item->mountPath;
+
+	return legacy;
+}
+
+static void LegacyFilteredList(std::list<LegacyResultItem_t*>* filteredList, int vid, int pid) {
+	for(std::map<std::string, LegacyResultItem_t*>::iterator it = legacyMap.begin(); it != legacyMap.end(); ++it) {
+		LegacyResultItem_t* item = it->second;
+
+		if(
+			((vid != 0 && pid != 0) && (vid == item->vendorId && pid == item->productId))
+			|| ((vid != 0 && pid == 0) && vid == item->vendorId)
+			|| (vid == 0 && pid == 0)
+		) {
+			filteredList->push_back(new LegacyResultItem_t(*item));
+		}
+	}
+}
+
+static void ClearList(std::list<LegacyResultItem_t*>& results, uint64_t* found) {
+	*found += results.size();
+	for(std::list<LegacyResultItem_t*>::iterator it = results.begin(); it != results.end(); ++it) {
+		delete *it;
+	}
+	results.clear();
+}
+
+static void ClearList(std::vector<DeviceRecord_t>& results, uint64_t* found) {
+	*found += results.size();
+	results.clear();
+}
+
+static DeviceItem_t* CreateBenchItem(int i) {
+	DeviceItem_t* item = new DeviceItem_t();
+	char devNode[32];
+
+	snprintf(devNode, sizeof(devNode), "/dev/sd%d", i);
+	item->deviceParams.devNode = devNode;
+	item->deviceParams.vendorId = 0x1000 + i % BENCH_VENDORS;
+	item->deviceParams.productId = 0x2000 + (i / BENCH_VENDORS) % BENCH_PRODUCTS;
+	// Longer than the small string buffer, like most real ones
+	item->deviceParams.serialNumber = "4C530001" + std::to_string(1000000000 + i);
+	item->deviceParams.deviceName = "Ultra Fit USB 3.1 Flash Drive";
+	item->deviceParams.manufacturer = "SanDisk Corporation";
+	item->syspath = "/sys/devices/bench/block/sd" + std::to_string(i);
+	item->deviceState = DeviceState_Connect;
+
+	return item;
+}
+
+int BenchDeviceList(int argc, char** argv) {
+	int devices = BenchArgInt(argc, argv, 1, 50000);
+	int queries = BenchArgInt(argc, argv, 2, 2000);
+	std::vector<DeviceItem_t*> items;
+	std::list<LegacyResultItem_t*> legacyResults;
+	std::vector<DeviceRecord_t> results;
+	uint64_t found = 0;
+	uint64_t start;
+	uint64_t allocations;
+
+	for(int i = 0; i < devices; i++) {
+		items.push_back(CreateBenchItem(i));
+	}
+
+	printf("device-list: %d devices, %d vendors x %d products, %d queries\n", devices, BENCH_VENDORS, BENCH_PRODUCTS, queries);
+
+	start = BenchNowNs();
+	for(int i = 0; i < devices; i++) {
+		legacyMap.insert(std::pair<std::string, LegacyResultItem_t*>(items[i]->deviceParams.devNode, CreateLegacyItem(&items[i]->deviceParams)));
+	}
+	BenchPrintPerOp("map insert", devices, BenchNowNs() - start);
+
+	// Like the initial enumeration: one snapshot for all of them
+	start = BenchNowNs();
+	BeginListUpdate();
+	for(int i = 0; i < devices; i++) {
+		AddItemToList((char*) items[i]->deviceParams.devNode.c_str(), items[i]);
+	}
+	EndListUpdate();
+	BenchPrintPerOp("registry insert", devices, BenchNowNs() - start);
+
+	// A hotplug event outside of a burst publishes a whole snapshot
+	std::vector<uint64_t> samples;
+	for(int i = 0; i < 20; i++) {
+		items[i]->deviceParams.mountPath = "/media/bench";
+		start = BenchNowNs();
+		RefreshItemInList(items[i]);
+		samples.push_back(BenchNowNs() - start);
+	}
+	BenchPrintLatency("registry publish", samples);
+
+	start = BenchNowNs();
+	for(int i = 0; i < queries; i++) {
+		found += legacyMap.find(items[(i * 7919) % devices]->deviceParams.devNode) != legacyMap.end();
+	}
+	BenchPrintPerOp("map key lookup", queries, BenchNowNs() - start);
+
+	start = BenchNowNs();
+	for(int i = 0; i < queries; i++) {
+		found += GetItemFromList((char*) items[(i * 7919) % devices]->deviceParams.devNode.c_str()) != NULL;
+	}
+	BenchPrintPerOp("registry key lookup", queries, BenchNowNs() - start);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		LegacyFilteredList(&legacyResults, 0x1000 + i % BENCH_VENDORS, 0);
+		ClearList(legacyResults, &found);
+	}
+	BenchPrintPerOpAllocs("map find(vid)", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		CreateFilteredList(&results, 0x1000 + i % BENCH_VENDORS, 0);
+		ClearList(results, &found);
+	}
+	BenchPrintPerOpAllocs("registry find(vid)", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		LegacyFilteredList(&legacyResults, 0x1000 + i % BENCH_VENDORS, 0x2000 + i % BENCH_PRODUCTS);
+		ClearList(legacyResults, &found);
+	}
+	BenchPrintPerOpAllocs("map find(vid, pid)", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		CreateFilteredList(&results, 0x1000 + i % BENCH_VENDORS, 0x2000 + i % BENCH_PRODUCTS);
+		ClearList(results, &found);
+	}
+	BenchPrintPerOpAllocs("registry find(vid, pid)", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		CreateSerialList(&results, items[(i * 7919) % devices]->deviceParams.serialNumber.c_str());
+		ClearList(results, &found);
+	}
+	BenchPrintPerOpAllocs("registry by serial", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	// A poller that is one hotplug event behind
+	std::vector<ListChange_t> changes;
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		uint64_t version;
+
+		CreateChangeList(&changes, GetListVersion() - 1, &version, &results);
+		found += changes.size();
+		changes.clear();
+	}
+	BenchPrintPerOpAllocs("registry changes", queries, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	for(int i = 0; i < queries; i++) {
+		found += GetItemBySyspath(items[(i * 7919) % devices]->syspath.c_str()) != NULL;
+	}
+	BenchPrintPerOp("registry by syspath", queries, BenchNowNs() - start);
+
+	// Every device: deep copies against one reference per record
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	LegacyFilteredList(&legacyResults, 0, 0);
+	ClearList(legacyResults, &found);
+	BenchPrintPerOpAllocs("map find()", 1, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	allocations = BenchAllocations();
+	CreateFilteredList(&results, 0, 0);
+	ClearList(results, &found);
+	BenchPrintPerOpAllocs("registry find()", 1, BenchNowNs() - start, BenchAllocations() - allocations);
+
+	start = BenchNowNs();
+	for(int i = 0; i < devices; i++) {
+		std::map<std::string, LegacyResultItem_t*>::iterator it = legacyMap.find(items[i]->deviceParams.devNode);
+		delete it->second;
+		legacyMap.erase(it);
+	}
+	BenchPrintPerOp("map remove", devices, BenchNowNs() - start);
+
+	start = BenchNowNs();
+	BeginListUpdate();
+	for(int i = 0; i < devices; i++) {
+		RemoveItemFromList(items[i]);
+	}
+	EndListUpdate();
+	BenchPrintPerOp("registry remove", devices, BenchNowNs() - start);
+
+	printf("  %-24s found=%llu left=%zu\n", "", (unsigned long long) found, GetListSize());
+
+	for(int i = 0; i < devices; i++) {
+		delete items[i];
+	}
+
+	return 0;
+}
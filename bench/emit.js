@@ -0,0 +1,71 @@
+/*eslint-env node */
+
+// Cost of getting a device event to its listeners, with 1, 100 and 1000
+// listeners on `add:vid:pid` topics of different devices. The legacy path
+// emits all nine topics of every event through EventEmitter2, the routed
+// one only calls out for the topics somebody listens to.
+//
+//   node bench/emit.js [events=20000] [rounds=20]
+
+var usbDetect = require('../');
+var detection = require('bindings')('detection.node');
+
+var eventCount = parseInt(process.argv[2], 10) || 20000;
+var roundCount = parseInt(process.argv[3], 10) || 20;
+
+// The synthetic devices, see syntheticEvents.cpp
+var SYNTHETIC_VENDOR_ID = 0x1000;
+var SYNTHETIC_VENDORS = 16;
+
+function elapsedNs(startedAt) {
+	var elapsed = process.hrtime(startedAt);
+	return elapsed[0] * 1e9 + elapsed[1];
+}
+
+function run(label, isLegacy) {
+	var samples = [];
+
+	for(var round = 0; round < roundCount; round++) {
+		var startedAt = process.hrtime();
+		detection.routeSyntheticEvents(eventCount, isLegacy);
+		samples.push(elapsedNs(startedAt) / eventCount);
+	}
+
+	samples.sort(function(a, b) { return a - b; });
+	return '  ' + label +
+		'  p50=' + samples[Math.floor(roundCount * 0.5)].toFixed(1) + 'ns/event' +
+		'  p99=' + samples[Math.floor(roundCount * 0.99)].toFixed(1) + 'ns/event';
+}
+
+// Synthetic events need the event queue to themselves
+usbDetect.stopMonitoring();
+
+console.log('emit: ' + eventCount + ' add/remove events, ' + roundCount + ' rounds');
+[1, 100, 1000].forEach(function(listenerCount) {
+	var calls = 0;
+	var listeners = [];
+
+	for(var i = 0; i < listenerCount; i++) {
+		var topic = 'add:' + (SYNTHETIC_VENDOR_ID + i % SYNTHETIC_VENDORS) + ':' + i;
+		var listener = function() {
+			calls++;
+		};
+
+		usbDetect.on(topic, listener);
+		listeners.push([topic, listener]);
+	}
+
+	// Warm up both paths before measuring either of them
+	detection.routeSyntheticEvents(eventCount, true);
+	detection.routeSyntheticEvents(eventCount, false);
+
+	calls = 0;
+	console.log(listenerCount + ' listeners');
+	console.log(run('legacy', true) + '  calls=' + calls);
+	calls = 0;
+	console.log(run('routed', false) + '  calls=' + calls);
+
+	listeners.forEach(function(entry) {
+		usbDetect.off(entry[0], entry[1]);
+	});
+});
@@ -0,0 +1,92 @@
+/*eslint-env node */
+
+// Per-call latency of looking up the device list: the thread pool `find`
+// of the native binding, the promise `find` of index.js and `findSync`.
+// Calls are made one after the other, like one lookup per HTTP request.
+//
+//   node bench/findLatency.js [calls=20000] [vid] [pid]
+
+var usbDetect = require('../');
+var detection = require('bindings')('detection.node');
+
+var callCount = parseInt(process.argv[2], 10) || 20000;
+var vid = parseInt(process.argv[3], 16) || 0;
+var pid = parseInt(process.argv[4], 16) || 0;
+
+function args() {
+	var list = [];
+	if(vid) {
+		list.push(vid);
+	}
+	if(pid) {
+		list.push(pid);
+	}
+	return list;
+}
+
+function elapsedUs(startedAt) {
+	var elapsed = process.hrtime(startedAt);
+	return elapsed[0] * 1e6 + elapsed[1] / 1e3;
+}
+
+function report(label, samples, devices) {
+	samples.sort(function(a, b) { return a - b; });
+	console.log(
+		'  ' + label +
+		'  n=' + samples.length +
+		'  devices=' + devices +
+		'  p50=' + samples[Math.floor(samples.length * 0.5)].toFixed(2) + 'us' +
+		'  p99=' + samples[Math.floor(samples.length * 0.99)].toFixed(2) + 'us' +
+		'  max=' + samples[samples.length - 1].toFixed(2) + 'us'
+	);
+}
+
+function runAsync(label, find, next) {
+	var samples = [];
+	var devices = 0;
+
+	(function call() {
+		if(samples.length === callCount) {
+			report(label, samples, devices);
+			next();
+			return;
+		}
+
+		var startedAt = process.hrtime();
+		find(function(result) {
+			samples.push(elapsedUs(startedAt));
+			devices = result.length;
+			call();
+		});
+	})();
+}
+
+function runSync(label) {
+	var samples = [];
+	var devices = 0;
+
+	for(var i = 0; i < callCount; i++) {
+		var startedAt = process.hrtime();
+		devices = usbDetect.findSync.apply(usbDetect, args()).length;
+		samples.push(elapsedUs(startedAt));
+	}
+
+	report(label, samples, devices);
+}
+
+usbDetect.ready.then(function() {
+	console.log('findLatency: ' + callCount + ' calls, vid=' + vid.toString(16) + ' pid=' + pid.toString(16));
+
+	runAsync('thread pool find', function(done) {
+		detection.find.apply(detection, args().concat(function(err, devices) {
+			done(devices);
+		}));
+	}, function() {
+		runAsync('promise find    ', function(done) {
+			usbDetect.find.apply(usbDetect, args()).then(done);
+		}, function() {
+			runSync('findSync        ');
+			usbDetect.stopMonitoring();
+		});
+	});
+});
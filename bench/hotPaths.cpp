@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../src/deviceList.h"
+#include "../src/eventQueue.h"
+
+/**********************************
+ * The paths every device goes through, timed one operation at a time for
+ * populations of 10 up to `maxDevices` devices: the insert into the
+ * registry, find(vid) and find() on it, CopyElement() of a record and the
+ * handoff of an event from the backend thread to the consumer through the
+ * event queue. Each line has the mean, the p99 and the heap allocations
+ * of one operation, so a regression in any of them shows as a number that
+ * moved rather than as a slower test run.
+ **********************************/
+#define HOT_VENDORS 500
+#define HOT_PRODUCTS 10
+// Single inserts that publish a snapshot each, like hotplug events
+#define HOT_PUBLISHES 100
+#define HOT_QUEUE_CAPACITY 16
+
+static DeviceItem_t* CreateHotItem(int i) {
+	DeviceItem_t* item = new DeviceItem_t();
+
+	item->deviceParams.devNode = "/dev/hot" + std::to_string(i);
+	item->deviceParams.vendorId = 0x1000 + i % HOT_VENDORS;
+	item->deviceParams.productId = 0x2000 + (i / HOT_VENDORS) % HOT_PRODUCTS;
+	item->deviceParams.serialNumber = "4C530001" + std::to_string(1000000000 + i);
+	item->deviceParams.deviceName = "Ultra Fit USB 3.1 Flash Drive";
+	item->deviceParams.manufacturer = "SanDisk Corporation";
+	item->deviceParams.mountPath = "/media/hot" + std::to_string(i);
+	item->syspath = "/sys/devices/hot/block/hot" + std::to_string(i);
+	item->deviceState = DeviceState_Connect;
+
+	return item;
+}
+
+static void PrintPopulation(const char* label, int devices, std::vector<uint64_t>& samples, uint64_t allocations) {
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s @%d", label, devices);
+	BenchPrintOps(name, samples, allocations);
+	samples.clear();
+}
+
+/* Events are numbered by the order they were pushed in, the producer
+   writes the push time of each before it pushes it and the queue makes it
+   visible to the consumer along with the event. The producer waits for
+   the queue to be empty before the next push, so the samples are the
+   handoff itself and not the time spent behind a backlog. */
+typedef struct {
+	EventQueue_t queue;
+	std::vector<DeviceRecord_t> records;
+	std::vector<uint64_t> pushedAt;
+} HotHandoff_t;
+
+static void RunProducer(HotHandoff_t* handoff) {
+	for(size_t i = 0; i < handoff->pushedAt.size(); i++) {
+		const DeviceRecord_t& record = handoff->records[i % handoff->records.size()];
+
+		while(EventQueueDepth(&handoff->queue) > 0) {
+			std::this_thread::yield();
+		}
+		EventTimes_t times = { 0, 0, BenchNowNs(), 0 };
+
+		handoff->pushedAt[i] = times.queuedNs;
+		EventQueuePush(&handoff->queue, i % 2 ? DeviceEvent_Removed : DeviceEvent_Added, record, times);
+	}
+}
+
+static void BenchHandoff(int devices, std::vector<uint64_t>& samples) {
+	HotHandoff_t handoff;
+	DeviceEvent_t event;
+	uint64_t allocations;
+
+	CreateFilteredList(&handoff.records, 0, 0);
+	handoff.pushedAt.resize(devices);
+	EventQueueInit(&handoff.queue, HOT_QUEUE_CAPACITY);
+
+	std::thread producer(RunProducer, &handoff);
+	allocations = BenchAllocations();
+	for(size_t i = 0; i < handoff.pushedAt.size();) {
+		if(EventQueuePop(&handoff.queue, &event)) {
+			samples.push_back(BenchNowNs() - handoff.pushedAt[i]);
+			i++;
+		}
+		else {
+			// Gives the producer the CPU on a single core machine
+			std::this_thread::yield();
+		}
+	}
+	allocations = BenchAllocations() - allocations;
+	producer.join();
+
+	PrintPopulation("handoff", devices, samples, allocations);
+	EventQueueFree(&handoff.queue);
+}
+
+static void BenchPopulation(int devices) {
+	std::vector<DeviceItem_t*> items;
+	std::vector<DeviceRecord_t> results;
+	std::vector<uint64_t> samples;
+	uint64_t found = 0;
+	uint64_t start;
+	uint64_t allocations;
+	int queries = devices < 1000 ? 1000 : devices;
+
+	for(int i = 0; i < devices + HOT_PUBLISHES; i++) {
+		items.push_back(CreateHotItem(i));
+	}
+
+	// Like the initial enumeration: one snapshot for all of them
+	allocations = BenchAllocations();
+	BeginListUpdate();
+	for(int i = 0; i < devices; i++) {
+		start = BenchNowNs();
+		AddItemToList((char*) items[i]->deviceParams.devNode.c_str(), items[i]);
+		samples.push_back(BenchNowNs() - start);
+	}
+	EndListUpdate();
+	PrintPopulation("AddItemToList burst", devices, samples, BenchAllocations() - allocations);
+
+	// Hotplug events, each one publishes a snapshot of the whole list
+	allocations = BenchAllocations();
+	for(int i = devices; i < devices + HOT_PUBLISHES; i++) {
+		start = BenchNowNs();
+		AddItemToList((char*) items[i]->deviceParams.devNode.c_str(), items[i]);
+		samples.push_back(BenchNowNs() - start);
+	}
+	PrintPopulation("AddItemToList publish", devices, samples, BenchAllocations() - allocations);
+
+	allocations = BenchAllocations();
+	for(int i = 0; i < queries; i++) {
+		start = BenchNowNs();
+		CreateFilteredList(&results, 0x1000 + (i * 7919) % HOT_VENDORS, 0);
+		found += results.size();
+		results.clear();
+		samples.push_back(BenchNowNs() - start);
+	}
+	PrintPopulation("CreateFilteredList(vid)", devices, samples, BenchAllocations() - allocations);
+
+	// A whole list per operation, fewer of them for the large populations
+	int rounds = devices > 10000 ? 20 : 200;
+	results.reserve(devices + HOT_PUBLISHES);
+	allocations = BenchAllocations();
+	for(int i = 0; i < rounds; i++) {
+		start = BenchNowNs();
+		CreateFilteredList(&results, 0, 0);
+		found += results.size();
+		results.clear();
+		samples.push_back(BenchNowNs() - start);
+	}
+	PrintPopulation("CreateFilteredList()", devices, samples, BenchAllocations() - allocations);
+
+	allocations = BenchAllocations();
+	for(int i = 0; i < devices; i++) {
+		start = BenchNowNs();
+		ListResultItem_t* copy = CopyElement(&items[i]->deviceParams);
+		samples.push_back(BenchNowNs() - start);
+		found += copy->vendorId != 0;
+		delete copy;
+	}
+	PrintPopulation("CopyElement", devices, samples, BenchAllocations() - allocations);
+
+	BenchHandoff(devices, samples);
+
+	BeginListUpdate();
+	for(size_t i = 0; i < items.size(); i++) {
+		RemoveItemFromList(items[i]);
+	}
+	EndListUpdate();
+	for(size_t i = 0; i < items.size(); i++) {
+		delete items[i];
+	}
+
+	printf("  %-24s found=%llu left=%zu\n", "", (unsigned long long) found, GetListSize());
+}
+
+int BenchHotPaths(int argc, char** argv) {
+	int maxDevices = BenchArgInt(argc, argv, 1, 100000);
+
+	printf("hot-paths: 10 to %d devices, %d vendors x %d products\n", maxDevices, HOT_VENDORS, HOT_PRODUCTS);
+
+	for(int devices = 10; devices <= maxDevices; devices *= 10) {
+		BenchPopulation(devices);
+	}
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../src/latencyHistogram.h"
+
+/**********************************
+ * The stage histograms behind getStats().latency: what one record costs,
+ * alone and with threads recording into the same histogram, and how far
+ * its percentiles are from the exact ones of the same samples. The samples
+ * spread from a few hundred nanoseconds to tens of milliseconds like event
+ * latencies do. Fails when a percentile is off by more than a bucket.
+ **********************************/
+#define HISTOGRAM_THREADS 4
+
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+
+// Log-uniform between 256 ns and 67 ms
+static std::vector<uint64_t> CreateSamples(int count) {
+	std::vector<uint64_t> samples;
+
+	srand(1);
+	for(int i = 0; i < count; i++) {
+		samples.push_back((uint64_t) exp2(8 + 18.0 * rand() / RAND_MAX));
+	}
+
+	return samples;
+}
+
+static void RecordSamples(LatencyHistogram_t* histogram, const std::vector<uint64_t>* samples) {
+	for(size_t i = 0; i < samples->size(); i++) {
+		LatencyHistogramRecord(histogram, (*samples)[i]);
+	}
+}
+
+int BenchLatencyHistogram(int argc, char** argv) {
+	int count = BenchArgInt(argc, argv, 1, 1000000);
+	std::vector<uint64_t> samples = CreateSamples(count);
+	LatencyHistogram_t* histogram = new LatencyHistogram_t();
+	std::vector<std::thread> threads;
+	char label[32];
+	int errors = 0;
+
+	printf("latency-histogram: %d samples, %d buckets of %zu bytes\n", count, LATENCY_BUCKETS, sizeof(histogram->counts[0]));
+
+	LatencyHistogramReset(histogram);
+	uint64_t start = BenchNowNs();
+	RecordSamples(histogram, &samples);
+	BenchPrintPerOp("record", samples.size(), BenchNowNs() - start);
+
+	for(size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		double exact = (double) BenchPercentile(samples, percentiles[i]);
+		double estimate = (double) LatencyHistogramPercentile(histogram, percentiles[i]);
+		double error = fabs(estimate - exact) / exact;
+
+		printf("  p%-6g exact=%12.0f ns  histogram=%12.0f ns  error=%5.2f%%\n", percentiles[i], exact, estimate, error * 100);
+		if(error > 1.0 / LATENCY_SUB_BUCKETS) {
+			errors++;
+		}
+	}
+
+	// Every environment records into its own, this is the worst case for the atomics
+	LatencyHistogramReset(histogram);
+	start = BenchNowNs();
+	for(int i = 0; i < HISTOGRAM_THREADS; i++) {
+		threads.push_back(std::thread(RecordSamples, histogram, &samples));
+	}
+	for(size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	snprintf(label, sizeof(label), "record, %d threads", HISTOGRAM_THREADS);
+	BenchPrintPerOp(label, samples.size() * HISTOGRAM_THREADS, BenchNowNs() - start);
+
+	if(histogram->count.load() != samples.size() * HISTOGRAM_THREADS) {
+		printf("  lost records: %llu of %zu\n", (unsigned long long) histogram->count.load(), samples.size() * HISTOGRAM_THREADS);
+		errors++;
+	}
+
+	delete histogram;
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+int BenchDebounce(int argc, char** argv);
+int BenchDeviceList(int argc, char** argv);
+int BenchHotPaths(int argc, char** argv);
+int BenchLatencyHistogram(int argc, char** argv);
+int BenchRegistryStress(int argc, char** argv);
+
+#ifdef __linux__
+int BenchMonitorLatency(int argc, char** argv);
+int BenchMountTable(int argc, char** argv);
+int BenchSysfsEnum(int argc, char** argv);
+int BenchUeventFilter(int argc, char** argv);
+int BenchUeventReplay(int argc, char** argv);
+#endif
+
+static BenchSuite_t suites[] = {
+	{ "debounce", "flapping devices replayed through the debouncer, JS callbacks avoided", BenchDebounce },
+	{ "device-list", "device registry: indexed lookups vs the map scan", BenchDeviceList },
+	{ "hot-paths", "registry insert, find, CopyElement and event handoff for 10 to 100k devices", BenchHotPaths },
+	{ "latency-histogram", "cost and accuracy of the getStats() latency histograms", BenchLatencyHistogram },
+	{ "registry-stress", "concurrent finders against a writer, checks every snapshot they read", BenchRegistryStress },
+#ifdef __linux__
+	{ "monitor-latency", "kernel-to-thread latency and idle wakeups of the monitor wait", BenchMonitorLatency },
+	{ "mount-table", "mount lookups: getmntent scan vs the indexed mount table", BenchMountTable },
+	{ "sysfs-enum", "mass storage enumeration: libudev vs direct sysfs walk", BenchSysfsEnum },
+	{ "uevent-filter", "uevent replay throughput with and without the socket filter", BenchUeventFilter },
+	{ "uevent-replay", "recorded hotplug storm replayed end to end at Nx and max speed", BenchUeventReplay },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+static void PrintUsage(const char* self) {
+	printf("usage: %s <suite> [args...]\n\nsuites:\n", self);
+	for(BenchSuite_t* suite = suites; suite->name; suite++) {
+		printf("  %-20s %s\n", suite->name, suite->description);
+	}
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	for(BenchSuite_t* suite = suites; suite->name; suite++) {
+		if(strcmp(suite->name, argv[1]) == 0) {
+			return suite->run(argc - 1, argv + 1);
+		}
+	}
+
+	PrintUsage(argv[0]);
+	return 1;
+}
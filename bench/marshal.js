@@ -0,0 +1,62 @@
+/*eslint-env node */
+
+// Cost of turning device records into JS objects, the way the added and
+// removed callbacks and find() do it, against the way they did before the
+// cached property names and the object template. Also times reading the
+// objects back, which is where dictionary-mode objects cost the most.
+//
+//   node bench/marshal.js [objects=10000] [rounds=50]
+
+var detection = require('bindings')('detection.node');
+
+var objectCount = parseInt(process.argv[2], 10) || 10000;
+var roundCount = parseInt(process.argv[3], 10) || 50;
+
+function elapsedNs(startedAt) {
+	var elapsed = process.hrtime(startedAt);
+	return elapsed[0] * 1e9 + elapsed[1];
+}
+
+function readAll(devices) {
+	var sum = 0;
+	for(var i = 0; i < devices.length; i++) {
+		var device = devices[i];
+		sum += device.vendorId + device.productId + device.locationId + device.deviceAddress;
+		sum += device.devNode.length + device.deviceName.length + device.manufacturer.length;
+	}
+	return sum;
+}
+
+function run(label, isLegacy) {
+	var createNs = [];
+	var readNs = [];
+	var checksum = 0;
+
+	for(var round = 0; round < roundCount; round++) {
+		var startedAt = process.hrtime();
+		var devices = detection.marshalSyntheticDevices(objectCount, isLegacy);
+		createNs.push(elapsedNs(startedAt) / objectCount);
+
+		startedAt = process.hrtime();
+		checksum += readAll(devices);
+		readNs.push(elapsedNs(startedAt) / objectCount);
+	}
+
+	createNs.sort(function(a, b) { return a - b; });
+	readNs.sort(function(a, b) { return a - b; });
+	console.log(
+		'  ' + label +
+		'  create p50=' + createNs[Math.floor(roundCount * 0.5)].toFixed(1) + 'ns/object' +
+		'  p99=' + createNs[Math.floor(roundCount * 0.99)].toFixed(1) + 'ns/object' +
+		'  read p50=' + readNs[Math.floor(roundCount * 0.5)].toFixed(1) + 'ns/object' +
+		'  checksum=' + checksum
+	);
+}
+
+// Warm up both paths and readAll() before measuring either of them
+readAll(detection.marshalSyntheticDevices(objectCount, true));
+readAll(detection.marshalSyntheticDevices(objectCount, false));
+
+console.log('marshal: ' + objectCount + ' device objects, ' + roundCount + ' rounds');
+run('legacy Set', true);
+run('template  ', false);
@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/monitorWait_linux.h"
+
+/**********************************
+ * Compares the old monitor loop (select() with a zero timeout followed by
+ * usleep(250ms)) with the blocking epoll wait used by ThreadFunc. A
+ * non-blocking datagram socketpair stands in for the udev netlink socket;
+ * every datagram carries the time it was sent.
+ **********************************/
+
+typedef struct {
+	int fd;
+	bool useEpoll;
+	volatile bool running;
+	MonitorWait_t wait;
+	std::vector<uint64_t> latencies;
+	uint64_t wakeups;
+} LatencyConsumer_t;
+
+static void DrainSocket(LatencyConsumer_t* consumer) {
+	uint64_t sentAt;
+
+	while(recv(consumer->fd, &sentAt, sizeof(sentAt), 0) == sizeof(sentAt)) {
+		consumer->latencies.push_back(BenchNowNs() - sentAt);
+	}
+}
+
+static void* LegacyLoop(LatencyConsumer_t* consumer) {
+	while(consumer->running) {
+		fd_set fds;
+		struct timeval tv;
+
+		FD_ZERO(&fds);
+		FD_SET(consumer->fd, &fds);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+
+		consumer->wakeups++;
+		if(select(consumer->fd + 1, &fds, NULL, NULL, &tv) > 0) {
+			DrainSocket(consumer);
+		}
+		usleep(250 * 1000);
+	}
+	return NULL;
+}
+
+static void* EpollLoop(LatencyConsumer_t* consumer) {
+	int readyFds[MONITOR_WAIT_MAX_FDS];
+
+	while(true) {
+		int ready = MonitorWaitNext(&consumer->wait, -1, readyFds, MONITOR_WAIT_MAX_FDS);
+		if(ready == MONITOR_WAIT_SHUTDOWN || ready < 0) {
+			break;
+		}
+
+		consumer->wakeups++;
+		DrainSocket(consumer);
+	}
+	return NULL;
+}
+
+static void* ConsumerThread(void* arg) {
+	LatencyConsumer_t* consumer = (LatencyConsumer_t*) arg;
+	return consumer->useEpoll ? EpollLoop(consumer) : LegacyLoop(consumer);
+}
+
+static void RunConsumer(const char* label, bool useEpoll, int events, int intervalMs, int idleMs) {
+	int fds[2];
+	pthread_t thread;
+	LatencyConsumer_t consumer;
+
+	socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+
+	consumer.fd = fds[0];
+	consumer.useEpoll = useEpoll;
+	consumer.running = true;
+	consumer.wakeups = 0;
+	consumer.latencies.reserve(events);
+	if(useEpoll) {
+		MonitorWaitInit(&consumer.wait);
+		MonitorWaitAddFd(&consumer.wait, consumer.fd, EPOLLIN);
+	}
+
+	pthread_create(&thread, NULL, ConsumerThread, &consumer);
+
+	// Idle phase: nothing is sent, every wakeup is wasted
+	BenchSleepMs(idleMs);
+	uint64_t idleWakeups = consumer.wakeups;
+
+	for(int i = 0; i < events; i++) {
+		uint64_t now = BenchNowNs();
+		send(fds[1], &now, sizeof(now), 0);
+		// Stagger the sends so they do not line up with the legacy poll period
+		BenchSleepMs(intervalMs + (i * 7) % intervalMs);
+	}
+	BenchSleepMs(300);
+
+	consumer.running = false;
+	if(useEpoll) {
+		MonitorWaitWake(&consumer.wait);
+	}
+	pthread_join(thread, NULL);
+
+	BenchPrintLatency(label, consumer.latencies);
+	printf("  %-24s idle wakeups/s=%.2f\n", "", idleWakeups * 1000.0 / idleMs);
+
+	if(useEpoll) {
+		MonitorWaitClose(&consumer.wait);
+	}
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int BenchMonitorLatency(int argc, char** argv) {
+	int events = BenchArgInt(argc, argv, 1, 40);
+	int intervalMs = BenchArgInt(argc, argv, 2, 40);
+	int idleMs = BenchArgInt(argc, argv, 3, 2000);
+
+	printf("monitor-latency: %d events, %d-%d ms apart, %d ms idle\n", events, intervalMs, 2 * intervalMs - 1, idleMs);
+	RunConsumer("select + usleep(250ms)", false, events, intervalMs, idleMs);
+	RunConsumer("epoll + eventfd", true, events, intervalMs, idleMs);
+
+	return 0;
+}
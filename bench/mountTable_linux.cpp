@@ -0,0 +1,138 @@
+#include <mntent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/mountTable_linux.h"
+
+/**********************************
+ * Compares the old mount lookup (a getmntent() scan of the whole table per
+ * device) with the indexed mount table. A synthetic table is written in
+ * both formats: mostly container overlay mounts, with one block device
+ * partition every 10 lines.
+ **********************************/
+
+typedef struct {
+	std::string source;
+	unsigned int major;
+	unsigned int minor;
+} BenchMount_t;
+
+static void WriteTables(const char* mountinfoPath, const char* mountsPath, int lines, std::vector<BenchMount_t>& devices) {
+	FILE* mountinfo = fopen(mountinfoPath, "w");
+	FILE* mounts = fopen(mountsPath, "w");
+
+	for(int i = 0; i < lines; i++) {
+		char source[64];
+		char target[128];
+
+		if(i % 10 == 0) {
+			BenchMount_t device;
+
+			snprintf(source, sizeof(source), "/dev/sd%c%c%d", 'a' + (i / 10) % 26, 'a' + (i / 260) % 26, 1 + i % 7);
+			snprintf(target, sizeof(target), "/media/usb%d", i);
+			fprintf(mountinfo, "%d 1 8:%d / %s rw,nosuid,nodev,relatime shared:%d - vfat %s rw\n", 100 + i, i, target, i, source);
+			fprintf(mounts, "%s %s vfat rw,nosuid,nodev,relatime 0 0\n", source, target);
+
+			device.source = source;
+			device.major = 8;
+			device.minor = i;
+			devices.push_back(device);
+		}
+		else {
+			snprintf(target, sizeof(target), "/var/lib/docker/overlay2/%08x%08x/merged", i * 2654435761u, i);
+			fprintf(mountinfo, "%d 1 0:%d / %s rw,relatime - overlay overlay rw,lowerdir=/l%d\n", 100 + i, 40 + i, target, i);
+			fprintf(mounts, "overlay %s overlay rw,relatime,lowerdir=/l%d 0 0\n", target, i);
+		}
+	}
+
+	fclose(mountinfo);
+	fclose(mounts);
+}
+
+// Mirror of the lookup the monitor thread did before the index existed
+static bool ScanMounts(const char* mountsPath, const char* devNode, std::string* mountPath) {
+	struct mntent* mnt;
+	FILE* fp = setmntent(mountsPath, "r");
+	bool found = false;
+
+	if(fp == NULL) {
+		return false;
+	}
+
+	while((mnt = getmntent(fp))) {
+		if(strcmp(mnt->mnt_fsname, devNode) == 0) {
+			*mountPath = mnt->mnt_dir;
+			found = true;
+		}
+	}
+
+	endmntent(fp);
+	return found;
+}
+
+int BenchMountTable(int argc, char** argv) {
+	int lines = BenchArgInt(argc, argv, 1, 5000);
+	int lookups = BenchArgInt(argc, argv, 2, 20000);
+	int rebuilds = BenchArgInt(argc, argv, 3, 50);
+	char mountinfoPath[] = "/tmp/detection_bench_mountinfo_XXXXXX";
+	char mountsPath[] = "/tmp/detection_bench_mounts_XXXXXX";
+	std::vector<BenchMount_t> devices;
+	std::vector<uint64_t> samples;
+	MountTable_t table;
+	std::string mountPath;
+	uint64_t found = 0;
+	uint64_t start;
+
+	close(mkstemp(mountinfoPath));
+	close(mkstemp(mountsPath));
+	WriteTables(mountinfoPath, mountsPath, lines, devices);
+
+	printf("mount-table: %d lines, %zu block devices, %d lookups\n", lines, devices.size(), lookups);
+
+	// The scan reads the whole file per lookup, so it gets fewer rounds
+	for(int i = 0; i < lookups / 100; i++) {
+		start = BenchNowNs();
+		found += ScanMounts(mountsPath, devices[i % devices.size()].source.c_str(), &mountPath);
+		samples.push_back(BenchNowNs() - start);
+	}
+	BenchPrintLatency("getmntent scan", samples);
+
+	samples.clear();
+	MountTableInit(&table, mountinfoPath);
+	for(int i = 0; i < rebuilds; i++) {
+		MountTableInvalidate(&table);
+		start = BenchNowNs();
+		MountTableRefresh(&table);
+		samples.push_back(BenchNowNs() - start);
+	}
+	BenchPrintLatency("index rebuild", samples);
+
+	// A regular file never reports POLLPRI, so this includes the staleness
+	// poll() but no rebuild, same as between two mount changes
+	start = BenchNowNs();
+	for(int i = 0; i < lookups; i++) {
+		const BenchMount_t& device = devices[i % devices.size()];
+		MountTableRefresh(&table);
+		found += MountTableFindDevice(&table, device.major, device.minor, &mountPath);
+	}
+	BenchPrintPerOp("index by major:minor", lookups, BenchNowNs() - start);
+
+	start = BenchNowNs();
+	for(int i = 0; i < lookups; i++) {
+		MountTableRefresh(&table);
+		found += MountTableFindSource(&table, devices[i % devices.size()].source.c_str(), false, &mountPath);
+	}
+	BenchPrintPerOp("index by source", lookups, BenchNowNs() - start);
+
+	printf("  %-24s found=%llu rebuilds=%llu\n", "", (unsigned long long) found, (unsigned long long) table.rebuilds);
+
+	MountTableClose(&table);
+	unlink(mountinfoPath);
+	unlink(mountsPath);
+
+	return 0;
+}
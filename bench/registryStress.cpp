@@ -0,0 +1,229 @@
+#include <atomic>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../src/deviceList.h"
+
+/**********************************
+ * Finder threads query the device list while a writer adds, removes and
+ * remounts devices as fast as it can, like find() on the thread pool
+ * racing the detection thread. Every record a finder gets has to be
+ * consistent with the device it came from, and the versions a finder sees
+ * must never go back. A follower keeps its own copy of the list up to date
+ * with the change log only, it has to end up with the same devices as the
+ * registry. Build with -Dsanitize=thread to run it under TSan.
+ **********************************/
+#define STRESS_VENDORS 16
+#define STRESS_PRODUCTS 4
+
+typedef struct {
+	uint64_t finds;
+	uint64_t records;
+	uint64_t errors;
+} StressFinder_t;
+
+static std::atomic<bool> isStressRunning;
+
+static DeviceItem_t* CreateStressItem(int i) {
+	DeviceItem_t* item = new DeviceItem_t();
+
+	item->deviceParams.devNode = "/dev/stress" + std::to_string(i);
+	item->deviceParams.vendorId = 0x1000 + i % STRESS_VENDORS;
+	item->deviceParams.productId = 0x2000 + (i / STRESS_VENDORS) % STRESS_PRODUCTS;
+	item->deviceParams.serialNumber = std::to_string(i);
+	item->deviceState = DeviceState_Connect;
+
+	return item;
+}
+
+// The serial number says which device the record belongs to
+static bool IsConsistent(const ListResultItem_t* record) {
+	int i = atoi(record->serialNumber.c_str());
+
+	return record->devNode == "/dev/stress" + std::to_string(i) &&
+		record->vendorId == 0x1000 + i % STRESS_VENDORS &&
+		record->productId == 0x2000 + (i / STRESS_VENDORS) % STRESS_PRODUCTS &&
+		(record->mountPath.empty() || record->mountPath == "/media/" + record->serialNumber);
+}
+
+static void RunFinder(StressFinder_t* finder, int seed) {
+	std::vector<DeviceRecord_t> results;
+	uint64_t lastVersion = 0;
+
+	for(int n = seed; isStressRunning.load(); n++) {
+		int vid = n % 3 == 0 ? 0 : 0x1000 + n % STRESS_VENDORS;
+		int pid = n % 3 == 2 ? 0x2000 + n % STRESS_PRODUCTS : 0;
+		uint64_t version = GetListVersion();
+
+		if(version < lastVersion) {
+			finder->errors++;
+		}
+		lastVersion = version;
+
+		CreateFilteredList(&results, vid, pid);
+		for(size_t i = 0; i < results.size(); i++) {
+			const ListResultItem_t* record = results[i].get();
+
+			if(!IsConsistent(record) || (vid && record->vendorId != vid) || (pid && record->productId != pid)) {
+				finder->errors++;
+			}
+		}
+
+		finder->records += results.size();
+		finder->finds++;
+		results.clear();
+	}
+}
+
+typedef struct {
+	// By devNode, like the registry keys
+	std::map<std::string, DeviceRecord_t> devices;
+	uint64_t version;
+	uint64_t polls;
+	uint64_t changes;
+	uint64_t resyncs;
+	uint64_t errors;
+} StressFollower_t;
+
+static void Follow(StressFollower_t* follower) {
+	std::vector<ListChange_t> changes;
+	std::vector<DeviceRecord_t> devices;
+	uint64_t version;
+
+	if(!CreateChangeList(&changes, follower->version, &version, &devices)) {
+		follower->devices.clear();
+		for(size_t i = 0; i < devices.size(); i++) {
+			follower->devices[devices[i]->devNode] = devices[i];
+		}
+		follower->resyncs++;
+	}
+
+	for(size_t i = 0; i < changes.size(); i++) {
+		const DeviceRecord_t& record = changes[i].record;
+
+		if(changes[i].isAdded) {
+			// Removed before, or never seen
+			if(!follower->devices.insert(std::make_pair(record->devNode, record)).second) {
+				follower->errors++;
+			}
+		}
+		else if(follower->devices.erase(record->devNode) == 0) {
+			follower->errors++;
+		}
+	}
+
+	if(version < follower->version) {
+		follower->errors++;
+	}
+	follower->version = version;
+	follower->changes += changes.size();
+	follower->polls++;
+}
+
+static void RunFollower(StressFollower_t* follower) {
+	while(isStressRunning.load()) {
+		Follow(follower);
+
+		// Fall behind now and then, far enough to need a resync
+		if(follower->polls % 50000 == 0) {
+			BenchSleepMs(250);
+		}
+	}
+}
+
+int BenchRegistryStress(int argc, char** argv) {
+	int finders = BenchArgInt(argc, argv, 1, 8);
+	int durationMs = BenchArgInt(argc, argv, 2, 2000);
+	int devices = BenchArgInt(argc, argv, 3, 256);
+	std::vector<StressFinder_t> results(finders);
+	std::vector<std::thread> threads;
+	std::vector<DeviceItem_t*> stored(devices, (DeviceItem_t*) NULL);
+	uint64_t writes = 0;
+	uint64_t errors = 0;
+	uint64_t finds = 0;
+	uint64_t records = 0;
+	StressFollower_t follower;
+
+	printf("registry-stress: %d finders, 1 writer, %d devices, %d ms\n", finders, devices, durationMs);
+
+	isStressRunning = true;
+	for(int i = 0; i < finders; i++) {
+		results[i].finds = results[i].records = results[i].errors = 0;
+		threads.push_back(std::thread(RunFinder, &results[i], i));
+	}
+	follower.version = follower.polls = follower.changes = follower.resyncs = follower.errors = 0;
+	std::thread followerThread(RunFollower, &follower);
+
+	// The writer: add, remount or remove a pseudo random device
+	uint64_t deadline = BenchNowNs() + (uint64_t) durationMs * 1000000ULL;
+	for(unsigned int n = 1; BenchNowNs() < deadline; n++) {
+		unsigned int i = (n * 2654435761u) % devices;
+		bool isBurst = n % 64 == 0;
+
+		if(isBurst) {
+			BeginListUpdate();
+		}
+
+		if(stored[i] == NULL) {
+			stored[i] = CreateStressItem(i);
+			AddItemToList((char*) stored[i]->deviceParams.devNode.c_str(), stored[i]);
+		}
+		else if(n % 2 == 0) {
+			stored[i]->deviceParams.mountPath = stored[i]->deviceParams.mountPath.empty() ? "/media/" + std::to_string(i) : "";
+			RefreshItemInList(stored[i]);
+		}
+		else {
+			RemoveItemFromList(stored[i]);
+			delete stored[i];
+			stored[i] = NULL;
+		}
+
+		if(isBurst) {
+			EndListUpdate();
+		}
+		writes++;
+	}
+
+	isStressRunning = false;
+	for(int i = 0; i < finders; i++) {
+		threads[i].join();
+		finds += results[i].finds;
+		records += results[i].records;
+		errors += results[i].errors;
+	}
+	followerThread.join();
+
+	// Catch up with the last changes and compare
+	std::vector<DeviceRecord_t> latest;
+	Follow(&follower);
+	CreateFilteredList(&latest, 0, 0);
+	if(latest.size() != follower.devices.size()) {
+		follower.errors++;
+	}
+	for(size_t i = 0; i < latest.size(); i++) {
+		std::map<std::string, DeviceRecord_t>::iterator it = follower.devices.find(latest[i]->devNode);
+		if(it == follower.devices.end() || it->second != latest[i]) {
+			follower.errors++;
+		}
+	}
+	errors += follower.errors;
+
+	printf("  %-24s writes=%llu finds=%llu records=%llu version=%llu\n",
+		"",
+		(unsigned long long) writes,
+		(unsigned long long) finds,
+		(unsigned long long) records,
+		(unsigned long long) GetListVersion());
+	printf("  %-24s polls=%llu changes=%llu resyncs=%llu\n",
+		"follower",
+		(unsigned long long) follower.polls,
+		(unsigned long long) follower.changes,
+		(unsigned long long) follower.resyncs);
+	printf("  %-24s errors=%llu\n", "", (unsigned long long) errors);
+
+	return errors == 0 ? 0 : 1;
+}
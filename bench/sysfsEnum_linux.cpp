@@ -0,0 +1,271 @@
+#include <libudev.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/sysfsEnum_linux.h"
+
+/**********************************
+ * Compares the libudev mass storage enumeration (one scan per SCSI device
+ * and per child lookup) with the sysfs enumerator. A fake sysfs tree with
+ * one USB disk and one partition per device is generated under /tmp.
+ *
+ * libudev always reads /sys, so its run happens in a child process that
+ * binds the fake tree over /sys in a private mount namespace. That needs
+ * CAP_SYS_ADMIN, without it only the sysfs enumerator is measured.
+ **********************************/
+
+static void WriteFile(const std::string& path, const std::string& content) {
+	FILE* fp = fopen(path.c_str(), "w");
+	if(fp) {
+		fputs(content.c_str(), fp);
+		fclose(fp);
+	}
+}
+
+static void MakeDirs(const std::string& path) {
+	for(size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+		mkdir(path.substr(0, slash).c_str(), 0755);
+	}
+	mkdir(path.c_str(), 0755);
+}
+
+// Both paths relative to the root, the link is made relative like in sysfs
+static void Link(const std::string& root, const std::string& link, const std::string& target) {
+	std::string up;
+	for(size_t i = 0; i < link.size(); i++) {
+		if(link[i] == '/') {
+			up += "../";
+		}
+	}
+	symlink((up + target).c_str(), (root + "/" + link).c_str());
+}
+
+static void AddDevice(const std::string& root, const std::string& path, const char* subsystem, const std::string& uevent) {
+	MakeDirs(root + "/" + path);
+	WriteFile(root + "/" + path + "/uevent", uevent);
+	Link(root, path + "/subsystem", subsystem);
+}
+
+// sda .. sdz, sdaa .. sdzz, like the kernel names them
+static std::string DiskName(int index) {
+	std::string suffix;
+	for(index++; index > 0; index = (index - 1) / 26) {
+		suffix.insert(suffix.begin(), (char) ('a' + (index - 1) % 26));
+	}
+	return "sd" + suffix;
+}
+
+static void GenerateTree(const std::string& root, int devices) {
+	char buffer[256];
+	const char* dirs[] = { "bus/usb/devices", "bus/scsi/devices", "class/block", "class/scsi_disk" };
+
+	for(size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		MakeDirs(root + "/" + dirs[i]);
+	}
+
+	for(int i = 0; i < devices; i++) {
+		int bus = i / 100 + 1;
+		std::string hub = "devices/pci0000:00/0000:00:14.0/usb" + std::to_string(bus);
+		std::string port = std::to_string(bus) + "-" + std::to_string(i % 100 + 1);
+		std::string usb = hub + "/" + port;
+		std::string interface = usb + "/" + port + ":1.0";
+		std::string lun = std::to_string(i) + ":0:0:0";
+		std::string scsi = interface + "/host" + std::to_string(i) + "/target" + std::to_string(i) + ":0:0/" + lun;
+		std::string disk = DiskName(i);
+		std::string block = scsi + "/block/" + disk;
+
+		if(i % 100 == 0) {
+			AddDevice(root, hub, "bus/usb", "DEVTYPE=usb_device\n");
+			WriteFile(root + "/" + hub + "/idVendor", "1d6b\n");
+			WriteFile(root + "/" + hub + "/idProduct", "0002\n");
+			Link(root, "bus/usb/devices/usb" + std::to_string(bus), hub);
+		}
+
+		AddDevice(root, usb, "bus/usb", "DEVTYPE=usb_device\n");
+		snprintf(buffer, sizeof(buffer), "%04x\n", 0x1000 + i % 64);
+		WriteFile(root + "/" + usb + "/idVendor", buffer);
+		snprintf(buffer, sizeof(buffer), "%04x\n", i);
+		WriteFile(root + "/" + usb + "/idProduct", buffer);
+		WriteFile(root + "/" + usb + "/product", "Bench disk " + std::to_string(i) + "\n");
+		WriteFile(root + "/" + usb + "/manufacturer", "Bench\n");
+		WriteFile(root + "/" + usb + "/serial", "SERIAL" + std::to_string(i) + "\n");
+		Link(root, "bus/usb/devices/" + port, usb);
+
+		AddDevice(root, interface, "bus/usb", "DEVTYPE=usb_interface\n");
+		Link(root, "bus/usb/devices/" + port + ":1.0", interface);
+
+		AddDevice(root, interface + "/host" + std::to_string(i), "bus/scsi", "DEVTYPE=scsi_host\n");
+		AddDevice(root, interface + "/host" + std::to_string(i) + "/target" + std::to_string(i) + ":0:0", "bus/scsi", "DEVTYPE=scsi_target\n");
+		AddDevice(root, scsi, "bus/scsi", "DEVTYPE=scsi_device\n");
+		Link(root, "bus/scsi/devices/" + lun, scsi);
+
+		AddDevice(root, scsi + "/scsi_disk/" + lun, "class/scsi_disk", "");
+		Link(root, "class/scsi_disk/" + lun, scsi + "/scsi_disk/" + lun);
+
+		snprintf(buffer, sizeof(buffer), "MAJOR=%d\nMINOR=%d\nDEVNAME=%s\nDEVTYPE=disk\n", 8 + i / 16, (i % 16) * 16, disk.c_str());
+		AddDevice(root, block, "class/block", buffer);
+		Link(root, "class/block/" + disk, block);
+
+		snprintf(buffer, sizeof(buffer), "MAJOR=%d\nMINOR=%d\nDEVNAME=%s1\nDEVTYPE=partition\n", 8 + i / 16, (i % 16) * 16 + 1, disk.c_str());
+		AddDevice(root, block + "/" + disk + "1", "class/block", buffer);
+		Link(root, "class/block/" + disk + "1", block + "/" + disk + "1");
+	}
+}
+
+// Mirror of get_child() in detection_linux.cpp
+static struct udev_device* GetChild(struct udev* udev, struct udev_device* parent, const char* subsystem) {
+	struct udev_device* child = NULL;
+	struct udev_enumerate* enumerate = udev_enumerate_new(udev);
+	struct udev_list_entry* entry;
+
+	udev_enumerate_add_match_parent(enumerate, parent);
+	udev_enumerate_add_match_subsystem(enumerate, subsystem);
+	udev_enumerate_scan_devices(enumerate);
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+		child = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+		break;
+	}
+
+	udev_enumerate_unref(enumerate);
+	return child;
+}
+
+// Mirror of the libudev enumeration in detection_linux.cpp, counting the disks
+static int EnumerateWithUdev() {
+	struct udev* udev = udev_new();
+	struct udev_enumerate* enumerate = udev_enumerate_new(udev);
+	struct udev_list_entry* entry;
+	int found = 0;
+
+	udev_enumerate_add_match_subsystem(enumerate, "scsi");
+	udev_enumerate_add_match_property(enumerate, "DEVTYPE", "scsi_device");
+	udev_enumerate_scan_devices(enumerate);
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+		struct udev_device* scsi = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+		if(!scsi) {
+			continue;
+		}
+
+		struct udev_device* block = GetChild(udev, scsi, "block");
+		struct udev_device* scsiDisk = GetChild(udev, scsi, "scsi_disk");
+		struct udev_device* usb = udev_device_get_parent_with_subsystem_devtype(scsi, "usb", "usb_device");
+
+		if(block && scsiDisk && usb && udev_device_get_sysattr_value(usb, "idVendor")) {
+			found++;
+		}
+
+		if(block) {
+			udev_device_unref(block);
+		}
+		if(scsiDisk) {
+			udev_device_unref(scsiDisk);
+		}
+		udev_device_unref(scsi);
+	}
+
+	udev_enumerate_unref(enumerate);
+	udev_unref(udev);
+	return found;
+}
+
+static int EnumerateWithSysfs(const char* root) {
+	std::vector<DeviceItem_t*> items;
+
+	SysfsEnumerateMassStorage(root, &items);
+	for(size_t i = 0; i < items.size(); i++) {
+		delete items[i];
+	}
+	return (int) items.size();
+}
+
+static void RunSysfs(const char* label, const char* root, int rounds) {
+	std::vector<uint64_t> samples;
+	int found = 0;
+
+	for(int i = 0; i < rounds; i++) {
+		uint64_t start = BenchNowNs();
+		found = EnumerateWithSysfs(root);
+		samples.push_back(BenchNowNs() - start);
+	}
+	BenchPrintLatency(label, samples);
+	printf("  %-24s disks=%d\n", "", found);
+}
+
+static void RunUdev(const char* label, int rounds) {
+	std::vector<uint64_t> samples;
+	int found = 0;
+
+	for(int i = 0; i < rounds; i++) {
+		uint64_t start = BenchNowNs();
+		found = EnumerateWithUdev();
+		samples.push_back(BenchNowNs() - start);
+	}
+	BenchPrintLatency(label, samples);
+	printf("  %-24s disks=%d\n", "", found);
+}
+
+// The fake tree replaces /sys for the child process only
+static void RunUdevOnTree(const std::string& root, int rounds) {
+	pid_t child;
+
+	fflush(stdout);
+	child = fork();
+
+	if(child == 0) {
+		if(unshare(CLONE_NEWNS) != 0 ||
+			mount("none", "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0 ||
+			mount(root.c_str(), "/sys", NULL, MS_BIND, NULL) != 0) {
+			printf("  %-24s skipped, binding the tree over /sys needs CAP_SYS_ADMIN\n", "libudev");
+			fflush(stdout);
+			_exit(0);
+		}
+
+		// systemd's libudev refuses a /sys that is not a sysfs mount otherwise
+		setenv("SYSTEMD_DEVICE_VERIFY_SYSFS", "0", 1);
+		RunUdev("libudev", rounds);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	waitpid(child, NULL, 0);
+}
+
+int BenchSysfsEnum(int argc, char** argv) {
+	int devices = BenchArgInt(argc, argv, 1, 2000);
+	int rounds = BenchArgInt(argc, argv, 2, 5);
+	char root[] = "/tmp/detection_bench_sysfs_XXXXXX";
+	std::string command;
+
+	if(mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	printf("sysfs-enum: generating %d USB disks in %s\n", devices, root);
+	GenerateTree(root, devices);
+
+	printf("generated tree, %d rounds\n", rounds);
+	RunSysfs("sysfs", root, rounds);
+	RunUdevOnTree(root, rounds);
+
+	printf("live /sys, %d rounds\n", rounds);
+	RunSysfs("sysfs", SYSFS_DEFAULT_ROOT, rounds);
+	RunUdev("libudev", rounds);
+
+	command = std::string("rm -rf ") + root;
+	if(system(command.c_str()) != 0) {
+		printf("could not remove %s\n", root);
+	}
+
+	return 0;
+}
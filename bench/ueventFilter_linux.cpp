@@ -0,0 +1,163 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/ueventSocket_linux.h"
+
+/**********************************
+ * Replays a synthetic kernel uevent stream through a datagram socketpair,
+ * once without and once with the socket filter of the kernel uevent
+ * source. Socket filters run on AF_UNIX sockets the same way as on the
+ * netlink socket, so the dropped events never reach the consumer.
+ *
+ * The stream is what a container host looks like: mostly loop, veth and
+ * bind events, two USB partition events in ten.
+ **********************************/
+#define REPLAY_STOP_DEVPATH "/devices/replay-stop"
+
+typedef struct {
+	int fd;
+	uint64_t delivered;
+	uint64_t matched;
+	uint64_t wakeups;
+	uint64_t cpuNs;
+} ReplayConsumer_t;
+
+static std::string Uevent(const char* action, const std::string& devpath, const char* subsystem, const char* devtype, const char* devname, int seqnum) {
+	std::string message = std::string(action) + "@" + devpath;
+	message += '\0';
+	message += std::string("ACTION=") + action + '\0';
+	message += "DEVPATH=" + devpath + '\0';
+	message += std::string("SUBSYSTEM=") + subsystem + '\0';
+	if(devtype) {
+		message += std::string("DEVTYPE=") + devtype + '\0';
+	}
+	if(devname) {
+		message += std::string("DEVNAME=") + devname + '\0';
+	}
+	message += "SEQNUM=" + std::to_string(seqnum) + '\0';
+	return message;
+}
+
+static std::string ReplayEvent(int i) {
+	std::string usb = "/devices/pci0000:00/0000:00:14.0/usb1/1-1";
+	std::string loop = "loop" + std::to_string(i % 64);
+	std::string veth = "veth" + std::to_string(i % 128);
+
+	switch(i % 10) {
+		case 0: case 1: case 2: case 3:
+			return Uevent("change", "/devices/virtual/block/" + loop, "block", "disk", loop.c_str(), i);
+		case 4:
+			return Uevent("add", "/devices/virtual/net/" + veth, "net", NULL, NULL, i);
+		case 5:
+			return Uevent("remove", "/devices/virtual/net/" + veth, "net", NULL, NULL, i);
+		case 6:
+			return Uevent("bind", usb + "/1-1:1.0", "usb", "usb_interface", NULL, i);
+		case 7:
+			return Uevent("add", usb + "/1-1:1.0/host0/target0:0:0/0:0:0:0", "scsi", "scsi_device", NULL, i);
+		case 8:
+			return Uevent("add", usb + "/1-1:1.0/host0/target0:0:0/0:0:0:0/block/sdb/sdb1", "block", "partition", "sdb1", i);
+		default:
+			return Uevent("remove", usb + "/1-1:1.0/host0/target0:0:0/0:0:0:0/block/sdb/sdb1", "block", "partition", "sdb1", i);
+	}
+}
+
+static void* ConsumerThread(void* arg) {
+	ReplayConsumer_t* consumer = (ReplayConsumer_t*) arg;
+	char buffer[UEVENT_BUFFER_SIZE];
+	struct pollfd pfd;
+	struct timespec start;
+	struct timespec end;
+	bool running = true;
+
+	pfd.fd = consumer->fd;
+	pfd.events = POLLIN;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	while(running && poll(&pfd, 1, -1) > 0) {
+		ssize_t length;
+		Uevent_t event;
+
+		consumer->wakeups++;
+		while(running && (length = UeventReceive(consumer->fd, buffer, sizeof(buffer))) > 0) {
+			consumer->delivered++;
+			if(!UeventParse(buffer, length, &event)) {
+				continue;
+			}
+
+			if(strcmp(event.devpath, REPLAY_STOP_DEVPATH) == 0) {
+				running = false;
+			}
+			else if(strcmp(event.subsystem, "block") == 0 && event.devtype && strcmp(event.devtype, "partition") == 0) {
+				consumer->matched++;
+			}
+		}
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+	consumer->cpuNs = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+	return NULL;
+}
+
+static void RunReplay(const char* label, bool filtered, const std::vector<std::string>& stream) {
+	int fds[2];
+	pthread_t thread;
+	ReplayConsumer_t consumer;
+	std::string stop = Uevent("add", REPLAY_STOP_DEVPATH, "replay", NULL, NULL, 0);
+
+	// Only the receiving end is non-blocking, like the netlink socket
+	socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds);
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	if(filtered && !UeventAttachFilter(fds[0])) {
+		printf("  %-24s could not attach the filter\n", label);
+		return;
+	}
+
+	memset(&consumer, 0, sizeof(consumer));
+	consumer.fd = fds[0];
+	pthread_create(&thread, NULL, ConsumerThread, &consumer);
+
+	uint64_t start = BenchNowNs();
+	for(size_t i = 0; i < stream.size(); i++) {
+		send(fds[1], stream[i].data(), stream[i].size(), 0);
+	}
+	send(fds[1], stop.data(), stop.size(), 0);
+	pthread_join(thread, NULL);
+	uint64_t elapsed = BenchNowNs() - start;
+
+	// The producer is the bottleneck of the replay, the consumer CPU time
+	// says how many events per second the consumer could keep up with
+	printf("  %-24s replay=%8.0f events/s  consumer=%9.0f events/s per core  delivered=%-7llu matched=%-6llu wakeups=%llu\n",
+		label,
+		stream.size() * 1e9 / elapsed,
+		consumer.cpuNs ? stream.size() * 1e9 / consumer.cpuNs : 0.0,
+		(unsigned long long) consumer.delivered,
+		(unsigned long long) consumer.matched,
+		(unsigned long long) consumer.wakeups);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int BenchUeventFilter(int argc, char** argv) {
+	int events = BenchArgInt(argc, argv, 1, 200000);
+	std::vector<std::string> stream;
+
+	stream.reserve(events);
+	for(int i = 0; i < events; i++) {
+		stream.push_back(ReplayEvent(i));
+	}
+
+	printf("uevent-filter: replaying %d uevents, 20%% USB partition add/remove\n", events);
+	RunReplay("unfiltered", false, stream);
+	RunReplay("socket filter", true, stream);
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/deviceList.h"
+#include "../src/sysfsEnum_linux.h"
+#include "../src/ueventReplay_linux.h"
+#include "../src/ueventSocket_linux.h"
+
+/**********************************
+ * A hotplug storm, recorded and replayed end to end: `devices` USB disks
+ * are added and removed `rounds` times, one uevent every millisecond.
+ *
+ * The events are recorded with the recorder of the addon against a
+ * generated tree, so the recording carries the USB attributes, then
+ * replayed into an empty root at the recorded pace times `speed` and as
+ * fast as possible. The consumer does what the kernel source of the addon
+ * does with each event: parse it, read the device from the replay root
+ * and update the device list. It has to end up with the ids of the
+ * recorded devices and an empty list.
+ **********************************/
+#define REPLAY_INTERVAL_NS (1000 * 1000ULL)
+
+typedef struct {
+	uint64_t received;
+	uint64_t added;
+	uint64_t errors;
+} ReplayResult_t;
+
+static std::string DevPath(int i) {
+	std::string port = "1-" + std::to_string(i + 1);
+	return "/devices/pci0000:00/0000:00:14.0/usb1/" + port + "/" + port + ":1.0/host" + std::to_string(i) +
+		"/target" + std::to_string(i) + ":0:0/" + std::to_string(i) + ":0:0:0/block/sd" + std::to_string(i) + "/sd" + std::to_string(i) + "1";
+}
+
+static std::string UsbPath(int i) {
+	return "devices/pci0000:00/0000:00:14.0/usb1/1-" + std::to_string(i + 1);
+}
+
+static std::string Uevent(const char* action, int i, int seqnum) {
+	std::string devpath = DevPath(i);
+	std::string devname = "sd" + std::to_string(i) + "1";
+	std::string message = std::string(action) + "@" + devpath;
+
+	message += '\0';
+	message += std::string("ACTION=") + action + '\0';
+	message += "DEVPATH=" + devpath + '\0';
+	message += std::string("SUBSYSTEM=block") + '\0';
+	message += std::string("DEVTYPE=partition") + '\0';
+	message += "DEVNAME=" + devname + '\0';
+	message += "SEQNUM=" + std::to_string(seqnum) + '\0';
+	return message;
+}
+
+static void WriteAttribute(const std::string& path, const std::string& value) {
+	FILE* fp = fopen(path.c_str(), "w");
+	if(fp) {
+		fprintf(fp, "%s\n", value.c_str());
+		fclose(fp);
+	}
+}
+
+// Only what the recorder and the sysfs reader look at
+static void GenerateLiveTree(const std::string& root, int devices) {
+	char buffer[16];
+
+	mkdir(root.c_str(), 0755);
+	for(int i = 0; i < devices; i++) {
+		std::string usb = root + "/" + UsbPath(i);
+		std::string path = root + "/" + DevPath(i).substr(1);
+
+		for(size_t slash = path.find('/', root.size() + 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+			mkdir(path.substr(0, slash).c_str(), 0755);
+		}
+
+		snprintf(buffer, sizeof(buffer), "%04x", 0x1000 + i % 64);
+		WriteAttribute(usb + "/idVendor", buffer);
+		snprintf(buffer, sizeof(buffer), "%04x", i);
+		WriteAttribute(usb + "/idProduct", buffer);
+		WriteAttribute(usb + "/product", "Replay disk " + std::to_string(i));
+		WriteAttribute(usb + "/manufacturer", "Replay");
+		WriteAttribute(usb + "/serial", "REPLAY" + std::to_string(i));
+	}
+}
+
+static bool Record(const std::string& path, const std::string& liveRoot, int devices, int rounds) {
+	UeventRecorder_t recorder;
+	int seqnum = 0;
+
+	if(!UeventRecorderOpen(&recorder, path.c_str())) {
+		return false;
+	}
+
+	// Starts at 1, the recorder takes the first time as its origin
+	for(int round = 0; round < rounds; round++) {
+		for(int i = 0; i < devices; i++, seqnum++) {
+			std::string message = Uevent("add", i, seqnum);
+			UeventRecorderWrite(&recorder, 1 + seqnum * REPLAY_INTERVAL_NS, message.data(), message.size(), liveRoot.c_str());
+		}
+		for(int i = 0; i < devices; i++, seqnum++) {
+			std::string message = Uevent("remove", i, seqnum);
+			UeventRecorderWrite(&recorder, 1 + seqnum * REPLAY_INTERVAL_NS, message.data(), message.size(), liveRoot.c_str());
+		}
+	}
+
+	UeventRecorderClose(&recorder);
+	return true;
+}
+
+// HandleUevent() of detection_linux.cpp, without the mount lookup and the JS side
+static void HandleReplayedUevent(const Uevent_t* event, const char* root, ReplayResult_t* result) {
+	std::string devNode = std::string("/dev/") + event->devname;
+
+	if(strcmp(event->action, "add") == 0) {
+		DeviceItem_t* item = SysfsReadUsbBlockDevice(root, event->devpath, event->devname);
+
+		if(item == NULL) {
+			result->errors++;
+			return;
+		}
+
+		// The serial number says which device the attributes belong to
+		int i = atoi(item->deviceParams.serialNumber.c_str() + strlen("REPLAY"));
+		if(devNode != "/dev/sd" + std::to_string(i) + "1" ||
+			item->deviceParams.vendorId != 0x1000 + i % 64 ||
+			item->deviceParams.productId != i) {
+			result->errors++;
+		}
+
+		AddItemToList((char*) devNode.c_str(), item);
+		result->added++;
+	}
+	else {
+		DeviceItem_t* item = GetItemFromList((char*) devNode.c_str());
+
+		if(item == NULL) {
+			result->errors++;
+			return;
+		}
+
+		RemoveItemFromList(item);
+		delete item;
+	}
+}
+
+static uint64_t RunReplay(const char* label, const std::string& path, const std::string& root, int speed) {
+	UeventReplay_t replay;
+	ReplayResult_t result;
+	std::vector<uint64_t> samples;
+	char buffer[UEVENT_BUFFER_SIZE];
+	struct pollfd pfd;
+
+	if(!UeventReplayStart(&replay, path.c_str(), speed, root.c_str())) {
+		printf("  %-24s could not start the replay\n", label);
+		return 1;
+	}
+
+	memset(&result, 0, sizeof(result));
+	pfd.fd = replay.fds[0];
+	pfd.events = POLLIN;
+
+	uint64_t start = BenchNowNs();
+	while(result.received < replay.records.size() && poll(&pfd, 1, 1000) > 0) {
+		ssize_t length;
+		Uevent_t event;
+
+		while((length = UeventReceive(replay.fds[0], buffer, sizeof(buffer))) > 0) {
+			// Nothing is filtered, so the events arrive in the recorded order
+			samples.push_back(BenchNowNs() - replay.sentNs[result.received]);
+			result.received++;
+
+			if(!UeventParse(buffer, length, &event) || event.devname == NULL) {
+				result.errors++;
+				continue;
+			}
+			HandleReplayedUevent(&event, root.c_str(), &result);
+		}
+	}
+	uint64_t elapsed = BenchNowNs() - start;
+
+	if(result.received != replay.records.size() || GetListSize() != 0) {
+		result.errors++;
+	}
+	UeventReplayStop(&replay);
+
+	printf("  %-24s %9.0f events/s  received=%llu added=%llu errors=%llu\n",
+		label,
+		result.received * 1e9 / elapsed,
+		(unsigned long long) result.received,
+		(unsigned long long) result.added,
+		(unsigned long long) result.errors);
+	BenchPrintLatency("  send to handled", samples);
+
+	return result.errors;
+}
+
+int BenchUeventReplay(int argc, char** argv) {
+	int devices = BenchArgInt(argc, argv, 1, 256);
+	int rounds = BenchArgInt(argc, argv, 2, 20);
+	int speed = BenchArgInt(argc, argv, 3, 10);
+	char dir[] = "/tmp/detection_bench_replay_XXXXXX";
+	std::string command;
+	char label[32];
+	uint64_t errors = 0;
+
+	if(mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	std::string recording = std::string(dir) + "/storm.uevents";
+	std::string liveRoot = std::string(dir) + "/live";
+	std::string replayRoot = std::string(dir) + "/replay";
+
+	printf("uevent-replay: %d devices added and removed %d times, %d uevents 1 ms apart\n", devices, rounds, devices * rounds * 2);
+	GenerateLiveTree(liveRoot, devices);
+	mkdir(replayRoot.c_str(), 0755);
+
+	if(!Record(recording, liveRoot, devices, rounds)) {
+		printf("could not record to %s\n", recording.c_str());
+		return 1;
+	}
+
+	snprintf(label, sizeof(label), "%dx", speed);
+	errors += RunReplay(label, recording, replayRoot, speed);
+	errors += RunReplay("max", recording, replayRoot, 0);
+
+	command = std::string("rm -rf ") + dir;
+	if(system(command.c_str()) != 0) {
+		printf("could not remove %s\n", dir);
+	}
+
+	return errors == 0 ? 0 : 1;
+}
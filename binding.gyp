@@ -1,11 +1,25 @@
 {
+  "variables": {
+    # Build the native benchmark runner: node-gyp rebuild -- -Dbuild_benchmarks=true
+    "build_benchmarks%": "false",
+    # Sanitizer for the benchmark runner, for example -Dsanitize=thread
+    "sanitize%": ""
+  },
   "targets": [
     {
       "target_name": "detection",
       "sources": [
+        "src/binaryList.cpp",
+        "src/debounce.cpp",
         "src/detection.cpp",
         "src/detection.h",
-        "src/deviceList.cpp"
+        "src/deviceList.cpp",
+        "src/eventHistory.cpp",
+        "src/eventQueue.cpp",
+        "src/latencyHistogram.cpp",
+        "src/monitorHost.cpp",
+        "src/syntheticEvents.cpp",
+        "src/topicRoutes.cpp"
       ],
       "include_dirs" : [
         "<!(node -e \"require('nan')\")"
@@ -36,7 +50,13 @@
         ['OS=="linux"',
           {
             'sources': [
-              "src/detection_linux.cpp"
+              "src/detection_linux.cpp",
+              "src/monitorWait_linux.cpp",
+              "src/mountTable_linux.cpp",
+              "src/mountWatch_linux.cpp",
+              "src/sysfsEnum_linux.cpp",
+              "src/ueventReplay_linux.cpp",
+              "src/ueventSocket_linux.cpp"
             ],
             'link_settings': {
               'libraries': [
@@ -47,5 +67,65 @@
         ]
       ]
     }
+  ],
+  "conditions": [
+    ['build_benchmarks=="true"',
+      {
+        "targets": [
+          {
+            "target_name": "detection_bench",
+            "type": "executable",
+            "sources": [
+              "bench/main.cpp",
+              "bench/bench.cpp",
+              "bench/allocCount.cpp",
+              "bench/debounce.cpp",
+              "bench/deviceList.cpp",
+              "bench/hotPaths.cpp",
+              "bench/latencyHistogram.cpp",
+              "bench/registryStress.cpp",
+              "src/debounce.cpp",
+              "src/deviceList.cpp",
+              "src/eventQueue.cpp",
+              "src/latencyHistogram.cpp"
+            ],
+            'conditions': [
+              ['sanitize!=""',
+                {
+                  'cflags+': [ '-fsanitize=<(sanitize)', '-g' ],
+                  'ldflags+': [ '-fsanitize=<(sanitize)' ],
+                  'xcode_settings': {
+                    'OTHER_CFLAGS+': [ '-fsanitize=<(sanitize)', '-g' ],
+                    'OTHER_LDFLAGS+': [ '-fsanitize=<(sanitize)' ]
+                  }
+                }
+              ],
+              ['OS=="linux"',
+                {
+                  'sources': [
+                    "bench/monitorLatency_linux.cpp",
+                    "bench/mountTable_linux.cpp",
+                    "bench/sysfsEnum_linux.cpp",
+                    "bench/ueventFilter_linux.cpp",
+                    "bench/ueventReplay_linux.cpp",
+                    "src/monitorWait_linux.cpp",
+                    "src/mountTable_linux.cpp",
+                    "src/sysfsEnum_linux.cpp",
+                    "src/ueventReplay_linux.cpp",
+                    "src/ueventSocket_linux.cpp"
+                  ],
+                  'link_settings': {
+                    'libraries': [
+                      '-lpthread',
+                      '-ludev'
+                    ]
+                  }
+                }
+              ]
+            ]
+          }
+        ]
+      }
+    ]
   ]
 }
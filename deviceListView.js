@@ -0,0 +1,114 @@
+/*eslint-env node */
+
+// Reads the ArrayBuffer of `findBinary()` without turning it into objects
+// up front. Numbers are read straight from their column, strings are
+// decoded the first time they are asked for. The layout is documented in
+// the README under "Binary device list format".
+
+var MAGIC = 0x44425355; // "USBD"
+var FORMAT_VERSION = 1;
+
+var OFFSET_MAGIC = 0;
+var OFFSET_FORMAT_VERSION = 4;
+var OFFSET_HEADER_SIZE = 6;
+var OFFSET_DEVICE_COUNT = 8;
+var OFFSET_STRING_COUNT = 12;
+var OFFSET_LIST_VERSION = 16;
+var OFFSET_STRING_TABLE = 24;
+
+// Column order of the format, strings are string table indexes
+var COLUMNS = [
+	'locationId',
+	'vendorId',
+	'productId',
+	'deviceAddress',
+	'deviceName',
+	'manufacturer',
+	'serialNumber',
+	'devNode',
+	'mountPath'
+];
+var FIRST_STRING_COLUMN = 4;
+
+function DeviceListView(buffer) {
+	var view = new DataView(buffer);
+
+	if(view.getUint32(OFFSET_MAGIC, true) !== MAGIC) {
+		throw new Error('Not a binary device list');
+	}
+	if(view.getUint16(OFFSET_FORMAT_VERSION, true) !== FORMAT_VERSION) {
+		throw new Error('Unsupported binary device list version ' + view.getUint16(OFFSET_FORMAT_VERSION, true));
+	}
+
+	this.buffer = buffer;
+	this.length = view.getUint32(OFFSET_DEVICE_COUNT, true);
+	// Version of the device list the devices were read from, see findBinary()
+	this.listVersion = view.getUint32(OFFSET_LIST_VERSION, true) + view.getUint32(OFFSET_LIST_VERSION + 4, true) * 0x100000000;
+
+	this._view = view;
+	this._columnsOffset = view.getUint16(OFFSET_HEADER_SIZE, true);
+	this._stringTableOffset = view.getUint32(OFFSET_STRING_TABLE, true);
+	this._stringCount = view.getUint32(OFFSET_STRING_COUNT, true);
+	this._stringBytesOffset = this._stringTableOffset + (this._stringCount + 1) * 4;
+	this._strings = new Array(this._stringCount);
+}
+
+DeviceListView.prototype._cell = function(column, index) {
+	if(index < 0 || index >= this.length) {
+		throw new RangeError('Device index out of range: ' + index);
+	}
+
+	var offset = this._columnsOffset + (column * this.length + index) * 4;
+	if(column < FIRST_STRING_COLUMN) {
+		return this._view.getInt32(offset, true);
+	}
+	return this._string(this._view.getUint32(offset, true));
+};
+
+DeviceListView.prototype._string = function(stringIndex) {
+	var value = this._strings[stringIndex];
+
+	if(value === undefined) {
+		var start = this._view.getUint32(this._stringTableOffset + stringIndex * 4, true);
+		var end = this._view.getUint32(this._stringTableOffset + (stringIndex + 1) * 4, true);
+
+		value = Buffer.from(this.buffer, this._stringBytesOffset + start, end - start).toString('utf8');
+		this._strings[stringIndex] = value;
+	}
+
+	return value;
+};
+
+// One accessor per field, `view.vendorId(i)`
+COLUMNS.forEach(function(name, column) {
+	DeviceListView.prototype[name] = function(index) {
+		return this._cell(column, index);
+	};
+});
+
+// The same object `find()` returns for the device, keys in the same order
+DeviceListView.prototype.get = function(index) {
+	return {
+		locationId: this._cell(0, index),
+		vendorId: this._cell(1, index),
+		productId: this._cell(2, index),
+		deviceName: this._cell(4, index),
+		manufacturer: this._cell(5, index),
+		serialNumber: this._cell(6, index),
+		deviceAddress: this._cell(3, index),
+		devNode: this._cell(7, index),
+		mountPath: this._cell(8, index)
+	};
+};
+
+DeviceListView.prototype.toArray = function() {
+	var devices = new Array(this.length);
+
+	for(var i = 0; i < this.length; i++) {
+		devices[i] = this.get(i);
+	}
+
+	return devices;
+};
+
+module.exports = DeviceListView;
@@ -16,49 +16,71 @@ if (global[index.name] && global[index.name].version === index.version) {
 		maxListeners: 1000 // default would be 10!
 	});
 
+	// Resolved once the initial device list is complete. It is read in the
+	// background, so loading the module does not wait for it.
+	detector.ready = new Promise(function(resolve) {
+		detection.registerReady(resolve);
+	});
+
 	//detector.find = detection.find;
 	detector.find = function(vid, pid, callback) {
-		// Suss out the optional parameters
-		if(!pid && !callback) {
+		// Suss out the optional parameters, `find(vid, pid)` has no callback
+		if(typeof vid === 'function') {
 			callback = vid;
 			vid = undefined;
 		}
-		else if(!callback) {
+		else if(typeof pid === 'function') {
 			callback = pid;
 			pid = undefined;
 		}
 
-		return new Promise(function(resolve, reject) {
-			// Assemble the optional args into something we can use with `apply`
-			var args = [];
-			if(vid) {
-				args = args.concat(vid);
-			}
-			if(pid) {
-				args = args.concat(pid);
-			}
-
-			// Tack on our own callback that takes care of things
-			args = args.concat(function(err, devices) {
+		return new Promise(function(resolve) {
+			// Read the device list once there is one to look at. It is in
+			// memory, so no need for a trip through the thread pool.
+			detector.ready.then(function() {
+				var devices = detector.findSync(vid, pid);
 
 				// We call the callback if they passed one
 				if(callback) {
-					callback.call(callback, err, devices);
+					callback.call(callback, undefined, devices);
 				}
 
 				// But also do the promise stuff
-				if(err) {
-					reject(err);
-					return;
-				}
 				resolve(devices);
 			});
-
-			// Fire off the `find` function that actually does all of the work
-			detection.find.apply(detection, args);
 		});
 	};
 
+	// Synchronous `find(vid, pid)`: returns the devices right away. Before
+	// `ready` resolved the initial device list is not there yet.
+	detector.findSync = function(vid, pid) {
+		// Assemble the optional args into something we can use with `apply`
+		var args = [];
+		if(vid) {
+			args = args.concat(vid);
+		}
+		if(pid) {
+			args = args.concat(pid);
+		}
+
+		return detection.findSync.apply(detection, args);
+	};
+
+	// `findSync(vid, pid)` packed into one ArrayBuffer, read it with
+	// `new DeviceListView(buffer)`. See "Binary device list format" in the README.
+	detector.findBinary = function(vid, pid) {
+		return detection.findBinary(vid || 0, pid || 0);
+	};
+
+	detector.DeviceListView = require('./deviceListView');
+
+	// What changed after `generation`: `{ generation, resync, changes }`, or
+	// `{ generation, resync: true, devices }` when it is too far back. Pass
+	// the returned generation next time, start with any, like `0`.
+	detector.changesSince = function(generation) {
+		return detection.changesSince(generation || 0);
+	};
+
 	detection.registerAdded(function(device) {
 		detector.emit('add:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('insert:' + device.vendorId + ':' + device.productId, device);
@@ -82,13 +104,142 @@ if (global[index.name] && global[index.name].version === index.version) {
 		detector.emit('change', device);
 	});
 	
+	// The mount of a device showed up after it was reported as added
+	detection.registerMounted(function(device) {
+		detector.emit('mount:' + device.vendorId + ':' + device.productId, device);
+		detector.emit('mount:' + device.vendorId, device);
+		detector.emit('mount', device);
+	});
+
+	// Only the device topics somebody listens to are emitted. The native side
+	// keeps a route per listened-to topic and passes the ids of the ones a
+	// device event matches, the callbacks above are only used once there is
+	// a wildcard listener, which the routes cannot express.
+	var TOPIC_TYPES = ['add', 'insert', 'remove', 'change', 'mount'];
+	var WILDCARD_TOPIC = {};
+	var routeIds = {};
+	var routeTopics = [null];
+	var routedTopics = {};
+	var isRouteAll = false;
+
+	// `{ type, level, vendorId, productId }` for a topic the native side can
+	// route, WILDCARD_TOPIC, or null for events that are not about devices
+	function parseTopic(event) {
+		var parts = (Array.isArray(event) ? event.join(':') : String(event)).split(':');
+		var type = TOPIC_TYPES.indexOf(parts[0]);
+
+		if(parts.some(function(part) { return part.indexOf('*') >= 0; })) {
+			return WILDCARD_TOPIC;
+		}
+		// Never emitted, like 'add:0x1234' or 'add:1:2:3'
+		if(type < 0 || parts.length > 3 || !parts.slice(1).every(function(part) { return String(parseInt(part, 10)) === part; })) {
+			return null;
+		}
+
+		return {
+			name: parts.join(':'),
+			type: type,
+			level: parts.length - 1,
+			vendorId: parts.length > 1 ? parseInt(parts[1], 10) : 0,
+			productId: parts.length > 2 ? parseInt(parts[2], 10) : 0
+		};
+	}
+
+	function updateRoute(event) {
+		var topic = parseTopic(event);
+
+		if(topic === WILDCARD_TOPIC) {
+			if(!isRouteAll) {
+				isRouteAll = true;
+				detection.setRouteAll(true);
+			}
+			return;
+		}
+		if(!topic) {
+			return;
+		}
+
+		var isListened = detector.listeners(topic.name).length > 0;
+		if(isListened === !!routedTopics[topic.name]) {
+			return;
+		}
+
+		// A topic keeps its id, listening to it again reuses it
+		var id = routeIds[topic.name];
+		if(!id) {
+			id = routeTopics.length;
+			routeIds[topic.name] = id;
+			routeTopics.push(topic.name);
+		}
+
+		if(detection.setRoute(topic.type, topic.level, topic.vendorId, topic.productId, isListened ? id : 0)) {
+			routedTopics[topic.name] = isListened;
+		}
+	}
+
+	// Every way to add or remove a listener ends up here
+	['on', 'addListener', 'once', 'many', 'prependListener', 'prependOnceListener', 'prependMany', 'off', 'removeListener'].forEach(function(method) {
+		var original = detector[method];
+		if(typeof original !== 'function') {
+			return;
+		}
+
+		detector[method] = function(event) {
+			var result = original.apply(this, arguments);
+			updateRoute(event);
+			return result;
+		};
+	});
+
+	var removeAllListeners = detector.removeAllListeners;
+	detector.removeAllListeners = function(event) {
+		var result = removeAllListeners.apply(this, arguments);
+
+		if(arguments.length > 0) {
+			updateRoute(event);
+		}
+		else {
+			Object.keys(routedTopics).forEach(updateRoute);
+		}
+		return result;
+	};
+
+	var onAny = detector.onAny;
+	detector.onAny = function() {
+		if(!isRouteAll) {
+			isRouteAll = true;
+			detection.setRouteAll(true);
+		}
+		return onAny.apply(this, arguments);
+	};
+
+	detection.registerRouted(function(device) {
+		for(var i = 1; i < arguments.length; i++) {
+			detector.emit(routeTopics[arguments[i]], device);
+		}
+	});
+
+	// Events that were dropped or merged because JS fell behind, or that the
+	// kernel dropped: `{ dropped, coalesced, monitorOverruns }` since the last one
+	detection.registerOverflow(function(overflow) {
+		detector.emit('overflow', overflow);
+	});
+
 	detection.registerLog(function(msg) {
 		detector.emit('log', msg);
 	});
 
 	var started = true;
 
-	detector.startMonitoring = function() {
+	// `options` narrows down what is monitored: `{ vendorId, productId, subsystems }`.
+	// Passing new options while monitoring replaces the filter in place.
+	detector.startMonitoring = function(options) {
+		if(options) {
+			started = true;
+			detection.startMonitoring(options);
+			return;
+		}
+
 		if(started) {
 			return;
 		}
@@ -106,6 +257,46 @@ if (global[index.name] && global[index.name].version === index.version) {
 		detection.stopMonitoring();
 	};
 
+	detector.configure = function(options) {
+		detection.configure(options || {});
+	};
+
+	// Opt-in: deliver the queued device events as one array per loop turn
+	// instead of emitting `add`/`remove`/`change` for every device.
+	// Pass `null` to go back to the events.
+	detector.registerBatch = function(callback, options) {
+		if(!callback) {
+			detection.registerBatch(null);
+			return;
+		}
+
+		options = options || {};
+		detection.registerBatch(callback, options.maxBatch || 0, options.maxDelayMs || 0);
+	};
+
+	detector.getStats = function() {
+		return detection.getStats();
+	};
+
+	// Calls `callback({ seq, type, device })` for every device event. With
+	// `options.fromSeq` it first replays the kept events from that sequence
+	// number on, to resume after the last `seq` seen. Returns `{ unsubscribe }`.
+	detector.subscribe = function(options, callback) {
+		if(typeof options === 'function') {
+			callback = options;
+			options = undefined;
+		}
+
+		options = options || {};
+		var id = detection.subscribe(options.fromSeq || 0, callback);
+
+		return {
+			unsubscribe: function() {
+				detection.unsubscribe(id);
+			}
+		};
+	};
+
 	detector.version = index.version;
 	global[index.name] = detector;
 
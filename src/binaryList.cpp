@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "binaryList.h"
+
+#define BINARY_LIST_STRING_FIELDS (BinaryListColumn_Count - BinaryListColumn_DeviceName)
+
+
+static void PutU16(uint8_t* at, uint16_t value) {
+	at[0] = (uint8_t) value;
+	at[1] = (uint8_t) (value >> 8);
+}
+
+static void PutU32(uint8_t* at, uint32_t value) {
+	at[0] = (uint8_t) value;
+	at[1] = (uint8_t) (value >> 8);
+	at[2] = (uint8_t) (value >> 16);
+	at[3] = (uint8_t) (value >> 24);
+}
+
+static uint32_t AddString(BinaryListLayout_t* layout, const std::string& value) {
+	if(value.empty()) {
+		return 0;
+	}
+
+	std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> added =
+		layout->stringIndexes.insert(std::make_pair(value, (uint32_t) layout->strings.size()));
+
+	if(added.second) {
+		layout->strings.push_back(&added.first->first);
+		layout->stringBytes += value.size();
+	}
+
+	return added.first->second;
+}
+
+void BinaryListLayout(const std::vector<DeviceRecord_t>& records, BinaryListLayout_t* layout) {
+	static const std::string empty;
+
+	layout->strings.clear();
+	layout->stringIndexes.clear();
+	layout->recordStrings.clear();
+	layout->recordStrings.reserve(records.size() * BINARY_LIST_STRING_FIELDS);
+	layout->strings.push_back(&empty);
+	layout->stringBytes = 0;
+
+	for(size_t i = 0; i < records.size(); i++) {
+		const ListResultItem_t* record = records[i].get();
+
+		layout->recordStrings.push_back(AddString(layout, record->deviceName.str()));
+		layout->recordStrings.push_back(AddString(layout, record->manufacturer.str()));
+		layout->recordStrings.push_back(AddString(layout, record->serialNumber));
+		layout->recordStrings.push_back(AddString(layout, record->devNode));
+		layout->recordStrings.push_back(AddString(layout, record->mountPath));
+	}
+
+	layout->stringTableOffset = BINARY_LIST_HEADER_SIZE + records.size() * BinaryListColumn_Count * 4;
+	layout->byteLength = layout->stringTableOffset + (layout->strings.size() + 1) * 4 + layout->stringBytes;
+}
+
+void BinaryListWrite(const std::vector<DeviceRecord_t>& records, uint64_t listVersion, const BinaryListLayout_t* layout, uint8_t* buffer) {
+	size_t count = records.size();
+	size_t stringCount = layout->strings.size();
+
+	PutU32(buffer + BINARY_LIST_OFFSET_MAGIC, BINARY_LIST_MAGIC);
+	PutU16(buffer + BINARY_LIST_OFFSET_FORMAT_VERSION, BINARY_LIST_FORMAT_VERSION);
+	PutU16(buffer + BINARY_LIST_OFFSET_HEADER_SIZE, BINARY_LIST_HEADER_SIZE);
+	PutU32(buffer + BINARY_LIST_OFFSET_DEVICE_COUNT, (uint32_t) count);
+	PutU32(buffer + BINARY_LIST_OFFSET_STRING_COUNT, (uint32_t) stringCount);
+	PutU32(buffer + BINARY_LIST_OFFSET_LIST_VERSION, (uint32_t) listVersion);
+	PutU32(buffer + BINARY_LIST_OFFSET_LIST_VERSION + 4, (uint32_t) (listVersion >> 32));
+	PutU32(buffer + BINARY_LIST_OFFSET_STRING_TABLE, (uint32_t) layout->stringTableOffset);
+	PutU32(buffer + BINARY_LIST_OFFSET_BYTE_LENGTH, (uint32_t) layout->byteLength);
+
+	// Column by column, so each one is written front to back
+	uint8_t* column = buffer + BINARY_LIST_HEADER_SIZE;
+	for(size_t i = 0; i < count; i++) {
+		PutU32(column + i * 4, (uint32_t) records[i]->locationId);
+	}
+	column += count * 4;
+	for(size_t i = 0; i < count; i++) {
+		PutU32(column + i * 4, (uint32_t) records[i]->vendorId);
+	}
+	column += count * 4;
+	for(size_t i = 0; i < count; i++) {
+		PutU32(column + i * 4, (uint32_t) records[i]->productId);
+	}
+	column += count * 4;
+	for(size_t i = 0; i < count; i++) {
+		PutU32(column + i * 4, (uint32_t) records[i]->deviceAddress);
+	}
+	column += count * 4;
+	for(int field = 0; field < BINARY_LIST_STRING_FIELDS; field++) {
+		for(size_t i = 0; i < count; i++) {
+			PutU32(column + i * 4, layout->recordStrings[i * BINARY_LIST_STRING_FIELDS + field]);
+		}
+		column += count * 4;
+	}
+
+	uint8_t* offsets = buffer + layout->stringTableOffset;
+	uint8_t* bytes = offsets + (stringCount + 1) * 4;
+	uint32_t offset = 0;
+	for(size_t i = 0; i < stringCount; i++) {
+		const std::string* value = layout->strings[i];
+
+		PutU32(offsets + i * 4, offset);
+		memcpy(bytes + offset, value->data(), value->size());
+		offset += (uint32_t) value->size();
+	}
+	PutU32(offsets + stringCount * 4, offset);
+}
@@ -0,0 +1,64 @@
+#ifndef _BINARY_LIST_H
+#define _BINARY_LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "deviceList.h"
+
+/**********************************
+ * Packed export of device records for findBinary(), see "Binary device
+ * list format" in the README. Little endian, version 1:
+ *
+ *   header     32 bytes, see the BINARY_LIST_OFFSET_* offsets
+ *   columns    one array of `deviceCount` 32-bit values per field, in
+ *              BinaryListColumn_t order. Strings are string table indexes.
+ *   strings    uint32 offsets[stringCount + 1] into the UTF-8 bytes that
+ *              follow them. String 0 is the empty string.
+ **********************************/
+#define BINARY_LIST_MAGIC 0x44425355 // "USBD"
+#define BINARY_LIST_FORMAT_VERSION 1
+#define BINARY_LIST_HEADER_SIZE 32
+
+#define BINARY_LIST_OFFSET_MAGIC 0
+#define BINARY_LIST_OFFSET_FORMAT_VERSION 4
+#define BINARY_LIST_OFFSET_HEADER_SIZE 6
+#define BINARY_LIST_OFFSET_DEVICE_COUNT 8
+#define BINARY_LIST_OFFSET_STRING_COUNT 12
+#define BINARY_LIST_OFFSET_LIST_VERSION 16
+#define BINARY_LIST_OFFSET_STRING_TABLE 24
+#define BINARY_LIST_OFFSET_BYTE_LENGTH 28
+
+typedef enum {
+	BinaryListColumn_LocationId,
+	BinaryListColumn_VendorId,
+	BinaryListColumn_ProductId,
+	BinaryListColumn_DeviceAddress,
+	BinaryListColumn_DeviceName,
+	BinaryListColumn_Manufacturer,
+	BinaryListColumn_SerialNumber,
+	BinaryListColumn_DevNode,
+	BinaryListColumn_MountPath,
+	BinaryListColumn_Count,
+} BinaryListColumn_t;
+
+typedef struct {
+	// Each distinct string once, in string table order
+	std::vector<const std::string*> strings;
+	std::unordered_map<std::string, uint32_t> stringIndexes;
+	// BinaryListColumn_Count - BinaryListColumn_DeviceName per record
+	std::vector<uint32_t> recordStrings;
+	size_t stringBytes;
+	size_t stringTableOffset;
+	size_t byteLength;
+} BinaryListLayout_t;
+
+// Assigns the string indexes and sizes the buffer for `records`
+void BinaryListLayout(const std::vector<DeviceRecord_t>& records, BinaryListLayout_t* layout);
+// Fills `buffer`, `layout->byteLength` bytes, in one pass
+void BinaryListWrite(const std::vector<DeviceRecord_t>& records, uint64_t listVersion, const BinaryListLayout_t* layout, uint8_t* buffer);
+
+#endif
@@ -0,0 +1,166 @@
+#include <utility>
+
+#include "debounce.h"
+
+// No previous held event of the device
+#define DEBOUNCE_NO_SEQ UINT64_MAX
+// Cancelled events `held` may carry on top of one per held event
+#define DEBOUNCE_COMPACT_SLACK 64
+
+
+/* The same for two records when they are the same device: devNode when
+   the backend has one, the ids otherwise */
+static std::string DeviceKey(const ListResultItem_t* item) {
+	if(!item->devNode.empty()) {
+		return item->devNode;
+	}
+
+	return "#" + std::to_string(item->vendorId) +
+		":" + std::to_string(item->productId) +
+		":" + std::to_string(item->locationId) +
+		":" + item->serialNumber;
+}
+
+// The previous held event of the device becomes its newest, if it is still held
+static void ForgetNewest(Debouncer_t* debouncer, std::unordered_map<std::string, uint64_t>::iterator newest, uint64_t prevSeq) {
+	if(prevSeq != DEBOUNCE_NO_SEQ && prevSeq >= debouncer->firstSeq) {
+		newest->second = prevSeq;
+	}
+	else {
+		debouncer->newestSeqs.erase(newest);
+	}
+}
+
+// Renumbers the held events without the cancelled ones
+static void Compact(Debouncer_t* debouncer) {
+	std::deque<DebouncedEvent_t> held;
+
+	debouncer->newestSeqs.clear();
+	for(size_t i = 0; i < debouncer->held.size(); i++) {
+		DebouncedEvent_t* event = &debouncer->held[i];
+		if(event->isCancelled) {
+			continue;
+		}
+
+		uint64_t seq = debouncer->firstSeq + held.size();
+		std::pair<std::unordered_map<std::string, uint64_t>::iterator, bool> newest = debouncer->newestSeqs.insert(std::make_pair(DeviceKey(event->event.record.get()), seq));
+		event->prevSeq = newest.second ? DEBOUNCE_NO_SEQ : newest.first->second;
+		newest.first->second = seq;
+		held.push_back(std::move(*event));
+	}
+
+	debouncer->held.swap(held);
+}
+
+// Neither end of `held` is left cancelled, so its front is the next due
+static void TrimCancelled(Debouncer_t* debouncer) {
+	while(!debouncer->held.empty() && debouncer->held.back().isCancelled) {
+		debouncer->held.pop_back();
+	}
+	while(!debouncer->held.empty() && debouncer->held.front().isCancelled) {
+		debouncer->held.pop_front();
+		debouncer->firstSeq++;
+	}
+
+	if(debouncer->held.size() > 2 * debouncer->heldCount + DEBOUNCE_COMPACT_SLACK) {
+		Compact(debouncer);
+	}
+}
+
+void DebouncerInit(Debouncer_t* debouncer, uint64_t windowNs) {
+	debouncer->windowNs = windowNs;
+	debouncer->held.clear();
+	debouncer->firstSeq = 0;
+	debouncer->newestSeqs.clear();
+	debouncer->heldCount = 0;
+	debouncer->suppressed = 0;
+}
+
+void DebouncerPush(Debouncer_t* debouncer, const DeviceEvent_t& event, uint64_t nowNs) {
+	std::string key = DeviceKey(event.record.get());
+	std::unordered_map<std::string, uint64_t>::iterator newest = debouncer->newestSeqs.find(key);
+	uint64_t prevSeq = DEBOUNCE_NO_SEQ;
+
+	if(newest != debouncer->newestSeqs.end()) {
+		DebouncedEvent_t* heldEvent = &debouncer->held[newest->second - debouncer->firstSeq];
+		DeviceEvent_t* held = &heldEvent->event;
+
+		if((held->type == DeviceEvent_Added && event.type == DeviceEvent_Removed) ||
+			(held->type == DeviceEvent_Removed && event.type == DeviceEvent_Added)) {
+			heldEvent->isCancelled = true;
+			held->record.reset();
+			debouncer->heldCount--;
+			debouncer->suppressed += 2;
+			ForgetNewest(debouncer, newest, heldEvent->prevSeq);
+			TrimCancelled(debouncer);
+			return;
+		}
+
+		if((held->type == DeviceEvent_Added && event.type != DeviceEvent_Removed) ||
+			(held->type == event.type) ||
+			(held->type == DeviceEvent_Mounted && event.type == DeviceEvent_Removed)) {
+			held->type = held->type == DeviceEvent_Added ? DeviceEvent_Added : event.type;
+			held->record = event.record;
+			debouncer->suppressed++;
+			return;
+		}
+
+		prevSeq = newest->second;
+	}
+
+	DebouncedEvent_t held;
+	held.event = event;
+	held.dueNs = nowNs + debouncer->windowNs;
+	held.prevSeq = prevSeq;
+	held.isCancelled = false;
+
+	uint64_t seq = debouncer->firstSeq + debouncer->held.size();
+	if(newest != debouncer->newestSeqs.end()) {
+		newest->second = seq;
+	}
+	else {
+		debouncer->newestSeqs.insert(std::make_pair(std::move(key), seq));
+	}
+	debouncer->held.push_back(std::move(held));
+	debouncer->heldCount++;
+}
+
+bool DebouncerPop(Debouncer_t* debouncer, DeviceEvent_t* event, uint64_t nowNs) {
+	if(debouncer->held.empty() || debouncer->held.front().dueNs > nowNs) {
+		return false;
+	}
+
+	std::unordered_map<std::string, uint64_t>::iterator newest = debouncer->newestSeqs.find(DeviceKey(debouncer->held.front().event.record.get()));
+	if(newest != debouncer->newestSeqs.end() && newest->second == debouncer->firstSeq) {
+		debouncer->newestSeqs.erase(newest);
+	}
+
+	*event = std::move(debouncer->held.front().event);
+	debouncer->held.pop_front();
+	debouncer->firstSeq++;
+	debouncer->heldCount--;
+	TrimCancelled(debouncer);
+
+	return true;
+}
+
+void DebouncerDropNewest(Debouncer_t* debouncer) {
+	if(debouncer->held.empty()) {
+		return;
+	}
+
+	// Never cancelled, see TrimCancelled()
+	DebouncedEvent_t* held = &debouncer->held.back();
+	std::unordered_map<std::string, uint64_t>::iterator newest = debouncer->newestSeqs.find(DeviceKey(held->event.record.get()));
+	if(newest != debouncer->newestSeqs.end()) {
+		ForgetNewest(debouncer, newest, held->prevSeq);
+	}
+
+	debouncer->held.pop_back();
+	debouncer->heldCount--;
+	TrimCancelled(debouncer);
+}
+
+uint64_t DebouncerNextDueNs(const Debouncer_t* debouncer) {
+	return debouncer->held.empty() ? 0 : debouncer->held.front().dueNs;
+}
@@ -0,0 +1,63 @@
+#ifndef _DEBOUNCE_H
+#define _DEBOUNCE_H
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "eventQueue.h"
+
+typedef struct {
+	DeviceEvent_t event;
+	// Delivered from then on, `windowNs` after the first event of the device
+	uint64_t dueNs;
+	// The position of the previous held event of the device, see `firstSeq`
+	uint64_t prevSeq;
+	// Cancelled out with a newer event, skipped when popped
+	bool isCancelled;
+} DebouncedEvent_t;
+
+/**********************************
+ * Holds device events back for a window so flapping devices can be
+ * collapsed before they reach JS. Per device, the events that arrive
+ * while one is held:
+ *
+ *   held add    + remove       both are dropped
+ *   held remove + add          both are dropped
+ *   held add    + add, mount   the add is kept with the newer record
+ *   held remove + remove       the remove is kept with the newer record
+ *   held mount  + mount        the mount is kept with the newer record
+ *   held mount  + remove       the remove replaces the mount
+ *
+ * Anything else is held on its own. The window starts with the first
+ * event of the device, so a device that keeps flapping is still reported
+ * at least every window. Only used on the loop thread.
+ *
+ * The newest held event of every device is looked up by its key, so a
+ * push does not scan what is held. A cancelled event stays in `held`
+ * until it reaches the front, or until they are compacted.
+ **********************************/
+typedef struct {
+	uint64_t windowNs;
+	// In the order they arrived, which is also the order they are due
+	std::deque<DebouncedEvent_t> held;
+	// The position of held.front() among all the events ever held
+	uint64_t firstSeq;
+	// The position of the newest held event, per device key
+	std::unordered_map<std::string, uint64_t> newestSeqs;
+	// The events in `held` that are not cancelled
+	size_t heldCount;
+	uint64_t suppressed;
+} Debouncer_t;
+
+void DebouncerInit(Debouncer_t* debouncer, uint64_t windowNs);
+void DebouncerPush(Debouncer_t* debouncer, const DeviceEvent_t& event, uint64_t nowNs);
+// The oldest held event if it is due at `nowNs`, UINT64_MAX releases all
+bool DebouncerPop(Debouncer_t* debouncer, DeviceEvent_t* event, uint64_t nowNs);
+// Lets go of the newest held event, when a bounded owner has no room for it
+void DebouncerDropNewest(Debouncer_t* debouncer);
+// When the oldest held event is due, 0 when none is held
+uint64_t DebouncerNextDueNs(const Debouncer_t* debouncer);
+
+#endif
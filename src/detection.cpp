@@ -1,4 +1,18 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "binaryList.h"
+#include "debounce.h"
 #include "detection.h"
+#include "eventHistory.h"
+#include "latencyHistogram.h"
+#include "monitorHost.h"
+#include "syntheticEvents.h"
+#include "topicRoutes.h"
 
 
 #define OBJECT_ITEM_LOCATION_ID "locationId"
@@ -11,15 +25,294 @@
 #define OBJECT_ITEM_DEVICE_DEV_NODE "devNode"
 #define OBJECT_ITEM_DEVICE_MOUNT_PATH "mountPath"
 
+#define DEVICE_EVENT_QUEUE_CAPACITY 1024
+
+#define OBJECT_CHANGES_GENERATION "generation"
+#define OBJECT_CHANGES_RESYNC "resync"
+#define OBJECT_CHANGES_CHANGES "changes"
+#define OBJECT_CHANGES_DEVICES "devices"
+
+#define OBJECT_RECORD_TYPE "type"
+#define OBJECT_RECORD_DEVICE "device"
+#define OBJECT_RECORD_SEQ "seq"
+#define RECORD_TYPE_ADD "add"
+#define RECORD_TYPE_REMOVE "remove"
+#define RECORD_TYPE_MOUNT "mount"
+
+#define OPTION_MOUNT_TIMEOUT_MS "mountTimeoutMs"
+#define DEFAULT_MOUNT_TIMEOUT_MS 10000
+
+#define OPTION_EVENT_HISTORY_SIZE "eventHistorySize"
+#define DEFAULT_EVENT_HISTORY_SIZE 256
+
+#define OPTION_DEBOUNCE_MS "debounceMs"
+#define OPTION_QUEUE_POLICY "queuePolicy"
+
+#define OBJECT_OVERFLOW_DROPPED "dropped"
+#define OBJECT_OVERFLOW_COALESCED "coalesced"
+#define OBJECT_OVERFLOW_MONITOR_OVERRUNS "monitorOverruns"
+
+#define DEFAULT_BATCH_MAX_SIZE 64
+
+/* Environments can be torn down since Node.js 10.2, worker_threads came
+   after that. Before, the one environment lives as long as the process. */
+#if NODE_MAJOR_VERSION > 10 || (NODE_MAJOR_VERSION == 10 && NODE_MINOR_VERSION >= 2)
+#define HAVE_ENVIRONMENT_CLEANUP_HOOK
+#endif
+
+#define OPTION_VENDOR_ID "vendorId"
+#define OPTION_PRODUCT_ID "productId"
+#define OPTION_SUBSYSTEMS "subsystems"
+
+
+DetectionOptions_t detectionOptions = {
+	DEFAULT_MOUNT_TIMEOUT_MS
+};
+
+std::vector<std::string> monitorSubsystems;
+MonitorCounters_t monitorCounters;
+
+// By EventQueuePolicy_t, the values of configure({ queuePolicy })
+static const char* queuePolicyNames[] = {
+	"drop-newest",
+	"drop-oldest",
+	"coalesce",
+	"block",
+};
+
+/**********************************
+ * Event latency
+ *
+ * Every event carries the times it went through each stage, see
+ * EventTimes_t. When it is handed to JS, the time spent in each stage goes
+ * into a histogram of the environment, getStats() has the percentiles.
+ **********************************/
+typedef enum {
+	// Received to enriched: the backend reads the device
+	LatencyStage_Enrich,
+	// Enriched to queued: the device list is updated
+	LatencyStage_Publish,
+	// Queued to popped: waiting for the loop thread
+	LatencyStage_Queue,
+	// Popped to handed to JS: held by debounceMs or by a batch
+	LatencyStage_Deliver,
+	// The JS callbacks, per callback and not per event in batch mode
+	LatencyStage_Callback,
+	// Received to handed to JS
+	LatencyStage_Total,
+	LatencyStage_Count,
+} LatencyStage_t;
+
+static const char* latencyStageNames[LatencyStage_Count] = {
+	"enrich",
+	"publish",
+	"queue",
+	"deliver",
+	"callback",
+	"total",
+};
+
+// Set by the backend on the thread that queues the event, see QueueDeviceEvent()
+static thread_local uint64_t eventReceivedNs = 0;
+static thread_local uint64_t eventEnrichedNs = 0;
+
+/**********************************
+ * Device objects
+ *
+ * The property names are created once as internalized strings and every
+ * device object is an instance of the same template, so they all share
+ * one hidden class instead of each of them ending up as a dictionary.
+ **********************************/
+typedef enum {
+	DeviceKey_LocationId,
+	DeviceKey_VendorId,
+	DeviceKey_ProductId,
+	DeviceKey_DeviceName,
+	DeviceKey_Manufacturer,
+	DeviceKey_SerialNumber,
+	DeviceKey_DeviceAddress,
+	DeviceKey_DevNode,
+	DeviceKey_MountPath,
+	DeviceKey_Count,
+} DeviceObjectKey_t;
+
+typedef struct {
+	const char* name;
+	// The template starts the property with a value of the right type
+	bool isString;
+} DeviceObjectField_t;
+
+static const DeviceObjectField_t deviceObjectFields[DeviceKey_Count] = {
+	{ OBJECT_ITEM_LOCATION_ID, false },
+	{ OBJECT_ITEM_VENDOR_ID, false },
+	{ OBJECT_ITEM_PRODUCT_ID, false },
+	{ OBJECT_ITEM_DEVICE_NAME, true },
+	{ OBJECT_ITEM_MANUFACTURER, true },
+	{ OBJECT_ITEM_SERIAL_NUMBER, true },
+	{ OBJECT_ITEM_DEVICE_ADDRESS, false },
+	{ OBJECT_ITEM_DEVICE_DEV_NODE, true },
+	{ OBJECT_ITEM_DEVICE_MOUNT_PATH, true },
+};
+
+typedef struct {
+	uint32_t id;
+	Nan::Callback* callback;
+	// Sequence number of the next event it gets
+	uint64_t nextSeq;
+	// Unsubscribed while events were being delivered, deleted afterwards
+	bool isRemoved;
+} Subscriber_t;
+
+/**********************************
+ * Per environment state
+ *
+ * Every Node environment that loads the module, the main thread or a
+ * worker, gets a context of its own: its callbacks, its event queue and
+ * the handles on its loop, and the V8 handles of its isolate. The backend
+ * behind them is shared, see monitorHost.h. An environment only ever runs
+ * on its own thread, so the context of the current one is thread local.
+ **********************************/
+typedef struct {
+	Nan::Callback* addedCallback;
+	bool isAddedRegistered;
+
+	Nan::Callback* removedCallback;
+	bool isRemovedRegistered;
+
+	Nan::Callback* mountedCallback;
+	bool isMountedRegistered;
+
+	Nan::Callback* routedCallback;
+	bool isRoutedRegistered;
+	// A listener the routes cannot express is registered, see RegisterRouted()
+	bool isRouteAll;
+	TopicRoutes_t topicRoutes;
+
+	Nan::Callback* logCallback;
+	bool isLogRegistered;
+
+	Nan::Callback* readyCallback;
+	bool isReadyRegistered;
+	bool isReady;
+
+	Nan::Callback* overflowCallback;
+	bool isOverflowRegistered;
+	// The counters the last overflow event went up to
+	uint64_t reportedDropped;
+	uint64_t reportedCoalesced;
+	uint64_t reportedOverruns;
+
+	Nan::Callback* batchCallback;
+	bool isBatchRegistered;
+	size_t batchMaxSize;
+	int batchMaxDelayMs;
+	std::vector<DeviceEvent_t> pendingBatch;
+	uv_timer_t batchTimer;
+
+	EventHistory_t eventHistory;
+	std::vector<Subscriber_t> subscribers;
+	uint32_t nextSubscriberId;
+	bool isDeliveringHistory;
+
+	Debouncer_t debouncer;
+	uv_timer_t debounceTimer;
 
-Nan::Callback* addedCallback;
-bool isAddedRegistered = false;
+	// Recorded on the loop thread, read by getStats()
+	LatencyHistogram_t latency[LatencyStage_Count];
 
-Nan::Callback* removedCallback;
-bool isRemovedRegistered = false;
+	// Filled by the backend, or by the synthetic events while not monitoring
+	EventQueue_t deviceEvents;
+	uv_async_t deviceEventsAsync;
+	// Guarded by contextsMutex, the backend only queues while it is set
+	bool isMonitoring;
+	// Guarded by contextsMutex too, the events it does not match are not queued
+	MonitorFilter_t filter;
+	// Guarded by contextsMutex, pushes of the backend that are still going on
+	int producerRefs;
+	// Handles still to be closed before the context can go
+	int openHandles;
 
-Nan::Callback* logCallback;
-bool isLogRegistered = false;
+	Nan::Persistent<v8::String> deviceObjectKeys[DeviceKey_Count];
+	Nan::Persistent<v8::ObjectTemplate> deviceObjectTemplate;
+} DetectionContext_t;
+
+static thread_local DetectionContext_t* context = NULL;
+
+// All of them, QueueDeviceEvent() and NotifyReady() fan out to them
+static std::mutex contextsMutex;
+static std::vector<DetectionContext_t*> contexts;
+// Signaled whenever a push of the backend is done, see WaitForProducer()
+static std::condition_variable producerDone;
+// The initial device list is complete, the environments are told on their loop
+static std::atomic<bool> isListReady(false);
+// What the backend was last told to monitor, see UpdateMonitorSubsystems()
+static std::mutex subsystemsMutex;
+static std::vector<std::string> requestedSubsystems;
+
+static v8::Local<v8::String> NewInternalizedString(const char* value) {
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+	return v8::String::NewFromUtf8(v8::Isolate::GetCurrent(), value, v8::NewStringType::kInternalized).ToLocalChecked();
+#else
+	return Nan::New<v8::String>(value).ToLocalChecked();
+#endif
+}
+
+void InitDeviceObjects() {
+	Nan::HandleScope scope;
+
+	v8::Local<v8::ObjectTemplate> objectTemplate = Nan::New<v8::ObjectTemplate>();
+	for(int i = 0; i < DeviceKey_Count; i++) {
+		v8::Local<v8::String> key = NewInternalizedString(deviceObjectFields[i].name);
+
+		context->deviceObjectKeys[i].Reset(key);
+		if(deviceObjectFields[i].isString) {
+			objectTemplate->Set(key, Nan::EmptyString());
+		}
+		else {
+			objectTemplate->Set(key, Nan::New<v8::Number>(0));
+		}
+	}
+	context->deviceObjectTemplate.Reset(objectTemplate);
+}
+
+static void SetDeviceField(v8::Local<v8::Object> object, DeviceObjectKey_t key, v8::Local<v8::Value> value) {
+	Nan::Set(object, Nan::New(context->deviceObjectKeys[key]), value);
+}
+
+static void SetDeviceField(v8::Local<v8::Object> object, DeviceObjectKey_t key, const char* value) {
+	Nan::Set(object, Nan::New(context->deviceObjectKeys[key]), Nan::New<v8::String>(value).ToLocalChecked());
+}
+
+v8::Local<v8::Object> CreateDeviceObject(const ListResultItem_t* it) {
+	v8::Local<v8::Object> item = Nan::NewInstance(Nan::New(context->deviceObjectTemplate)).ToLocalChecked();
+	SetDeviceField(item, DeviceKey_LocationId, Nan::New<v8::Number>(it->locationId));
+	SetDeviceField(item, DeviceKey_VendorId, Nan::New<v8::Number>(it->vendorId));
+	SetDeviceField(item, DeviceKey_ProductId, Nan::New<v8::Number>(it->productId));
+	SetDeviceField(item, DeviceKey_DeviceName, it->deviceName.c_str());
+	SetDeviceField(item, DeviceKey_Manufacturer, it->manufacturer.c_str());
+	SetDeviceField(item, DeviceKey_SerialNumber, it->serialNumber.c_str());
+	SetDeviceField(item, DeviceKey_DeviceAddress, Nan::New<v8::Number>(it->deviceAddress));
+	SetDeviceField(item, DeviceKey_DevNode, it->devNode.c_str());
+	SetDeviceField(item, DeviceKey_MountPath, it->mountPath.c_str());
+
+	return item;
+}
+
+// How device objects were built before the template, for bench/marshal.js
+static v8::Local<v8::Object> CreateLegacyDeviceObject(const ListResultItem_t* it) {
+	v8::Local<v8::Object> item = Nan::New<v8::Object>();
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_LOCATION_ID).ToLocalChecked(), Nan::New<v8::Number>(it->locationId));
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_VENDOR_ID).ToLocalChecked(), Nan::New<v8::Number>(it->vendorId));
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_PRODUCT_ID).ToLocalChecked(), Nan::New<v8::Number>(it->productId));
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_DEVICE_NAME).ToLocalChecked(), Nan::New<v8::String>(it->deviceName.c_str()).ToLocalChecked());
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_MANUFACTURER).ToLocalChecked(), Nan::New<v8::String>(it->manufacturer.c_str()).ToLocalChecked());
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_SERIAL_NUMBER).ToLocalChecked(), Nan::New<v8::String>(it->serialNumber.c_str()).ToLocalChecked());
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_DEVICE_ADDRESS).ToLocalChecked(), Nan::New<v8::Number>(it->deviceAddress));
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_DEVICE_DEV_NODE).ToLocalChecked(), Nan::New<v8::String>(it->devNode.c_str()).ToLocalChecked());
+	Nan::Set(item, Nan::New<v8::String>(OBJECT_ITEM_DEVICE_MOUNT_PATH).ToLocalChecked(), Nan::New<v8::String>(it->mountPath.c_str()).ToLocalChecked());
+
+	return item;
+}
 
 void RegisterLog(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 	Nan::HandleScope scope;
@@ -39,24 +332,30 @@ void RegisterLog(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 		callback = args[0].As<v8::Function>();
 	}
 
-	logCallback = new Nan::Callback(callback);
-	isLogRegistered = true;
+	context->logCallback = new Nan::Callback(callback);
+	context->isLogRegistered = true;
 }
 
 void NotifyLog(std::string msg) {
+	/* The backend logs from the host thread too, where no environment and
+	   no isolate runs. Checked before anything touches V8. */
+	if (context == NULL) {
+		return;
+	}
+
 	Nan::HandleScope scope;
 
 	if (&msg == NULL) {
 		return;
 	}
 
-	if (isLogRegistered){
+	if (context->isLogRegistered){
 		v8::Local<v8::Value> argv[1];
 		//v8::String::Utf8Value s(*msg);
 		
 		argv[0] = Nan::New<v8::String>(msg).ToLocalChecked();
 
-		logCallback->Call(1, argv);
+		context->logCallback->Call(1, argv);
 	}
 }
 
@@ -78,33 +377,22 @@ void RegisterAdded(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 		callback = args[0].As<v8::Function>();
 	}
 
-	addedCallback = new Nan::Callback(callback);
-	isAddedRegistered = true;
+	context->addedCallback = new Nan::Callback(callback);
+	context->isAddedRegistered = true;
 }
 
-void NotifyAdded(ListResultItem_t* it) {
+void NotifyAdded(const ListResultItem_t* it) {
 	Nan::HandleScope scope;
 
 	if (it == NULL) {
 		return;
 	}
 
-	if (isAddedRegistered){
+	if (context->isAddedRegistered){
 		v8::Local<v8::Value> argv[1];
-		v8::Local<v8::Object> item = Nan::New<v8::Object>();
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_LOCATION_ID).ToLocalChecked(), Nan::New<v8::Number>(it->locationId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_VENDOR_ID).ToLocalChecked(), Nan::New<v8::Number>(it->vendorId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_PRODUCT_ID).ToLocalChecked(), Nan::New<v8::Number>(it->productId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_NAME).ToLocalChecked(), Nan::New<v8::String>(it->deviceName.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_MANUFACTURER).ToLocalChecked(), Nan::New<v8::String>(it->manufacturer.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_SERIAL_NUMBER).ToLocalChecked(), Nan::New<v8::String>(it->serialNumber.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_ADDRESS).ToLocalChecked(), Nan::New<v8::Number>(it->deviceAddress));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_DEV_NODE).ToLocalChecked(), Nan::New<v8::String>(it->devNode.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_MOUNT_PATH).ToLocalChecked(), Nan::New<v8::String>(it->mountPath.c_str()).ToLocalChecked());
-		
-		argv[0] = item;
+		argv[0] = CreateDeviceObject(it);
 
-		addedCallback->Call(1, argv);
+		context->addedCallback->Call(1, argv);
 	}
 }
 
@@ -126,35 +414,328 @@ void RegisterRemoved(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 		callback = args[0].As<v8::Function>();
 	}
 
-	removedCallback = new Nan::Callback(callback);
-	isRemovedRegistered = true;
+	context->removedCallback = new Nan::Callback(callback);
+	context->isRemovedRegistered = true;
+}
+
+void NotifyRemoved(const ListResultItem_t* it) {
+	Nan::HandleScope scope;
+
+	if (it == NULL) {
+		return;
+	}
+
+	if (context->isRemovedRegistered) {
+		v8::Local<v8::Value> argv[1];
+		argv[0] = CreateDeviceObject(it);
+
+		context->removedCallback->Call(1, argv);
+	}
+}
+
+void RegisterMounted(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	v8::Local<v8::Function> callback;
+
+	if (args.Length() == 0) {
+		return Nan::ThrowTypeError("First argument must be a function");
+	}
+
+	if (args.Length() == 1) {
+		// callback
+		if(!args[0]->IsFunction()) {
+			return Nan::ThrowTypeError("First argument must be a function");
+		}
+
+		callback = args[0].As<v8::Function>();
+	}
+
+	context->mountedCallback = new Nan::Callback(callback);
+	context->isMountedRegistered = true;
 }
 
-void NotifyRemoved(ListResultItem_t* it) {
+void NotifyMounted(const ListResultItem_t* it) {
 	Nan::HandleScope scope;
 
 	if (it == NULL) {
 		return;
 	}
 
-	if (isRemovedRegistered) {
+	if (context->isMountedRegistered) {
 		v8::Local<v8::Value> argv[1];
-		v8::Local<v8::Object> item = Nan::New<v8::Object>();
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_LOCATION_ID).ToLocalChecked(), Nan::New<v8::Number>(it->locationId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_VENDOR_ID).ToLocalChecked(), Nan::New<v8::Number>(it->vendorId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_PRODUCT_ID).ToLocalChecked(), Nan::New<v8::Number>(it->productId));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_NAME).ToLocalChecked(), Nan::New<v8::String>(it->deviceName.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_MANUFACTURER).ToLocalChecked(), Nan::New<v8::String>(it->manufacturer.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_SERIAL_NUMBER).ToLocalChecked(), Nan::New<v8::String>(it->serialNumber.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_ADDRESS).ToLocalChecked(), Nan::New<v8::Number>(it->deviceAddress));
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_DEV_NODE).ToLocalChecked(), Nan::New<v8::String>(it->devNode.c_str()).ToLocalChecked());
-		item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_MOUNT_PATH).ToLocalChecked(), Nan::New<v8::String>(it->mountPath.c_str()).ToLocalChecked());
-		argv[0] = item;
+		argv[0] = CreateDeviceObject(it);
 
-		removedCallback->Call(1, argv);
+		context->mountedCallback->Call(1, argv);
 	}
 }
 
+/* registerRouted(callback): `callback(device, routeId...)` with the ids of
+   the routes the device event matches, see setRoute(). While it is
+   registered the added/removed/mounted callbacks are only used in
+   setRouteAll(true) mode. */
+void RegisterRouted(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() == 0 || !args[0]->IsFunction()) {
+		return Nan::ThrowTypeError("First argument must be a function");
+	}
+
+	if(context->routedCallback == NULL) {
+		context->routedCallback = new Nan::Callback(args[0].As<v8::Function>());
+	}
+	else {
+		context->routedCallback->SetFunction(args[0].As<v8::Function>());
+	}
+	context->isRoutedRegistered = true;
+}
+
+/* setRoute(type, level, vid, pid, routeId): routes the topic to `routeId`,
+   0 removes the route. `type` and `level` as in topicRoutes.h. */
+void SetRoute(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 5) {
+		return Nan::ThrowTypeError("Expected a type, a level, a vendor id, a product id and a route id");
+	}
+	for (int i = 0; i < 5; i++) {
+		if (!args[i]->IsNumber()) {
+			return Nan::ThrowTypeError("Expected a type, a level, a vendor id, a product id and a route id");
+		}
+	}
+
+	int type = Nan::To<int32_t>(args[0]).FromJust();
+	int level = Nan::To<int32_t>(args[1]).FromJust();
+	if (type < 0 || type >= Topic_Count || level < TopicLevel_Type || level > TopicLevel_Product) {
+		return Nan::ThrowRangeError("Unknown topic type or level");
+	}
+
+	bool isSet = TopicRoutesSet(
+		&context->topicRoutes,
+		(TopicType_t) type,
+		(TopicLevel_t) level,
+		Nan::To<int32_t>(args[2]).FromJust(),
+		Nan::To<int32_t>(args[3]).FromJust(),
+		Nan::To<uint32_t>(args[4]).FromJust()
+	);
+
+	args.GetReturnValue().Set(Nan::New<v8::Boolean>(isSet));
+}
+
+/* setRouteAll(enabled): back to the added/removed/mounted callbacks for
+   every device event, for listeners on wildcard topics */
+void SetRouteAll(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	context->isRouteAll = args.Length() > 0 && Nan::To<bool>(args[0]).FromJust();
+}
+
+static void NotifyRouted(DeviceEventType_t type, const ListResultItem_t* it) {
+	Nan::HandleScope scope;
+
+	uint32_t routeIds[TOPIC_ROUTES_MAX_MATCHES];
+	size_t routeCount = TopicRoutesMatch(&context->topicRoutes, type, it->vendorId, it->productId, routeIds);
+
+	// No listener, no device object either
+	if(routeCount == 0) {
+		return;
+	}
+
+	v8::Local<v8::Value> argv[1 + TOPIC_ROUTES_MAX_MATCHES];
+	argv[0] = CreateDeviceObject(it);
+	for(size_t i = 0; i < routeCount; i++) {
+		argv[1 + i] = Nan::New<v8::Number>((double) routeIds[i]);
+	}
+
+	context->routedCallback->Call((int) (1 + routeCount), argv);
+}
+
+static void CheckReady();
+
+void RegisterReady(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() == 0 || !args[0]->IsFunction()) {
+		return Nan::ThrowTypeError("First argument must be a function");
+	}
+
+	context->readyCallback = new Nan::Callback(args[0].As<v8::Function>());
+	context->isReadyRegistered = true;
+
+	// The initial device list may already be complete
+	if (context->isReady) {
+		context->readyCallback->Call(0, NULL);
+	}
+	else {
+		CheckReady();
+	}
+}
+
+// Runs on the loop of the environment, once the backend said so
+static void CheckReady() {
+	Nan::HandleScope scope;
+
+	if (context->isReady || !isListReady.load()) {
+		return;
+	}
+
+	context->isReady = true;
+	if (context->isReadyRegistered) {
+		context->readyCallback->Call(0, NULL);
+	}
+}
+
+void NotifyReady() {
+	isListReady = true;
+
+	std::lock_guard<std::mutex> lock(contextsMutex);
+	for(size_t i = 0; i < contexts.size(); i++) {
+		uv_async_send(&contexts[i]->deviceEventsAsync);
+	}
+}
+
+void QueueMonitorOverrun() {
+	monitorCounters.overruns++;
+
+	std::lock_guard<std::mutex> lock(contextsMutex);
+	for(size_t i = 0; i < contexts.size(); i++) {
+		if(contexts[i]->isMonitoring) {
+			uv_async_send(&contexts[i]->deviceEventsAsync);
+		}
+	}
+}
+
+void RegisterOverflow(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() == 0 || !args[0]->IsFunction()) {
+		return Nan::ThrowTypeError("First argument must be a function");
+	}
+
+	context->overflowCallback = new Nan::Callback(args[0].As<v8::Function>());
+	context->isOverflowRegistered = true;
+}
+
+/* `{ dropped, coalesced, monitorOverruns }`: what was lost or merged since
+   the last call, once the events that made it were delivered. Lost
+   overruns are events the kernel dropped, their number is unknown. */
+static void NotifyOverflow() {
+	Nan::HandleScope scope;
+
+	uint64_t dropped = context->deviceEvents.dropped.load();
+	uint64_t coalesced = context->deviceEvents.coalesced.load();
+	uint64_t overruns = context->isMonitoring ? monitorCounters.overruns.load() : context->reportedOverruns;
+
+	if (dropped == context->reportedDropped && coalesced == context->reportedCoalesced && overruns == context->reportedOverruns) {
+		return;
+	}
+
+	v8::Local<v8::Object> overflow = Nan::New<v8::Object>();
+	Nan::Set(overflow, Nan::New<v8::String>(OBJECT_OVERFLOW_DROPPED).ToLocalChecked(), Nan::New<v8::Number>((double) (dropped - context->reportedDropped)));
+	Nan::Set(overflow, Nan::New<v8::String>(OBJECT_OVERFLOW_COALESCED).ToLocalChecked(), Nan::New<v8::Number>((double) (coalesced - context->reportedCoalesced)));
+	Nan::Set(overflow, Nan::New<v8::String>(OBJECT_OVERFLOW_MONITOR_OVERRUNS).ToLocalChecked(), Nan::New<v8::Number>((double) (overruns - context->reportedOverruns)));
+
+	context->reportedDropped = dropped;
+	context->reportedCoalesced = coalesced;
+	context->reportedOverruns = overruns;
+
+	if (context->isOverflowRegistered) {
+		v8::Local<v8::Value> argv[1];
+		argv[0] = overflow;
+
+		context->overflowCallback->Call(1, argv);
+	}
+}
+
+const char* GetRecordType(DeviceEventType_t type) {
+	switch(type) {
+		case DeviceEvent_Added:
+			return RECORD_TYPE_ADD;
+		case DeviceEvent_Removed:
+			return RECORD_TYPE_REMOVE;
+		default:
+			return RECORD_TYPE_MOUNT;
+	}
+}
+
+// `{ type, device, seq }`, what batches and subscriptions hand out
+v8::Local<v8::Object> CreateEventRecord(uint64_t seq, DeviceEventType_t type, const ListResultItem_t* device) {
+	v8::Local<v8::Object> record = Nan::New<v8::Object>();
+	Nan::Set(record, Nan::New<v8::String>(OBJECT_RECORD_TYPE).ToLocalChecked(), Nan::New<v8::String>(GetRecordType(type)).ToLocalChecked());
+	Nan::Set(record, Nan::New<v8::String>(OBJECT_RECORD_DEVICE).ToLocalChecked(), CreateDeviceObject(device));
+	Nan::Set(record, Nan::New<v8::String>(OBJECT_RECORD_SEQ).ToLocalChecked(), Nan::New<v8::Number>((double) seq));
+
+	return record;
+}
+
+static void RecordEventLatency(const EventTimes_t& times, uint64_t deliveredNs) {
+	LatencyHistogramRecord(&context->latency[LatencyStage_Enrich], times.enrichedNs - times.receivedNs);
+	LatencyHistogramRecord(&context->latency[LatencyStage_Publish], times.queuedNs - times.enrichedNs);
+	LatencyHistogramRecord(&context->latency[LatencyStage_Queue], times.poppedNs - times.queuedNs);
+	LatencyHistogramRecord(&context->latency[LatencyStage_Deliver], deliveredNs - times.poppedNs);
+	LatencyHistogramRecord(&context->latency[LatencyStage_Total], deliveredNs - times.receivedNs);
+}
+
+void FlushBatch() {
+	Nan::HandleScope scope;
+
+	uv_timer_stop(&context->batchTimer);
+	if(context->pendingBatch.empty()) {
+		return;
+	}
+
+	uint64_t deliveredNs = uv_hrtime();
+	v8::Local<v8::Array> records = Nan::New<v8::Array>((int) context->pendingBatch.size());
+	for(size_t i = 0; i < context->pendingBatch.size(); i++) {
+		Nan::Set(records, (uint32_t) i, CreateEventRecord(context->pendingBatch[i].seq, context->pendingBatch[i].type, context->pendingBatch[i].record.get()));
+		RecordEventLatency(context->pendingBatch[i].times, deliveredNs);
+	}
+	// Cleared before calling out, the callback may register a new batch mode
+	context->pendingBatch.clear();
+
+	v8::Local<v8::Value> argv[1];
+	argv[0] = records;
+
+	context->batchCallback->Call(1, argv);
+	LatencyHistogramRecord(&context->latency[LatencyStage_Callback], uv_hrtime() - deliveredNs);
+}
+
+void OnBatchTimer(uv_timer_t* handle) {
+	FlushBatch();
+}
+
+void RegisterBatch(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() == 0 || args[0]->IsNull() || args[0]->IsUndefined()) {
+		// Back to one callback per device, hand out what is still pending
+		if(context->isBatchRegistered) {
+			FlushBatch();
+		}
+		context->isBatchRegistered = false;
+		return;
+	}
+
+	if(!args[0]->IsFunction()) {
+		return Nan::ThrowTypeError("First argument must be a function");
+	}
+
+	context->batchMaxSize = DEFAULT_BATCH_MAX_SIZE;
+	context->batchMaxDelayMs = 0;
+	if (args.Length() > 1 && args[1]->IsNumber() && Nan::To<double>(args[1]).FromJust() >= 1) {
+		context->batchMaxSize = (size_t) Nan::To<double>(args[1]).FromJust();
+	}
+	if (args.Length() > 2 && args[2]->IsNumber() && Nan::To<double>(args[2]).FromJust() > 0) {
+		context->batchMaxDelayMs = Nan::To<int32_t>(args[2]).FromJust();
+	}
+
+	if(context->batchCallback == NULL) {
+		context->batchCallback = new Nan::Callback(args[0].As<v8::Function>());
+	}
+	else {
+		context->batchCallback->SetFunction(args[0].As<v8::Function>());
+	}
+	context->isBatchRegistered = true;
+}
+
 void Find(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 	NotifyLog("Finding....");
 	Nan::HandleScope scope;
@@ -169,8 +750,8 @@ void Find(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 
 	if (args.Length() == 3) {
 		if (args[0]->IsNumber() && args[1]->IsNumber()) {
-			vid = (int) args[0]->NumberValue();
-			pid = (int) args[1]->NumberValue();
+			vid = Nan::To<int32_t>(args[0]).FromJust();
+			pid = Nan::To<int32_t>(args[1]).FromJust();
 		}
 
 		// callback
@@ -183,7 +764,7 @@ void Find(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 
 	if (args.Length() == 2) {
 		if (args[0]->IsNumber()) {
-			vid = (int) args[0]->NumberValue();
+			vid = Nan::To<int32_t>(args[0]).FromJust();
 		}
 
 		// callback
@@ -211,7 +792,113 @@ void Find(const Nan::FunctionCallbackInfo<v8::Value>& args) {
 
 	uv_work_t* req = new uv_work_t();
 	req->data = baton;
-	uv_queue_work(uv_default_loop(), req, EIO_Find, (uv_after_work_cb)EIO_AfterFind);
+	uv_queue_work(Nan::GetCurrentEventLoop(), req, EIO_Find, (uv_after_work_cb)EIO_AfterFind);
+}
+
+/* Same arguments as find() without the callback. The list is an immutable
+   snapshot in memory, so there is nothing to wait for on the thread pool. */
+void FindSync(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	int vid = 0;
+	int pid = 0;
+	std::vector<DeviceRecord_t> devices;
+
+	if (args.Length() >= 1 && args[0]->IsNumber()) {
+		vid = Nan::To<int32_t>(args[0]).FromJust();
+
+		if (args.Length() >= 2 && args[1]->IsNumber()) {
+			pid = Nan::To<int32_t>(args[1]).FromJust();
+		}
+	}
+
+	CreateFilteredList(&devices, vid, pid);
+
+	v8::Local<v8::Array> results = Nan::New<v8::Array>((int) devices.size());
+	for(size_t i = 0; i < devices.size(); i++) {
+		Nan::Set(results, (uint32_t) i, CreateDeviceObject(devices[i].get()));
+	}
+
+	args.GetReturnValue().Set(results);
+}
+
+/* findBinary(vid, pid): the matching devices packed into one ArrayBuffer,
+   see binaryList.h. The records are written straight into the buffer. */
+void FindBinary(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	int vid = 0;
+	int pid = 0;
+	uint64_t version = 0;
+	std::vector<DeviceRecord_t> devices;
+	BinaryListLayout_t layout;
+
+	if (args.Length() >= 1 && args[0]->IsNumber()) {
+		vid = Nan::To<int32_t>(args[0]).FromJust();
+
+		if (args.Length() >= 2 && args[1]->IsNumber()) {
+			pid = Nan::To<int32_t>(args[1]).FromJust();
+		}
+	}
+
+	CreateFilteredList(&devices, vid, pid, &version);
+	BinaryListLayout(devices, &layout);
+
+	v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), layout.byteLength);
+	// Node.js 14 and later, GetContents() is gone from later V8 versions
+#if NODE_MODULE_VERSION >= 83
+	uint8_t* data = (uint8_t*) buffer->GetBackingStore()->Data();
+#else
+	uint8_t* data = (uint8_t*) buffer->GetContents().Data();
+#endif
+	BinaryListWrite(devices, version, &layout, data);
+
+	args.GetReturnValue().Set(buffer);
+}
+
+/* changesSince(generation): what happened to the device list after
+   `generation`, as add/remove records in order. When the change log does
+   not go back that far, `resync` is set and `devices` is the whole list
+   instead. Either way `generation` is the one to ask from next time. */
+void ChangesSince(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsNumber()) {
+		return Nan::ThrowTypeError("First argument must be a number");
+	}
+
+	// Negative ones were never handed out, they get a resync like future ones
+	double generation = Nan::To<double>(args[0]).FromJust();
+	uint64_t since = generation >= 0 ? (uint64_t) generation : UINT64_MAX;
+	uint64_t version = 0;
+	std::vector<ListChange_t> changes;
+	std::vector<DeviceRecord_t> devices;
+	bool isComplete = CreateChangeList(&changes, since, &version, &devices);
+
+	v8::Local<v8::Object> result = Nan::New<v8::Object>();
+	Nan::Set(result, Nan::New<v8::String>(OBJECT_CHANGES_GENERATION).ToLocalChecked(), Nan::New<v8::Number>((double) version));
+	Nan::Set(result, Nan::New<v8::String>(OBJECT_CHANGES_RESYNC).ToLocalChecked(), Nan::New<v8::Boolean>(!isComplete));
+
+	if (isComplete) {
+		v8::Local<v8::Array> records = Nan::New<v8::Array>((int) changes.size());
+		for(size_t i = 0; i < changes.size(); i++) {
+			v8::Local<v8::Object> record = Nan::New<v8::Object>();
+			const char* type = changes[i].isAdded ? RECORD_TYPE_ADD : RECORD_TYPE_REMOVE;
+			Nan::Set(record, Nan::New<v8::String>(OBJECT_RECORD_TYPE).ToLocalChecked(), Nan::New<v8::String>(type).ToLocalChecked());
+			Nan::Set(record, Nan::New<v8::String>(OBJECT_RECORD_DEVICE).ToLocalChecked(), CreateDeviceObject(changes[i].record.get()));
+			Nan::Set(records, (uint32_t) i, record);
+		}
+		Nan::Set(result, Nan::New<v8::String>(OBJECT_CHANGES_CHANGES).ToLocalChecked(), records);
+	}
+	else {
+		v8::Local<v8::Array> results = Nan::New<v8::Array>((int) devices.size());
+		for(size_t i = 0; i < devices.size(); i++) {
+			Nan::Set(results, (uint32_t) i, CreateDeviceObject(devices[i].get()));
+		}
+		Nan::Set(result, Nan::New<v8::String>(OBJECT_CHANGES_DEVICES).ToLocalChecked(), results);
+	}
+
+	args.GetReturnValue().Set(result);
 }
 
 void EIO_AfterFind(uv_work_t* req) {
@@ -226,19 +913,8 @@ void EIO_AfterFind(uv_work_t* req) {
 	}
 	else {
 		v8::Local<v8::Array> results = Nan::New<v8::Array>();
-		int i = 0;
-		for(std::list<ListResultItem_t*>::iterator it = data->results.begin(); it != data->results.end(); it++, i++) {
-			v8::Local<v8::Object> item = Nan::New<v8::Object>();
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_LOCATION_ID).ToLocalChecked(), Nan::New<v8::Number>((*it)->locationId));
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_VENDOR_ID).ToLocalChecked(), Nan::New<v8::Number>((*it)->vendorId));
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_PRODUCT_ID).ToLocalChecked(), Nan::New<v8::Number>((*it)->productId));
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_NAME).ToLocalChecked(), Nan::New<v8::String>((*it)->deviceName.c_str()).ToLocalChecked());
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_MANUFACTURER).ToLocalChecked(), Nan::New<v8::String>((*it)->manufacturer.c_str()).ToLocalChecked());
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_SERIAL_NUMBER).ToLocalChecked(), Nan::New<v8::String>((*it)->serialNumber.c_str()).ToLocalChecked());
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_ADDRESS).ToLocalChecked(), Nan::New<v8::Number>((*it)->deviceAddress));
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_DEV_NODE).ToLocalChecked(), Nan::New<v8::String>((*it)->devNode.c_str()).ToLocalChecked());
-			item->Set(Nan::New<v8::String>(OBJECT_ITEM_DEVICE_MOUNT_PATH).ToLocalChecked(), Nan::New<v8::String>((*it)->mountPath.c_str()).ToLocalChecked());
-			results->Set(i, item);
+		for(size_t i = 0; i < data->results.size(); i++) {
+			Nan::Set(results, (uint32_t) i, CreateDeviceObject(data->results[i].get()));
 		}
 		argv[0] = Nan::Undefined();
 		argv[1] = results;
@@ -246,33 +922,726 @@ void EIO_AfterFind(uv_work_t* req) {
 
 	data->callback->Call(2, argv);
 
-	for(std::list<ListResultItem_t*>::iterator it = data->results.begin(); it != data->results.end(); it++) {
-		delete *it;
-	}
 	delete data;
 	delete req;
 }
 
+/**********************************
+ * Device event hand-off
+ *
+ * The backend pushes references to the device records into a lock-free
+ * ring and wakes the loop with uv_async_send(). The loop thread drains
+ * everything that queued up in one go, so the producer never waits on JS.
+ * Only with the block policy it waits for room in a full ring, outside of
+ * contextsMutex, so the other environments keep what was queued for them,
+ * and for a second at most.
+ *
+ * In batch mode the drained events are handed to JS as one array, at the
+ * latest `maxDelayMs` after the first of them arrived.
+ *
+ * With `debounceMs` set, the drained events go through the debouncer
+ * first, see debounce.h. What is left reaches JS once the window is over.
+ **********************************/
+static void DispatchDeviceEvent(DeviceEvent_t& event) {
+	event.seq = EventHistoryAppend(&context->eventHistory, event.type, event.record);
+
+	if(context->isBatchRegistered) {
+		context->pendingBatch.push_back(std::move(event));
+		if(context->pendingBatch.size() >= context->batchMaxSize) {
+			FlushBatch();
+		}
+		return;
+	}
+
+	uint64_t deliveredNs = uv_hrtime();
+	RecordEventLatency(event.times, deliveredNs);
+
+	if(context->isRoutedRegistered && !context->isRouteAll) {
+		NotifyRouted(event.type, event.record.get());
+	}
+	else if(event.type == DeviceEvent_Added) {
+		NotifyAdded(event.record.get());
+	}
+	else if(event.type == DeviceEvent_Removed) {
+		NotifyRemoved(event.record.get());
+	}
+	else {
+		NotifyMounted(event.record.get());
+	}
+
+	LatencyHistogramRecord(&context->latency[LatencyStage_Callback], uv_hrtime() - deliveredNs);
+}
+
+static void FinishDeviceEvents() {
+	if(context->isBatchRegistered && !context->pendingBatch.empty()) {
+		if(context->batchMaxDelayMs <= 0) {
+			FlushBatch();
+		}
+		else if(!uv_is_active((uv_handle_t*) &context->batchTimer)) {
+			uv_timer_start(&context->batchTimer, (uv_timer_cb) OnBatchTimer, context->batchMaxDelayMs, 0);
+		}
+	}
+
+	DeliverHistory();
+	NotifyOverflow();
+}
+
+static void OnDebounceTimer(uv_timer_t* handle);
+
+// Dispatches the held events that are due, `nowNs` UINT64_MAX for all of them
+static void ReleaseDebounced(uint64_t nowNs) {
+	DeviceEvent_t event;
+
+	while(DebouncerPop(&context->debouncer, &event, nowNs)) {
+		DispatchDeviceEvent(event);
+	}
+
+	uint64_t dueNs = DebouncerNextDueNs(&context->debouncer);
+	if(dueNs == 0) {
+		uv_timer_stop(&context->debounceTimer);
+		return;
+	}
+
+	// Rounded up, the timer must not fire before the event is due
+	uint64_t delayMs = dueNs > nowNs ? (dueNs - nowNs + 999999) / 1000000 : 0;
+	uv_timer_start(&context->debounceTimer, (uv_timer_cb) OnDebounceTimer, delayMs, 0);
+}
+
+static void OnDebounceTimer(uv_timer_t* handle) {
+	ReleaseDebounced(uv_hrtime());
+	FinishDeviceEvents();
+}
+
+void OnDeviceEvents(uv_async_t* handle) {
+	DeviceEvent_t event;
+
+	CheckReady();
+
+	if(context->debouncer.windowNs == 0) {
+		while(EventQueuePop(&context->deviceEvents, &event)) {
+			event.times.poppedNs = uv_hrtime();
+			DispatchDeviceEvent(event);
+		}
+	}
+	else {
+		uint64_t nowNs = uv_hrtime();
+
+		while(EventQueuePop(&context->deviceEvents, &event)) {
+			event.times.poppedNs = nowNs;
+			DebouncerPush(&context->debouncer, event, nowNs);
+		}
+		ReleaseDebounced(nowNs);
+	}
+
+	FinishDeviceEvents();
+}
+
+/**********************************
+ * Subscriptions
+ *
+ * Every event that reaches the loop thread is numbered and kept in the
+ * event history. A subscriber is just the sequence number of the next
+ * event it gets, so one that attaches with an older `fromSeq` replays the
+ * kept events first. Events that fell out of the history are skipped, the
+ * subscriber sees the gap in the sequence numbers.
+ **********************************/
+static void RemoveSubscribers() {
+	size_t kept = 0;
+
+	for(size_t i = 0; i < context->subscribers.size(); i++) {
+		if(context->subscribers[i].isRemoved) {
+			delete context->subscribers[i].callback;
+		}
+		else {
+			context->subscribers[kept++] = context->subscribers[i];
+		}
+	}
+	context->subscribers.resize(kept);
+}
+
+void DeliverHistory() {
+	Nan::HandleScope scope;
+
+	if(context->isDeliveringHistory) {
+		return;
+	}
+
+	context->isDeliveringHistory = true;
+	// By index, the callbacks may subscribe more
+	for(size_t i = 0; i < context->subscribers.size(); i++) {
+		while(!context->subscribers[i].isRemoved && context->subscribers[i].nextSeq < context->eventHistory.nextSeq) {
+			uint64_t seq = std::max(context->subscribers[i].nextSeq, EventHistoryOldestSeq(&context->eventHistory));
+			const HistoryEntry_t* entry = EventHistoryGet(&context->eventHistory, seq);
+			Nan::Callback* callback = context->subscribers[i].callback;
+
+			context->subscribers[i].nextSeq = seq + 1;
+
+			v8::Local<v8::Value> argv[1];
+			argv[0] = CreateEventRecord(entry->seq, entry->type, entry->record.get());
+			callback->Call(1, argv);
+		}
+	}
+	context->isDeliveringHistory = false;
+
+	RemoveSubscribers();
+}
+
+/* subscribe(fromSeq, callback): returns the id for unsubscribe(). Starts
+   with the kept events from `fromSeq` on, 0 only gets new ones. The replay
+   happens on the next loop turn, not before this returns. */
+void Subscribe(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 2 || !args[0]->IsNumber()) {
+		return Nan::ThrowTypeError("First argument must be a number");
+	}
+	if (!args[1]->IsFunction()) {
+		return Nan::ThrowTypeError("Second argument must be a function");
+	}
+
+	double fromSeq = Nan::To<double>(args[0]).FromJust();
+	Subscriber_t subscriber;
+
+	subscriber.id = context->nextSubscriberId++;
+	subscriber.callback = new Nan::Callback(args[1].As<v8::Function>());
+	subscriber.nextSeq = fromSeq >= 1 ? (uint64_t) fromSeq : context->eventHistory.nextSeq;
+	subscriber.isRemoved = false;
+	context->subscribers.push_back(subscriber);
+
+	if (subscriber.nextSeq < context->eventHistory.nextSeq) {
+		uv_async_send(&context->deviceEventsAsync);
+	}
+
+	args.GetReturnValue().Set(Nan::New<v8::Number>(subscriber.id));
+}
+
+void Unsubscribe(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsNumber()) {
+		return Nan::ThrowTypeError("First argument must be a number");
+	}
+
+	uint32_t id = Nan::To<uint32_t>(args[0]).FromJust();
+	for(size_t i = 0; i < context->subscribers.size(); i++) {
+		if(context->subscribers[i].id == id) {
+			context->subscribers[i].isRemoved = true;
+		}
+	}
+
+	if(!context->isDeliveringHistory) {
+		RemoveSubscribers();
+	}
+}
+
+void InitDeviceEvents() {
+	uv_loop_t* loop = Nan::GetCurrentEventLoop();
+
+	context->batchMaxSize = DEFAULT_BATCH_MAX_SIZE;
+	context->nextSubscriberId = 1;
+
+	EventQueueInit(&context->deviceEvents, DEVICE_EVENT_QUEUE_CAPACITY);
+	EventHistoryInit(&context->eventHistory, DEFAULT_EVENT_HISTORY_SIZE);
+	uv_async_init(loop, &context->deviceEventsAsync, (uv_async_cb) OnDeviceEvents);
+	uv_timer_init(loop, &context->batchTimer);
+	DebouncerInit(&context->debouncer, 0);
+	uv_timer_init(loop, &context->debounceTimer);
+	for(int i = 0; i < LatencyStage_Count; i++) {
+		LatencyHistogramReset(&context->latency[i]);
+	}
+	// Only runs while events are held, it must not keep the process alive
+	uv_unref((uv_handle_t*) &context->debounceTimer);
+	// Ref'd while monitoring, see SetMonitoring()
+	uv_unref((uv_handle_t*) &context->deviceEventsAsync);
+	context->openHandles = 3;
+}
+
+/* Waits until the backend is done pushing to `target`, with contextsMutex
+   held and `target` no longer taking events. A push that waits for room
+   with the block policy drops its event instead. */
+static void WaitForProducer(DetectionContext_t* target, std::unique_lock<std::mutex>& lock) {
+	EventQueueSetMayBlock(&target->deviceEvents, false);
+	producerDone.wait(lock, [target]() { return target->producerRefs == 0; });
+	EventQueueSetMayBlock(&target->deviceEvents, true);
+}
+
+// Whether the backend queues device events for the current environment
+static void SetMonitoring(bool isMonitoring) {
+	if(context->isMonitoring == isMonitoring) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(contextsMutex);
+		context->isMonitoring = isMonitoring;
+
+		// The queue is free for the synthetic events once the backend is done with it
+		if(!isMonitoring) {
+			WaitForProducer(context, lock);
+		}
+	}
+	// Overruns while not monitoring are none of its business
+	context->reportedOverruns = monitorCounters.overruns.load();
+
+	// While monitoring the async handle keeps the process running
+	if(isMonitoring) {
+		uv_ref((uv_handle_t*) &context->deviceEventsAsync);
+	}
+	else {
+		uv_unref((uv_handle_t*) &context->deviceEventsAsync);
+	}
+
+	MonitorHostSetMonitoring(isMonitoring);
+}
+
+bool MonitorFilterMatches(const MonitorFilter_t* filter, int vendorId, int productId) {
+	return (filter->vendorId == 0 || filter->vendorId == vendorId) && (filter->productId == 0 || filter->productId == productId);
+}
+
+bool MatchesMonitorFilter(int vendorId, int productId) {
+	bool isMonitored = false;
+
+	std::lock_guard<std::mutex> lock(contextsMutex);
+	for(size_t i = 0; i < contexts.size(); i++) {
+		if(!contexts[i]->isMonitoring) {
+			continue;
+		}
+		if(MonitorFilterMatches(&contexts[i]->filter, vendorId, productId)) {
+			return true;
+		}
+		isMonitored = true;
+	}
+
+	// Nobody to filter for
+	return !isMonitored;
+}
+
+/* The backend monitors the subsystems of every environment that is
+   monitoring. Only handed over when they changed, the udev monitor is
+   restarted for it. */
+static void UpdateMonitorSubsystems() {
+	std::vector<std::string> subsystems;
+
+	// Held while handing over, so the union of an earlier call cannot overtake this one
+	std::lock_guard<std::mutex> subsystemsLock(subsystemsMutex);
+	{
+		std::lock_guard<std::mutex> lock(contextsMutex);
+		for(size_t i = 0; i < contexts.size(); i++) {
+			const std::vector<std::string>& wanted = contexts[i]->filter.subsystems;
+
+			for(size_t j = 0; contexts[i]->isMonitoring && j < wanted.size(); j++) {
+				if(std::find(subsystems.begin(), subsystems.end(), wanted[j]) == subsystems.end()) {
+					subsystems.push_back(wanted[j]);
+				}
+			}
+		}
+	}
+
+	if(subsystems != requestedSubsystems) {
+		requestedSubsystems = subsystems;
+		MonitorHostSetSubsystems(subsystems);
+	}
+}
+
+void MarkEventReceived() {
+	eventReceivedNs = uv_hrtime();
+	eventEnrichedNs = 0;
+}
+
+void MarkEventEnriched() {
+	eventEnrichedNs = uv_hrtime();
+}
+
+void QueueDeviceEvent(DeviceEventType_t type, const DeviceRecord_t& record) {
+	EventTimes_t times;
+
+	times.queuedNs = uv_hrtime();
+	times.enrichedNs = eventEnrichedNs != 0 ? eventEnrichedNs : times.queuedNs;
+	times.receivedNs = eventReceivedNs != 0 && eventReceivedNs <= times.enrichedNs ? eventReceivedNs : times.enrichedNs;
+	times.poppedNs = 0;
+	// The next event is marked again, or not at all
+	eventReceivedNs = 0;
+	eventEnrichedNs = 0;
+
+	// Only ever used by the thread of the backend that queues, kept for the next event
+	static thread_local std::vector<DetectionContext_t*> targets;
+	bool isMonitored = false;
+
+	targets.clear();
+	{
+		std::lock_guard<std::mutex> lock(contextsMutex);
+		for(size_t i = 0; i < contexts.size(); i++) {
+			if(!contexts[i]->isMonitoring) {
+				continue;
+			}
+			isMonitored = true;
+
+			// Backends that can drop events earlier only dropped what nobody wants
+			if(MonitorFilterMatches(&contexts[i]->filter, record->vendorId, record->productId)) {
+				contexts[i]->producerRefs++;
+				targets.push_back(contexts[i]);
+			}
+		}
+
+		if(isMonitored && targets.empty()) {
+			monitorCounters.filtered++;
+		}
+	}
+
+	/* Every environment gets the same record, none of them copies it. A
+	   push can wait for room, the environment stays around until it is
+	   done, see WaitForProducer(). */
+	for(size_t i = 0; i < targets.size(); i++) {
+		if(EventQueuePush(&targets[i]->deviceEvents, type, record, times)) {
+			uv_async_send(&targets[i]->deviceEventsAsync);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(contextsMutex);
+			targets[i]->producerRefs--;
+		}
+		producerDone.notify_all();
+	}
+}
+
+// `{ count, meanNs, p50Ns, p90Ns, p99Ns, p999Ns, maxNs }` of one stage
+static v8::Local<v8::Object> CreateLatencyObject(const LatencyHistogram_t* histogram) {
+	static const struct {
+		const char* name;
+		double percentile;
+	} percentiles[] = {
+		{ "p50Ns", 50 },
+		{ "p90Ns", 90 },
+		{ "p99Ns", 99 },
+		{ "p999Ns", 99.9 },
+	};
+	uint64_t count = histogram->count.load(std::memory_order_relaxed);
+
+	v8::Local<v8::Object> stage = Nan::New<v8::Object>();
+	Nan::Set(stage, Nan::New<v8::String>("count").ToLocalChecked(), Nan::New<v8::Number>((double) count));
+	Nan::Set(stage, Nan::New<v8::String>("meanNs").ToLocalChecked(), Nan::New<v8::Number>(count > 0 ? (double) histogram->sumNs.load(std::memory_order_relaxed) / count : 0));
+	for(size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		Nan::Set(stage, Nan::New<v8::String>(percentiles[i].name).ToLocalChecked(), Nan::New<v8::Number>((double) LatencyHistogramPercentile(histogram, percentiles[i].percentile)));
+	}
+	Nan::Set(stage, Nan::New<v8::String>("maxNs").ToLocalChecked(), Nan::New<v8::Number>((double) histogram->maxNs.load(std::memory_order_relaxed)));
+
+	return stage;
+}
+
+void GetStats(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+	Nan::Set(stats, Nan::New<v8::String>("queueDepth").ToLocalChecked(), Nan::New<v8::Number>((double) EventQueueDepth(&context->deviceEvents)));
+	Nan::Set(stats, Nan::New<v8::String>("queueHighWaterMark").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.highWaterMark.load()));
+	Nan::Set(stats, Nan::New<v8::String>("queueCapacity").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.capacity));
+	Nan::Set(stats, Nan::New<v8::String>("eventsQueued").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.pushed.load()));
+	Nan::Set(stats, Nan::New<v8::String>("eventsDropped").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.dropped.load()));
+	Nan::Set(stats, Nan::New<v8::String>("eventsCoalesced").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.coalesced.load()));
+	Nan::Set(stats, Nan::New<v8::String>("queueBlocked").ToLocalChecked(), Nan::New<v8::Number>((double) context->deviceEvents.blocked.load()));
+	Nan::Set(stats, Nan::New<v8::String>("queuePolicy").ToLocalChecked(), Nan::New<v8::String>(queuePolicyNames[context->deviceEvents.policy.load()]).ToLocalChecked());
+	Nan::Set(stats, Nan::New<v8::String>("monitorWakeups").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.wakeups.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorEventsReceived").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.received.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorEventsFiltered").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.filtered.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorOverruns").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.overruns.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorReceiveBufferSize").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.receiveBufferSize.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorFilterUpdates").ToLocalChecked(), Nan::New<v8::Number>((double) monitorCounters.filterUpdates.load()));
+	Nan::Set(stats, Nan::New<v8::String>("monitorRunning").ToLocalChecked(), Nan::New<v8::Boolean>(monitorCounters.isRunning.load()));
+	Nan::Set(stats, Nan::New<v8::String>("eventSeq").ToLocalChecked(), Nan::New<v8::Number>((double) (context->eventHistory.nextSeq - 1)));
+	Nan::Set(stats, Nan::New<v8::String>("eventHistoryOldestSeq").ToLocalChecked(), Nan::New<v8::Number>((double) EventHistoryOldestSeq(&context->eventHistory)));
+	Nan::Set(stats, Nan::New<v8::String>("eventHistorySize").ToLocalChecked(), Nan::New<v8::Number>((double) context->eventHistory.slots.size()));
+	Nan::Set(stats, Nan::New<v8::String>("eventsSuppressed").ToLocalChecked(), Nan::New<v8::Number>((double) context->debouncer.suppressed));
+	Nan::Set(stats, Nan::New<v8::String>("eventsHeld").ToLocalChecked(), Nan::New<v8::Number>((double) context->debouncer.heldCount));
+	Nan::Set(stats, Nan::New<v8::String>("monitoringEnvironments").ToLocalChecked(), Nan::New<v8::Number>((double) MonitorHostMonitoringCount()));
+	Nan::Set(stats, Nan::New<v8::String>("eventsDelivered").ToLocalChecked(), Nan::New<v8::Number>((double) context->latency[LatencyStage_Total].count.load()));
+
+	v8::Local<v8::Object> latency = Nan::New<v8::Object>();
+	for(int i = 0; i < LatencyStage_Count; i++) {
+		Nan::Set(latency, Nan::New<v8::String>(latencyStageNames[i]).ToLocalChecked(), CreateLatencyObject(&context->latency[i]));
+	}
+	Nan::Set(stats, Nan::New<v8::String>("latency").ToLocalChecked(), latency);
+
+	args.GetReturnValue().Set(stats);
+}
+
+void QueueSyntheticEvents(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 2 || !args[0]->IsNumber() || !args[1]->IsNumber()) {
+		return Nan::ThrowTypeError("Expected an event count and a rate per second");
+	}
+
+	// The event queue has a single producer
+	if(context->isMonitoring) {
+		return Nan::ThrowError("Synthetic events can only be queued while monitoring is stopped");
+	}
+
+	MonitorFilter_t filter;
+	{
+		std::lock_guard<std::mutex> lock(contextsMutex);
+		filter = context->filter;
+	}
+
+	if(!StartSyntheticEvents(Nan::To<uint32_t>(args[0]).FromJust(), Nan::To<uint32_t>(args[1]).FromJust(), filter, &context->deviceEvents, &context->deviceEventsAsync)) {
+		return Nan::ThrowError("Synthetic events are already being queued");
+	}
+}
+
+/* marshalSyntheticDevices(count, isLegacy): `count` device objects of
+   synthetic devices, built the current or the legacy way. */
+void MarshalSyntheticDevices(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsNumber()) {
+		return Nan::ThrowTypeError("First argument must be a number");
+	}
+
+	unsigned int count = Nan::To<uint32_t>(args[0]).FromJust();
+	bool isLegacy = args.Length() > 1 && Nan::To<bool>(args[1]).FromJust();
+	std::vector<DeviceRecord_t> records;
+
+	records.reserve(count);
+	for(unsigned int i = 0; i < count; i++) {
+		records.push_back(CreateSyntheticRecord(i * 2));
+	}
+
+	v8::Local<v8::Array> results = Nan::New<v8::Array>((int) count);
+	for(unsigned int i = 0; i < count; i++) {
+		Nan::Set(results, i, isLegacy ? CreateLegacyDeviceObject(records[i].get()) : CreateDeviceObject(records[i].get()));
+	}
+
+	args.GetReturnValue().Set(results);
+}
+
+/* routeSyntheticEvents(count, isLegacy): dispatches `count` synthetic
+   add/remove events right away, through the routes or the way it was done
+   before them. For bench/emit.js. */
+void RouteSyntheticEvents(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsNumber()) {
+		return Nan::ThrowTypeError("First argument must be a number");
+	}
+
+	unsigned int count = Nan::To<uint32_t>(args[0]).FromJust();
+	bool isLegacy = args.Length() > 1 && Nan::To<bool>(args[1]).FromJust();
+
+	if(!isLegacy && !context->isRoutedRegistered) {
+		return Nan::ThrowError("No routed callback registered");
+	}
+
+	for(unsigned int i = 0; i < count; i++) {
+		DeviceRecord_t record = CreateSyntheticRecord(i);
+		DeviceEventType_t type = i % 2 == 0 ? DeviceEvent_Added : DeviceEvent_Removed;
+
+		if(!isLegacy) {
+			NotifyRouted(type, record.get());
+		}
+		else if(type == DeviceEvent_Added) {
+			NotifyAdded(record.get());
+		}
+		else {
+			NotifyRemoved(record.get());
+		}
+	}
+}
+
+void Configure(const Nan::FunctionCallbackInfo<v8::Value>& args) {
+	Nan::HandleScope scope;
+
+	if (args.Length() == 0 || !args[0]->IsObject()) {
+		return Nan::ThrowTypeError("First argument must be an object");
+	}
+
+	v8::Local<v8::Object> options = args[0].As<v8::Object>();
+	v8::Local<v8::Value> mountTimeoutMs = Nan::Get(options, Nan::New<v8::String>(OPTION_MOUNT_TIMEOUT_MS).ToLocalChecked()).ToLocalChecked();
+
+	v8::Local<v8::Value> eventHistorySize = Nan::Get(options, Nan::New<v8::String>(OPTION_EVENT_HISTORY_SIZE).ToLocalChecked()).ToLocalChecked();
+	v8::Local<v8::Value> debounceMs = Nan::Get(options, Nan::New<v8::String>(OPTION_DEBOUNCE_MS).ToLocalChecked()).ToLocalChecked();
+	v8::Local<v8::Value> queuePolicy = Nan::Get(options, Nan::New<v8::String>(OPTION_QUEUE_POLICY).ToLocalChecked()).ToLocalChecked();
+
+	if (!queuePolicy->IsUndefined()) {
+		Nan::Utf8String name(queuePolicy);
+		int policy = -1;
+
+		for (int i = 0; i < (int) (sizeof(queuePolicyNames) / sizeof(queuePolicyNames[0])); i++) {
+			if (queuePolicy->IsString() && strcmp(*name, queuePolicyNames[i]) == 0) {
+				policy = i;
+			}
+		}
+		if (policy < 0) {
+			return Nan::ThrowTypeError("queuePolicy must be 'drop-newest', 'drop-oldest', 'coalesce' or 'block'");
+		}
+		context->deviceEvents.policy.store(policy);
+	}
+
+	if (mountTimeoutMs->IsNumber()) {
+		detectionOptions.mountTimeoutMs = Nan::To<int32_t>(mountTimeoutMs).FromJust();
+	}
+	if (eventHistorySize->IsNumber() && Nan::To<double>(eventHistorySize).FromJust() >= 1) {
+		EventHistoryResize(&context->eventHistory, (size_t) Nan::To<double>(eventHistorySize).FromJust());
+	}
+	if (debounceMs->IsNumber()) {
+		double windowMs = Nan::To<double>(debounceMs).FromJust();
+		context->debouncer.windowNs = windowMs > 0 ? (uint64_t) (windowMs * 1000000.0) : 0;
+
+		// Turned off, the held events go out now
+		if(context->debouncer.windowNs == 0 && context->debouncer.heldCount > 0) {
+			ReleaseDebounced(UINT64_MAX);
+			FinishDeviceEvents();
+		}
+	}
+}
+
 void StartMonitoring(const Nan::FunctionCallbackInfo<v8::Value>& args) {
-	Start();
+	Nan::HandleScope scope;
+
+	// Calling it again with other options replaces the filter while running
+	if (args.Length() > 0 && args[0]->IsObject()) {
+		v8::Local<v8::Object> options = args[0].As<v8::Object>();
+		v8::Local<v8::Value> vendorId = Nan::Get(options, Nan::New<v8::String>(OPTION_VENDOR_ID).ToLocalChecked()).ToLocalChecked();
+		v8::Local<v8::Value> productId = Nan::Get(options, Nan::New<v8::String>(OPTION_PRODUCT_ID).ToLocalChecked()).ToLocalChecked();
+		v8::Local<v8::Value> subsystems = Nan::Get(options, Nan::New<v8::String>(OPTION_SUBSYSTEMS).ToLocalChecked()).ToLocalChecked();
+
+		if (!subsystems->IsUndefined() && !subsystems->IsArray()) {
+			return Nan::ThrowTypeError("subsystems must be an array of strings");
+		}
+
+		std::vector<std::string> subsystemList;
+
+		if (subsystems->IsArray()) {
+			v8::Local<v8::Array> list = subsystems.As<v8::Array>();
+
+			for (uint32_t i = 0; i < list->Length(); i++) {
+				Nan::Utf8String subsystem(Nan::Get(list, i).ToLocalChecked());
+				subsystemList.push_back(*subsystem);
+			}
+		}
+
+		// Only this environment's, the backend monitors what any of them asked for
+		std::lock_guard<std::mutex> lock(contextsMutex);
+		context->filter.vendorId = vendorId->IsNumber() ? Nan::To<int32_t>(vendorId).FromJust() : 0;
+		context->filter.productId = productId->IsNumber() ? Nan::To<int32_t>(productId).FromJust() : 0;
+		context->filter.subsystems.swap(subsystemList);
+	}
+
+	SetMonitoring(true);
+	UpdateMonitorSubsystems();
 }
 
 void StopMonitoring(const Nan::FunctionCallbackInfo<v8::Value>& args) {
-	Stop();
+	SetMonitoring(false);
+	UpdateMonitorSubsystems();
+}
+
+#ifdef HAVE_ENVIRONMENT_CLEANUP_HOOK
+static void OnContextHandleClosed(uv_handle_t* handle) {
+	DetectionContext_t* closing = static_cast<DetectionContext_t*>(handle->data);
+
+	if(--closing->openHandles == 0) {
+		EventQueueFree(&closing->deviceEvents);
+		delete closing;
+	}
+}
+
+/* The environment goes away, a worker that ended or the process exiting.
+   It is taken off the fan-out first, so nothing queues for it while its
+   handles are closed. The backend keeps running for the others. */
+static void CleanupContext(void* arg) {
+	DetectionContext_t* closing = static_cast<DetectionContext_t*>(arg);
+
+	StopSyntheticEvents(&closing->deviceEvents);
+
+	{
+		std::unique_lock<std::mutex> lock(contextsMutex);
+		contexts.erase(std::remove(contexts.begin(), contexts.end(), closing), contexts.end());
+		// Its async handle is closed below
+		WaitForProducer(closing, lock);
+	}
+	if(closing->isMonitoring) {
+		MonitorHostSetMonitoring(false);
+		UpdateMonitorSubsystems();
+	}
+
+	delete closing->addedCallback;
+	delete closing->removedCallback;
+	delete closing->mountedCallback;
+	delete closing->routedCallback;
+	delete closing->logCallback;
+	delete closing->readyCallback;
+	delete closing->batchCallback;
+	delete closing->overflowCallback;
+	for(size_t i = 0; i < closing->subscribers.size(); i++) {
+		delete closing->subscribers[i].callback;
+	}
+	for(int i = 0; i < DeviceKey_Count; i++) {
+		closing->deviceObjectKeys[i].Reset();
+	}
+	closing->deviceObjectTemplate.Reset();
+
+	closing->deviceEventsAsync.data = closing;
+	closing->batchTimer.data = closing;
+	closing->debounceTimer.data = closing;
+	uv_close((uv_handle_t*) &closing->deviceEventsAsync, OnContextHandleClosed);
+	uv_close((uv_handle_t*) &closing->batchTimer, OnContextHandleClosed);
+	uv_close((uv_handle_t*) &closing->debounceTimer, OnContextHandleClosed);
+
+	if(context == closing) {
+		context = NULL;
+	}
 }
+#endif
 
-extern "C" {
-	void init (v8::Handle<v8::Object> target) {
-		Nan::SetMethod(target, "find", Find);
-		Nan::SetMethod(target, "registerAdded", RegisterAdded);
-		Nan::SetMethod(target, "registerRemoved", RegisterRemoved);
-		Nan::SetMethod(target, "registerLog", RegisterLog);
-		Nan::SetMethod(target, "startMonitoring", StartMonitoring);
-		Nan::SetMethod(target, "stopMonitoring", StopMonitoring);
-		InitDetection();
+NAN_MODULE_INIT(init) {
+	// Loaded again by the same environment, it keeps its context
+	bool isNewContext = context == NULL;
+	if(isNewContext) {
+		context = new DetectionContext_t();
 	}
+
+	Nan::SetMethod(target, "find", Find);
+	Nan::SetMethod(target, "findSync", FindSync);
+	Nan::SetMethod(target, "findBinary", FindBinary);
+	Nan::SetMethod(target, "changesSince", ChangesSince);
+	Nan::SetMethod(target, "registerAdded", RegisterAdded);
+	Nan::SetMethod(target, "registerRemoved", RegisterRemoved);
+	Nan::SetMethod(target, "registerLog", RegisterLog);
+	Nan::SetMethod(target, "registerMounted", RegisterMounted);
+	Nan::SetMethod(target, "registerBatch", RegisterBatch);
+	Nan::SetMethod(target, "registerOverflow", RegisterOverflow);
+	Nan::SetMethod(target, "registerRouted", RegisterRouted);
+	Nan::SetMethod(target, "setRoute", SetRoute);
+	Nan::SetMethod(target, "setRouteAll", SetRouteAll);
+	Nan::SetMethod(target, "registerReady", RegisterReady);
+	Nan::SetMethod(target, "configure", Configure);
+	Nan::SetMethod(target, "startMonitoring", StartMonitoring);
+	Nan::SetMethod(target, "stopMonitoring", StopMonitoring);
+	Nan::SetMethod(target, "getStats", GetStats);
+	Nan::SetMethod(target, "subscribe", Subscribe);
+	Nan::SetMethod(target, "unsubscribe", Unsubscribe);
+	Nan::SetMethod(target, "queueSyntheticEvents", QueueSyntheticEvents);
+	Nan::SetMethod(target, "marshalSyntheticDevices", MarshalSyntheticDevices);
+	Nan::SetMethod(target, "routeSyntheticEvents", RouteSyntheticEvents);
+
+	if(!isNewContext) {
+		return;
+	}
+
+	InitDeviceObjects();
+	InitDeviceEvents();
+	{
+		std::lock_guard<std::mutex> lock(contextsMutex);
+		contexts.push_back(context);
+	}
+#ifdef HAVE_ENVIRONMENT_CLEANUP_HOOK
+	node::AddEnvironmentCleanupHook(v8::Isolate::GetCurrent(), CleanupContext, context);
+#endif
+
+	// Monitoring from the start, like the module always did
+	SetMonitoring(true);
+	MonitorHostAcquire();
 }
 
-NODE_MODULE(detection, init);
+NAN_MODULE_WORKER_ENABLED(detection, init)
 
 
@@ -5,22 +5,29 @@
 #include <node.h>
 #include <v8.h>
 #include <uv.h>
+#include <atomic>
 #include <list>
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <nan.h>
 
 #include "deviceList.h"
+#include "eventQueue.h"
 
 void Find(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void FindSync(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void FindBinary(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void ChangesSince(const Nan::FunctionCallbackInfo<v8::Value>& args);
 void EIO_Find(uv_work_t* req);
 void EIO_AfterFind(uv_work_t* req);
-void InitDetection();
 void StartMonitoring(const Nan::FunctionCallbackInfo<v8::Value>& args);
-void Start();
 void StopMonitoring(const Nan::FunctionCallbackInfo<v8::Value>& args);
+// The backend, only called on the host thread, see monitorHost.h
+void InitDetection();
+void Start();
 void Stop();
 
 
@@ -28,17 +35,98 @@ struct ListBaton {
 	public:
 		//v8::Persistent<v8::Function> callback;
 		Nan::Callback* callback;
-		std::list<ListResultItem_t*> results;
+		std::vector<DeviceRecord_t> results;
 		char errorString[1024];
 		int vid;
 		int pid;
 };
 
+// Creates the property names and the template of the device objects, once
+void InitDeviceObjects();
+v8::Local<v8::Object> CreateDeviceObject(const ListResultItem_t* it);
+
 void RegisterLog(const Nan::FunctionCallbackInfo<v8::Value>& args);
 void NotifyLog(std::string msg);
 void RegisterAdded(const Nan::FunctionCallbackInfo<v8::Value>& args);
-void NotifyAdded(ListResultItem_t* it);
+void NotifyAdded(const ListResultItem_t* it);
 void RegisterRemoved(const Nan::FunctionCallbackInfo<v8::Value>& args);
-void NotifyRemoved(ListResultItem_t* it);
+void NotifyRemoved(const ListResultItem_t* it);
+void RegisterMounted(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void NotifyMounted(const ListResultItem_t* it);
+void RegisterBatch(const Nan::FunctionCallbackInfo<v8::Value>& args);
+// Events the queue or the monitor socket could not take, see FinishDeviceEvents()
+void RegisterOverflow(const Nan::FunctionCallbackInfo<v8::Value>& args);
+// Device events to the topics JS listens to, see topicRoutes.h
+void RegisterRouted(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void SetRoute(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void SetRouteAll(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void RegisterReady(const Nan::FunctionCallbackInfo<v8::Value>& args);
+// Called by the backend on the host thread once the initial device list is complete
+void NotifyReady();
+
+// Set from JS through configure(), read by the backends
+typedef struct {
+	// How long a new device may take to get mounted before we stop watching for it
+	int mountTimeoutMs;
+} DetectionOptions_t;
+
+extern DetectionOptions_t detectionOptions;
+
+void Configure(const Nan::FunctionCallbackInfo<v8::Value>& args);
+
+// Set from JS through startMonitoring(options), per environment. 0 or empty matches anything
+typedef struct {
+	int vendorId;
+	int productId;
+	std::vector<std::string> subsystems;
+} MonitorFilter_t;
+
+bool MonitorFilterMatches(const MonitorFilter_t* filter, int vendorId, int productId);
+
+/* Whether any environment that is monitoring wants the device, so the
+   backend can drop the others before reading them. Each environment is
+   matched again when the event is queued, see QueueDeviceEvent(). */
+bool MatchesMonitorFilter(int vendorId, int productId);
+
+// The subsystems of all the environments together, only touched on the
+// host thread. JS hands them over through monitorHost.h
+extern std::vector<std::string> monitorSubsystems;
+// Pushes monitorSubsystems down to the platform monitor, called on the host thread
+void UpdateMonitorFilter();
+
+// Written by the backend, read by getStats()
+typedef struct {
+	// Times the monitor woke up because its socket was readable
+	std::atomic<uint64_t> wakeups;
+	// Events read from the socket, after the kernel side filters
+	std::atomic<uint64_t> received;
+	// Events dropped by the vendor/product filter
+	std::atomic<uint64_t> filtered;
+	// Times the kernel dropped events because the socket buffer was full
+	std::atomic<uint64_t> overruns;
+	// What the kernel granted for the socket buffer, 0 when there is none
+	std::atomic<uint64_t> receiveBufferSize;
+	// Times UpdateMonitorFilter() changed the filter of the socket
+	std::atomic<uint64_t> filterUpdates;
+	// The platform monitor receives events
+	std::atomic<bool> isRunning;
+} MonitorCounters_t;
+
+extern MonitorCounters_t monitorCounters;
+
+// Hand-off of device events from the backend to every environment
+// that is monitoring, see detection.cpp. Called by the backend.
+void QueueDeviceEvent(DeviceEventType_t type, const DeviceRecord_t& record);
+// Stage times of the next QueueDeviceEvent() on the same thread, see
+// EventTimes_t. Optional, a backend that does not mark them gets 0 for
+// the stages before the queue.
+void MarkEventReceived();
+void MarkEventEnriched();
+// The monitor socket overflowed, counted and reported to every environment
+void QueueMonitorOverrun();
+void GetStats(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void DeliverHistory();
+void Subscribe(const Nan::FunctionCallbackInfo<v8::Value>& args);
+void Unsubscribe(const Nan::FunctionCallbackInfo<v8::Value>& args);
 
 #endif
@@ -1,10 +1,19 @@
+#include <errno.h>
 #include <libudev.h>
-#include <mntent.h>
 #include <pthread.h>
+#include <sys/epoll.h>
 #include <unistd.h>
+#include <algorithm>
+#include <vector>
 
 #include "detection.h"
 #include "deviceList.h"
+#include "monitorHost.h"
+#include "monitorWait_linux.h"
+#include "mountWatch_linux.h"
+#include "sysfsEnum_linux.h"
+#include "ueventReplay_linux.h"
+#include "ueventSocket_linux.h"
 
 using namespace std;
 
@@ -23,19 +32,62 @@ using namespace std;
 #define DEVICE_PROPERTY_SERIAL          "ID_SERIAL_SHORT"
 #define DEVICE_PROPERTY_VENDOR          "ID_VENDOR"
 
+#define MONITOR_MODE_ENV                "USB_DETECTION_MONITOR_MODE"
+#define MONITOR_MODE_LOOP               "loop"
+
+#define ENUMERATOR_ENV                  "USB_DETECTION_ENUMERATOR"
+#define ENUMERATOR_SYSFS                "sysfs"
+#define SYSFS_ROOT_ENV                  "USB_DETECTION_SYSFS_ROOT"
+
+#define MONITOR_SOURCE_ENV              "USB_DETECTION_MONITOR_SOURCE"
+#define MONITOR_SOURCE_KERNEL           "kernel"
+#define MONITOR_SOURCE_REPLAY           "replay"
+#define VENDOR_IDS_ENV                  "USB_DETECTION_VENDOR_IDS"
+#define REPLAY_FILE_ENV                 "USB_DETECTION_REPLAY_FILE"
+#define REPLAY_SPEED_ENV                "USB_DETECTION_REPLAY_SPEED"
+#define RECORD_FILE_ENV                 "USB_DETECTION_RECORD_FILE"
+#define RECEIVE_BUFFER_SIZE_ENV         "USB_DETECTION_RECEIVE_BUFFER_SIZE"
+
+// Only partitions are handled, disks and USB devices would just wake us up
+#define DEFAULT_SUBSYSTEM_MATCH         "block/" DEVICE_TYPE_PARTITION
+
+/* Libuv can poll for POLLPRI since 1.14, before that the mount table is
+   re-read on a timer while mounts are pending */
+#if UV_VERSION_MAJOR > 1 || (UV_VERSION_MAJOR == 1 && UV_VERSION_MINOR >= 14)
+#define HAVE_UV_PRIORITIZED
+#endif
+#define MOUNT_RECHECK_MS                250
+
 
 /**********************************
  * Local typedefs
  **********************************/
-
+typedef enum {
+    // A helper thread blocks on the monitor and queues the devices
+    MonitorMode_Thread,
+    // The monitor fd is polled by the host loop, devices are handled on the host thread
+    MonitorMode_Loop,
+} MonitorMode_t;
+
+typedef struct {
+    uv_work_t                  req;
+    // Listed by libudev, each one is read by a work item of its own
+    std::vector<std::string>   syspaths;
+    // Read by the sysfs enumerator in one go
+    std::vector<DeviceItem_t*> items;
+} ScanBaton_t;
+
+typedef struct {
+    uv_work_t     req;
+    std::string   syspath;
+    // NULL when the SCSI device is not a USB mass storage device
+    DeviceItem_t* item;
+} DeviceBaton_t;
 
 
 /**********************************
  * Local Variables
  **********************************/
-ListResultItem_t*             currentItem;
-
-bool                         isAdded;
 struct udev*                 udev;
 struct udev_enumerate*       enumerate;
 struct udev_list_entry*      devices;
@@ -44,182 +96,177 @@ struct udev_device*          dev;
 
 struct udev_monitor*         mon;
 int                          fd;
+// Kernel uevent socket or replay, replaces the udev monitor when opened
+int                          ueventFd = -1;
+char                         ueventBuffer[UEVENT_BUFFER_SIZE];
+// Only these vendors are reported by the kernel source, all when empty
+std::vector<int>             watchedVendorIds;
+// Takes the place of the kernel socket, ueventFd is its consumer end
+UeventReplay_t               replay;
+// Every event the source delivers goes to the file when it is open
+UeventRecorder_t             recorder = { NULL, 0 };
+MonitorWait_t                monitorWait = { -1, -1 };
+
+MonitorMode_t                monitorMode = MonitorMode_Thread;
+uv_poll_t                    monitorPoll;
+
+MountWatch_t                 mountWatch;
+bool                         isMountTableWatched = false;
+uv_poll_t                    mountPoll;
+uv_timer_t                   mountTimer;
 
 pthread_t       thread;
-pthread_mutex_t notify_mutex;
-pthread_cond_t  notifyNewDevice;
-pthread_cond_t  notifyDeviceHandled;
-
-bool newDeviceAvailable = false;
-bool deviceHandled      = true;
+bool            isThreadActive = false;
 
 bool isRunning          = false;
+
+std::vector<DeviceBaton_t*>  enumeration;
+size_t                       enumerationDone = 0;
+bool                         isEnumerated    = false;
+bool                         isStartPending  = false;
+const char*                  sysfsRoot       = SYSFS_DEFAULT_ROOT;
+// Replaces the libudev enumeration when set
+bool                         useSysfsEnumerator = false;
 /**********************************
  * Local Helper Functions protoypes
  **********************************/
 void  BuildInitialDeviceList();
 
 void* ThreadFunc(void* ptr);
-void  WaitForDeviceHandled();
-void  SignalDeviceHandled();
-void  WaitForNewDevice();
-void  SignalDeviceAvailable();
+void  HandleMonitorDevice(struct udev_device* dev);
+void  OnMonitorReadable(uv_poll_t* handle, int status, int events);
+void  DrainMonitor();
+void  HandleUevent(const Uevent_t* event);
+void  RecordMonitorDevice(struct udev_device* dev);
+void  WatchMountTable();
+void  OnMountResolved(const std::string& devNode, const std::string& mountPath);
+void  OnMountTableChanged(uv_poll_t* handle, int status, int events);
+void  OnMountTimer(uv_timer_t* handle);
+void  EIO_ScanDevices(uv_work_t* req);
+void  EIO_AfterScanDevices(uv_work_t* req, int status);
+void  EIO_ReadDevice(uv_work_t* req);
+void  EIO_AfterReadDevice(uv_work_t* req, int status);
+void  FinishEnumeration();
+void  AddSubsystemMatches();
+bool  IsVendorWatched(int vendorId);
 
 /**********************************
  * Public Functions
  **********************************/
-void NotifyAsync(uv_work_t* req)
+void Start()
 {
-    WaitForNewDevice();
-}
-
+    NotifyLog("Start");
 
-void NotifyFinished(uv_work_t* req)
-{
     if (isRunning)
     {
-        if (isAdded)
-        {
-            NotifyAdded(currentItem);
-        }
-
-        else
-        {
-            NotifyRemoved(currentItem);
-        }
+        return;
     }
 
-    // Delete Item in case of removal
-    if (isAdded == false)
+    if (!isEnumerated)
     {
-        delete currentItem;
+        // Started by FinishEnumeration()
+        isStartPending = true;
+        return;
     }
 
-    SignalDeviceHandled();
-    if (isRunning)
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-}
-
-void Start()
-{
-    NotifyLog("Start");
     isRunning = true;
-}
 
-void Stop()
-{
-    isRunning = false;
-    pthread_mutex_lock(&notify_mutex);
-    pthread_cond_signal(&notifyNewDevice);
-    pthread_mutex_unlock(&notify_mutex);
-    
-    pthread_mutex_lock(&notify_mutex);
-    pthread_cond_signal(&notifyDeviceHandled);
-    pthread_mutex_unlock(&notify_mutex);
-}
-
-void GetInitMountPath(struct udev_device* dev, ListResultItem_t* item)
-{
-    struct mntent *mnt;
-    FILE          *fp      = NULL;
-    const char    *devNode = udev_device_get_devnode(dev);
-
-    // TODO: find a better way to replace waiting for a second
-    sleep(1);
-    if ((fp = setmntent("/proc/mounts", "r")) == NULL)
+    if (monitorMode == MonitorMode_Loop)
     {
-        //TODO: sent error to js layer
-        //NanThrowError("Can't open mounted filesystems\n");
-        printf("Can't open mounted filesystems\n");
+        uv_poll_start(&monitorPoll, UV_READABLE, OnMonitorReadable);
+        WatchMountTable();
+        monitorCounters.isRunning = true;
         return;
     }
 
-    while ((mnt = getmntent(fp)))
+    if (!MonitorWaitInit(&monitorWait) || !MonitorWaitAddFd(&monitorWait, fd, EPOLLIN))
     {
-        if (mnt->mnt_fsname == strstr(mnt->mnt_fsname, devNode))//(!strcmp(mnt->mnt_fsname, devNode))
-        {
-            item->mountPath = mnt->mnt_dir;
-        }
+        printf("Can't set up the udev monitor wait\n");
+        MonitorWaitClose(&monitorWait);
+        return;
     }
 
-    /* close file for describing the mounted filesystems */
-    endmntent(fp);
-
-    SignalDeviceAvailable();
+    isThreadActive = pthread_create(&thread, NULL, ThreadFunc, NULL) == 0;
+    monitorCounters.isRunning = isThreadActive;
 }
 
-void GetMountPath(struct udev_device* dev, ListResultItem_t* item)
+void Stop()
 {
-    struct mntent *mnt;
-    FILE          *fp      = NULL;
-    const char    *devNode = udev_device_get_devnode(dev);
-    
-    std::string s(devNode);
-    item->devNode = s;
+    isStartPending = false;
 
-    // TODO: find a better way to replace waiting for a second
-    sleep(1);
-    if ((fp = setmntent("/proc/mounts", "r")) == NULL)
+    if (!isRunning)
     {
-        //TODO: sent error to js layer
-        //NanThrowError("Can't open mounted filesystems\n");
-        printf("Can't open mounted filesystems\n");
         return;
     }
 
-    while ((mnt = getmntent(fp)))
+    isRunning = false;
+    monitorCounters.isRunning = false;
+
+    if (monitorMode == MonitorMode_Loop)
     {
-        if (strcmp(mnt->mnt_fsname, devNode) == 0)
+        // Inactive handles no longer keep the loop alive
+        uv_poll_stop(&monitorPoll);
+        if (mountWatch.fd >= 0)
         {
-            item->mountPath = mnt->mnt_dir;
+            uv_poll_stop(&mountPoll);
         }
-        //else {
-        //    printf("mnt_fsname %s\n", mnt->mnt_fsname);
-        //    printf("mnt->mnt_dir %s\n", mnt->mnt_dir);
-        //    printf("devNode %s\n", devNode);
-        //}
+        uv_timer_stop(&mountTimer);
+        return;
     }
 
-    /* close file for describing the mounted filesystems */
-    endmntent(fp);
-
-    SignalDeviceAvailable();
+    // The monitor thread waits on JS for a second at most, with the block
+    // queue policy only
+    MonitorWaitWake(&monitorWait);
+    if (isThreadActive)
+    {
+        pthread_join(thread, NULL);
+        isThreadActive = false;
+    }
+    MonitorWaitClose(&monitorWait);
+    isMountTableWatched = false;
 }
 
-void GetMountPath2(struct udev_device* dev, ListResultItem_t* item)
+void UpdateMonitorFilter()
 {
-    struct mntent *mnt;
-    FILE          *fp      = NULL;
-    const char    *devNode = udev_device_get_devnode(dev);
-
-    std::string s(devNode);
-    item->devNode = s;
-
-    // TODO: find a better way to replace waiting for a second
-    sleep(1);
-    if ((fp = setmntent("/proc/mounts", "r")) == NULL)
+    /* The kernel source only ever looks at block partitions, its ids are
+       matched after parsing the event */
+    if (ueventFd >= 0 || mon == NULL)
     {
-        //TODO: sent error to js layer
-        //NanThrowError("Can't open mounted filesystems\n");
-        printf("Can't open mounted filesystems\n");
         return;
     }
 
-    while ((mnt = getmntent(fp)))
+    // libudev objects are not thread safe, the monitor thread must not
+    // receive while the filter changes. Queued events stay in the socket.
+    bool restart = isRunning && monitorMode == MonitorMode_Thread;
+    if (restart)
     {
-        if (!strcmp(mnt->mnt_fsname, devNode))
-        {
-            item->mountPath = mnt->mnt_dir;
-        } else {
-            //printf("mnt_fsname %s\n", mnt->mnt_fsname);
-            //printf("mnt->mnt_dir %s\n", mnt->mnt_dir);
-        }
+        Stop();
     }
 
-    /* close file for describing the mounted filesystems */
-    endmntent(fp);
+    udev_monitor_filter_remove(mon);
+    AddSubsystemMatches();
+    if (udev_monitor_filter_update(mon) < 0)
+    {
+        printf("Can't update the udev monitor filter\n");
+    }
+    else
+    {
+        monitorCounters.filterUpdates++;
+    }
+
+    if (restart)
+    {
+        Start();
+    }
+}
 
-    SignalDeviceAvailable();
+void ResolveMountPath(const char* devNode, bool matchPrefix, ListResultItem_t* item)
+{
+    if (!LookupMountPath(&mountWatch, devNode, matchPrefix, &item->mountPath))
+    {
+        // Not mounted (yet), a mount event follows if it shows up in time
+        MountWatchAdd(&mountWatch, devNode, matchPrefix, detectionOptions.mountTimeoutMs);
+    }
 }
 
 static struct udev_device* get_child(struct udev* udev, struct udev_device* parent, const char* subsystem) {
@@ -243,7 +290,7 @@ static struct udev_device* get_child(struct udev* udev, struct udev_device* pare
   return child;
 }
 
-static void enumerate_usb_mass_storage(struct udev* udev) {
+static void enumerate_usb_mass_storage(struct udev* udev, std::vector<std::string>* syspaths) {
   struct udev_enumerate* enumerate = udev_enumerate_new(udev);
 
   udev_enumerate_add_match_subsystem(enumerate, "scsi");
@@ -254,10 +301,20 @@ static void enumerate_usb_mass_storage(struct udev* udev) {
   struct udev_list_entry *entry;
 
   udev_list_entry_foreach(entry, devices) {
-    const char* path = udev_list_entry_get_name(entry);
+    syspaths->push_back(udev_list_entry_get_name(entry));
+  }
+
+  udev_enumerate_unref(enumerate);
+}
+
+static DeviceItem_t* read_usb_mass_storage(struct udev* udev, const char* path) {
+    DeviceItem_t* item = NULL;
     //printf("   Path absolute: %s\n", path);
     struct udev_device* scsi = udev_device_new_from_syspath(udev, path);
 
+    if (!scsi)
+      return NULL;
+
     struct udev_device* block = get_child(udev, scsi, "block");
     struct udev_device* scsi_disk = get_child(udev, scsi, "scsi_disk");
 
@@ -279,7 +336,8 @@ static void enumerate_usb_mass_storage(struct udev* udev) {
           vendor);
         */
     
-	DeviceItem_t* item = new DeviceItem_t();
+	item = new DeviceItem_t();
+	item->syspath = udev_device_get_syspath(block);
 	item->deviceParams.devNode = devNode;
 	item->deviceParams.vendorId = strtol (idVendor, NULL, 16);
 	item->deviceParams.productId = strtol (idProduct, NULL, 16);
@@ -302,13 +360,8 @@ static void enumerate_usb_mass_storage(struct udev* udev) {
 
 	item->deviceParams.deviceAddress = 0;
 	item->deviceParams.locationId = 0;
-		
-
-	GetInitMountPath(block, &item->deviceParams);
 
 	item->deviceState = DeviceState_Connect;
-
-	AddItemToList((char *)devNode, item);
     }    
 
     if (block)
@@ -318,9 +371,118 @@ static void enumerate_usb_mass_storage(struct udev* udev) {
       udev_device_unref(scsi_disk);
 
     udev_device_unref(scsi);
-  }
 
-  udev_enumerate_unref(enumerate);
+    return item;
+}
+
+/* libudev objects must not be shared between threads, so every work item
+   below runs with a udev context of its own. */
+void EIO_ScanDevices(uv_work_t* req)
+{
+    ScanBaton_t* baton   = static_cast<ScanBaton_t*>(req->data);
+    struct udev* context;
+
+    if (useSysfsEnumerator)
+    {
+        if (!SysfsEnumerateMassStorage(sysfsRoot, &baton->items))
+        {
+            printf("Can't enumerate the devices in %s\n", sysfsRoot);
+        }
+        return;
+    }
+
+    if ((context = udev_new()))
+    {
+        enumerate_usb_mass_storage(context, &baton->syspaths);
+        udev_unref(context);
+    }
+}
+
+void EIO_AfterScanDevices(uv_work_t* req, int status)
+{
+    ScanBaton_t* baton = static_cast<ScanBaton_t*>(req->data);
+
+    // One work item per device, so slow devices are read in parallel
+    for (size_t i = 0; i < baton->syspaths.size(); i++)
+    {
+        DeviceBaton_t* device = new DeviceBaton_t();
+
+        device->req.data = device;
+        device->syspath  = baton->syspaths[i];
+        device->item     = NULL;
+
+        enumeration.push_back(device);
+        uv_queue_work(MonitorHostLoop(), &device->req, EIO_ReadDevice, (uv_after_work_cb) EIO_AfterReadDevice);
+    }
+
+    for (size_t i = 0; i < baton->items.size(); i++)
+    {
+        DeviceBaton_t* device = new DeviceBaton_t();
+
+        device->item = baton->items[i];
+        enumeration.push_back(device);
+    }
+
+    bool isComplete = baton->syspaths.empty();
+    delete baton;
+
+    if (isComplete)
+    {
+        FinishEnumeration();
+    }
+}
+
+void EIO_ReadDevice(uv_work_t* req)
+{
+    DeviceBaton_t* device  = static_cast<DeviceBaton_t*>(req->data);
+    struct udev*   context = udev_new();
+
+    if (context)
+    {
+        device->item = read_usb_mass_storage(context, device->syspath.c_str());
+        udev_unref(context);
+    }
+}
+
+void EIO_AfterReadDevice(uv_work_t* req, int status)
+{
+    if (++enumerationDone == enumeration.size())
+    {
+        FinishEnumeration();
+    }
+}
+
+/* Runs on the host thread before the monitor is started, so the registry
+   and the mount watch are not shared with the monitor thread yet. */
+void FinishEnumeration()
+{
+    // Published as one snapshot, before anyone is told the list is ready
+    BeginListUpdate();
+    for (size_t i = 0; i < enumeration.size(); i++)
+    {
+        DeviceItem_t* item = enumeration[i]->item;
+
+        if (item)
+        {
+            // Whole disk node, its partitions are what gets mounted
+            ResolveMountPath(item->deviceParams.devNode.c_str(), true, &item->deviceParams);
+            AddItemToList((char *) item->deviceParams.devNode.c_str(), item);
+        }
+
+        delete enumeration[i];
+    }
+    EndListUpdate();
+
+    enumeration.clear();
+    isEnumerated = true;
+
+    NotifyReady();
+
+    if (isStartPending)
+    {
+        isStartPending = false;
+        Start();
+    }
 }
 
 void InitDetection()
@@ -333,37 +495,130 @@ void InitDetection()
     if (!udev)
     {
         printf("Can't create udev\n");
+        // There is no device list to wait for, find() answers with an empty one
+        NotifyReady();
         return;
     }
 
-    /* Set up a monitor to monitor devices */
-    mon = udev_monitor_new_from_netlink(udev, "udev");
-    //udev_monitor_filter_add_match_subsystem_devtype(mon, "usb", "usb_device");
-    
-    udev_monitor_filter_add_match_subsystem_devtype(mon, "block", NULL);
-    udev_monitor_filter_add_match_subsystem_devtype(mon, "usb","usb_device");
-    
-    udev_monitor_enable_receiving(mon);
+    const char* mode = getenv(MONITOR_MODE_ENV);
+    if (mode != NULL && strcmp(mode, MONITOR_MODE_LOOP) == 0)
+    {
+        monitorMode = MonitorMode_Loop;
+    }
+
+    const char* enumerator = getenv(ENUMERATOR_ENV);
+    useSysfsEnumerator = enumerator != NULL && strcmp(enumerator, ENUMERATOR_SYSFS) == 0;
+
+    if (getenv(SYSFS_ROOT_ENV) != NULL)
+    {
+        sysfsRoot = getenv(SYSFS_ROOT_ENV);
+    }
+
+    const char* source = getenv(MONITOR_SOURCE_ENV);
+    if (source != NULL && strcmp(source, MONITOR_SOURCE_KERNEL) == 0)
+    {
+        ueventFd = UeventSocketOpen();
+        if (ueventFd < 0)
+        {
+            printf("Can't open the kernel uevent socket, using udev\n");
+        }
+    }
+    else if (source != NULL && strcmp(source, MONITOR_SOURCE_REPLAY) == 0)
+    {
+        const char* replayFile = getenv(REPLAY_FILE_ENV);
+
+        // The recorded attributes are written into the root, never into /sys
+        if (replayFile == NULL || strcmp(sysfsRoot, SYSFS_DEFAULT_ROOT) == 0)
+        {
+            printf("Replaying needs " REPLAY_FILE_ENV " and " SYSFS_ROOT_ENV ", using udev\n");
+        }
+        else if (!UeventReplayStart(&replay, replayFile, UeventReplayParseSpeed(getenv(REPLAY_SPEED_ENV)), sysfsRoot))
+        {
+            printf("Can't replay %s, using udev\n", replayFile);
+        }
+        else
+        {
+            ueventFd = replay.fds[0];
+            // The devices of the host are not part of the recording
+            useSysfsEnumerator = true;
+        }
+    }
+
+    if (getenv(RECORD_FILE_ENV) != NULL && !UeventRecorderOpen(&recorder, getenv(RECORD_FILE_ENV)))
+    {
+        printf("Can't record to %s\n", getenv(RECORD_FILE_ENV));
+    }
+
+    if (ueventFd >= 0)
+    {
+        // "1234,abcd", hex like the ids in sysfs
+        const char* vendorIds = getenv(VENDOR_IDS_ENV);
+        while (vendorIds != NULL && *vendorIds)
+        {
+            char* end;
+            long  vendorId = strtol(vendorIds, &end, 16);
+
+            if (end == vendorIds)
+            {
+                break;
+            }
+            watchedVendorIds.push_back((int) vendorId);
+            vendorIds = *end == ',' ? end + 1 : end;
+        }
+
+        fd = ueventFd;
+    }
+    else
+    {
+        /* Set up a monitor to monitor devices */
+        mon = udev_monitor_new_from_netlink(udev, "udev");
+
+        // Compiled into the socket filter by libudev
+        AddSubsystemMatches();
+
+        udev_monitor_enable_receiving(mon);
 
-    /* Get the file descriptor (fd) for the monitor.
-       This fd will get passed to select() */
-    fd = udev_monitor_get_fd(mon);
+        /* Get the file descriptor (fd) for the monitor.
+           The monitor thread blocks on it through epoll */
+        fd = udev_monitor_get_fd(mon);
+    }
+
+    /* Events wait in the socket while the monitor is busy, a burst that
+       does not fit is lost in the kernel. udev_monitor_set_receive_buffer_size()
+       only tries to force the size, this falls back to the system limit. */
+    const char* receiveBufferSize = getenv(RECEIVE_BUFFER_SIZE_ENV);
+    int         size              = receiveBufferSize != NULL ? atoi(receiveBufferSize) : 0;
+
+    monitorCounters.receiveBufferSize = UeventSetReceiveBuffer(fd, size > 0 ? size : UEVENT_RECEIVE_BUFFER_SIZE);
 
 
-    enumerate_usb_mass_storage(udev);
+    if (!MountWatchInit(&mountWatch))
+    {
+        printf("Can't watch the mount table\n");
+    }
+
+    /* The device list is read on the thread pool, require() does not wait
+       for it. Events that arrive meanwhile stay in the monitor socket
+       until the list is complete. */
+    ScanBaton_t* baton = new ScanBaton_t();
+    baton->req.data = baton;
+    uv_queue_work(MonitorHostLoop(), &baton->req, EIO_ScanDevices, (uv_after_work_cb) EIO_AfterScanDevices);
     
     //BuildInitialDeviceList();
 
-    pthread_mutex_init(&notify_mutex, NULL);
-    pthread_cond_init(&notifyNewDevice, NULL);
-    pthread_cond_init(&notifyDeviceHandled, NULL);       
-    
-    Start();
+    if (monitorMode == MonitorMode_Loop)
+    {
+        /* No helper thread: the host loop wakes up when the monitor fd is
+           readable and the devices are handled right there. */
+        uv_poll_init(MonitorHostLoop(), &monitorPoll, fd);
+        uv_timer_init(MonitorHostLoop(), &mountTimer);
+        if (mountWatch.fd >= 0)
+        {
+            uv_poll_init(MonitorHostLoop(), &mountPoll, mountWatch.fd);
+        }
+    }
 
-    uv_work_t *req = new uv_work_t();
-    uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-    
-    pthread_create(&thread, NULL, ThreadFunc, NULL);    
+    Start();
 }
 
 
@@ -377,46 +632,48 @@ void EIO_Find(uv_work_t* req)
 /**********************************
  * Local Functions
  **********************************/
-void WaitForDeviceHandled()
+/* Entries are "subsystem" or "subsystem/devtype", like the matches of
+   udevadm monitor. The partitions are always matched, they are the only
+   events HandleMonitorDevice() handles. */
+void AddSubsystemMatches()
 {
-    pthread_mutex_lock(&notify_mutex);
+    std::vector<std::string> matches = monitorSubsystems;
 
-    if (deviceHandled == false)
+    if (find(matches.begin(), matches.end(), DEFAULT_SUBSYSTEM_MATCH) == matches.end())
     {
-        pthread_cond_wait(&notifyDeviceHandled, &notify_mutex);
+        matches.push_back(DEFAULT_SUBSYSTEM_MATCH);
     }
 
-    deviceHandled = false;
-    pthread_mutex_unlock(&notify_mutex);
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        size_t      slash     = matches[i].find('/');
+        std::string subsystem = matches[i].substr(0, slash);
+        std::string devtype   = slash == std::string::npos ? "" : matches[i].substr(slash + 1);
+
+        udev_monitor_filter_add_match_subsystem_devtype(mon, subsystem.c_str(), devtype.empty() ? NULL : devtype.c_str());
+    }
 }
 
-void SignalDeviceHandled()
+bool IsVendorWatched(int vendorId)
 {
-    pthread_mutex_lock(&notify_mutex);
-    deviceHandled = true;
-    pthread_cond_signal(&notifyDeviceHandled);
-    pthread_mutex_unlock(&notify_mutex);
+    return watchedVendorIds.empty() ||
+           find(watchedVendorIds.begin(), watchedVendorIds.end(), vendorId) != watchedVendorIds.end();
 }
 
-void WaitForNewDevice()
+/* udevd already attached the ids of the USB device to the event, so
+   filtered devices are dropped before anything is read from sysfs.
+   Events without them are checked once the item is read. */
+bool MatchesEventProperties(struct udev_device* dev)
 {
-    pthread_mutex_lock(&notify_mutex);
+    const char* idVendor  = udev_device_get_property_value(dev, "ID_VENDOR_ID");
+    const char* idProduct = udev_device_get_property_value(dev, "ID_MODEL_ID");
 
-    if (newDeviceAvailable == false)
+    if (idVendor == NULL || idProduct == NULL)
     {
-        pthread_cond_wait(&notifyNewDevice, &notify_mutex);
+        return true;
     }
 
-    newDeviceAvailable = false;
-    pthread_mutex_unlock(&notify_mutex);
-}
-
-void SignalDeviceAvailable()
-{
-    pthread_mutex_lock(&notify_mutex);
-    newDeviceAvailable = true;
-    pthread_cond_signal(&notifyNewDevice);
-    pthread_mutex_unlock(&notify_mutex);
+    return MatchesMonitorFilter(strtol(idVendor, NULL, 16), strtol(idProduct, NULL, 16));
 }
 
 void initItem(ListResultItem_t* item)
@@ -489,206 +746,396 @@ ListResultItem_t* GetProperties(struct udev_device* dev, ListResultItem_t* item)
 
 void DeviceAdded(const char* devNode, DeviceItem_t* item)
 {    
+    MarkEventEnriched();
     AddItemToList((char *)devNode, item);
 
-    currentItem = &item->deviceParams;
-    isAdded     = true;
-
-    SignalDeviceAvailable();
+    // JS gets the record the registry just published
+    QueueDeviceEvent(DeviceEvent_Added, item->record);
 }
 
 void DeviceRemoved(const char* devNode)
 {
-    ListResultItem_t* item = NULL;
+    DeviceRecord_t record;
 
+    MarkEventEnriched();
     if (IsItemAlreadyStored((char *)devNode))
     {
         DeviceItem_t* deviceItem = GetItemFromList((char *)devNode);
 
         if (deviceItem)
         {
-            item = CopyElement(&deviceItem->deviceParams);
+            // Outlives the item, the snapshots and the event still hold it
+            record = deviceItem->record;
         }
 
         RemoveItemFromList(deviceItem);
         delete deviceItem;
     }
 
-    if (item == NULL)
+    MountWatchRemove(&mountWatch, devNode);
+
+    if (!record)
     {
-        item = new ListResultItem_t();
-        GetProperties(dev, item);
+        ListResultItem_t item = ListResultItem_t();
+        GetProperties(dev, &item);
+        record = CreateDeviceRecord(&item);
     }
 
-    currentItem = item;
-    isAdded     = false;
-
-    SignalDeviceAvailable();
+    QueueDeviceEvent(DeviceEvent_Removed, record);
 }
 
 
-void* ThreadFunc(void* ptr)
+void HandleMonitorDevice(struct udev_device* dev)
 {
-    while (isRunning)
-    {
-    	/* Set up the call to select(). In this case, select() will
-	   only operate on a single file descriptor, the one
-	   associated with our udev_monitor. Note that the timeval
-	   object is set to 0, which will cause select() to not
-	   block. */
-	fd_set fds;
-	struct timeval tv;
-	int ret;
+	const char* devtype = udev_device_get_devtype(dev);
+
+	// Other subsystems only get here when startMonitoring() asked for them
+	if (devtype != NULL && strcmp(devtype, DEVICE_TYPE_PARTITION) == 0){
+		//const char *syspath;
+		/* Get the filename of the /sys entry for the device
+		   and create a udev_device object (dev) representing it */
+		//syspath = udev_device_get_syspath(dev);
 	
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
+		/*
+		printf("Got Device\n");
+		printf("   Sysname: %s\n",udev_device_get_sysname(dev));
+		printf("   Syspath: %s\n",udev_device_get_syspath(dev));
+		printf("   Devpath: %s\n",udev_device_get_devpath(dev));
+		printf("   Node: %s\n", udev_device_get_devnode(dev));
+		printf("   Subsystem: %s\n", udev_device_get_subsystem(dev));
+		printf("   Devtype: %s\n", udev_device_get_devtype(dev));
+		printf("   Action: %s\n",udev_device_get_action(dev));
+		*/					
 	
-	ret = select(fd+1, &fds, NULL, NULL, &tv);
-	
-	/* Check if our file descriptor has received data. */
-	if (ret > 0 && FD_ISSET(fd, &fds)) {
-		//printf("\nselect() says there should be data\n");
-			
-		/* Make the call to receive the device.
-		   select() ensured that this will not block. */
-		dev = udev_monitor_receive_device(mon);
-		if (dev) {
-			if (strcmp(udev_device_get_devtype(dev), DEVICE_TYPE_PARTITION) == 0){
-				//const char *syspath;
-				/* Get the filename of the /sys entry for the device
-				   and create a udev_device object (dev) representing it */
-				//syspath = udev_device_get_syspath(dev);
-			
-				/*
-				printf("Got Device\n");
-				printf("   Sysname: %s\n",udev_device_get_sysname(dev));
-				printf("   Syspath: %s\n",udev_device_get_syspath(dev));
-				printf("   Devpath: %s\n",udev_device_get_devpath(dev));
-				printf("   Node: %s\n", udev_device_get_devnode(dev));
-				printf("   Subsystem: %s\n", udev_device_get_subsystem(dev));
-				printf("   Devtype: %s\n", udev_device_get_devtype(dev));
-				printf("   Action: %s\n",udev_device_get_action(dev));
-				*/					
-			
+
+		if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_ADDED) == 0) {
+			if (!MatchesEventProperties(dev)) {
+				monitorCounters.filtered++;
+				return;
+			}
+
+			struct udev_device* block = get_child(udev, dev, "block");
+
+			struct udev_device* usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+
+			if (block && usb) {
+				const char  *devNode  = udev_device_get_devnode(block);
+			    	const char* idVendor = udev_device_get_sysattr_value(usb, "idVendor");
+			    	const char* idProduct = udev_device_get_sysattr_value(usb, "idProduct");
+			    	//const char* vendor = udev_device_get_sysattr_value(usb, "vendor");
+			    
+				//printf("block = %s, usb = %s:%s, vendor = %s\n",
+				//  devNode,
+				//  idVendor,
+				//  idProduct,
+				//  vendor);
+			    
+				DeviceItem_t* item = new DeviceItem_t();
+				initItem(&item->deviceParams);
+				item->syspath = udev_device_get_syspath(dev);
+				item->deviceParams.devNode = devNode;
+				item->deviceParams.vendorId = strtol (idVendor, NULL, 16);
+				item->deviceParams.productId = strtol (idProduct, NULL, 16);
+
+
+				if (udev_device_get_sysattr_value(usb, "product") != NULL)
+				{
+				    item->deviceParams.deviceName = udev_device_get_sysattr_value(usb, "product");
+				}
+
+				if (udev_device_get_sysattr_value(usb, "manufacturer") != NULL)
+				{
+				    item->deviceParams.manufacturer = udev_device_get_sysattr_value(usb, "manufacturer");
+				}
+
+				if (udev_device_get_sysattr_value(usb, "serial") != NULL)
+				{
+				    item->deviceParams.serialNumber = udev_device_get_sysattr_value(usb, "serial");
+				}
+
+				item->deviceParams.deviceAddress = 0;
+				item->deviceParams.locationId = 0;
+
+				// Not tracked at all, so there is no mount to wait for either
+				if (!MatchesMonitorFilter(item->deviceParams.vendorId, item->deviceParams.productId)) {
+					monitorCounters.filtered++;
+					delete item;
+					udev_device_unref(block);
+					return;
+				}
+
+				ResolveMountPath(devNode, false, &item->deviceParams);
+
+				item->deviceState = DeviceState_Connect;
 		
-				if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_ADDED) == 0) {
-					struct udev_device* block = get_child(udev, dev, "block");
-
-					struct udev_device* usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
-
-					if (block && usb) {
-						const char  *devNode  = udev_device_get_devnode(block);
-					    	const char* idVendor = udev_device_get_sysattr_value(usb, "idVendor");
-					    	const char* idProduct = udev_device_get_sysattr_value(usb, "idProduct");
-					    	//const char* vendor = udev_device_get_sysattr_value(usb, "vendor");
-					    
-						//printf("block = %s, usb = %s:%s, vendor = %s\n",
-						//  devNode,
-						//  idVendor,
-						//  idProduct,
-						//  vendor);
-					    
-						DeviceItem_t* item = new DeviceItem_t();
-						initItem(&item->deviceParams);
-						item->deviceParams.devNode = devNode;
-						item->deviceParams.vendorId = strtol (idVendor, NULL, 16);
-						item->deviceParams.productId = strtol (idProduct, NULL, 16);
-
-
-						if (udev_device_get_sysattr_value(usb, "product") != NULL)
-						{
-						    item->deviceParams.deviceName = udev_device_get_sysattr_value(usb, "product");
-						}
-
-						if (udev_device_get_sysattr_value(usb, "manufacturer") != NULL)
-						{
-						    item->deviceParams.manufacturer = udev_device_get_sysattr_value(usb, "manufacturer");
-						}
-
-						if (udev_device_get_sysattr_value(usb, "serial") != NULL)
-						{
-						    item->deviceParams.serialNumber = udev_device_get_sysattr_value(usb, "serial");
-						}
-
-						item->deviceParams.deviceAddress = 0;
-						item->deviceParams.locationId = 0;
+				//printf("MountPath: %s\n",item->deviceParams.mountPath.c_str());
 		
-
-						GetMountPath(block, &item->deviceParams);
-
-						item->deviceState = DeviceState_Connect;
-				
-						//printf("MountPath: %s\n",item->deviceParams.mountPath.c_str());
-				
-						//printItem(&item->deviceParams);
-					
-						WaitForDeviceHandled();
-						DeviceAdded(udev_device_get_devnode(dev), item);
-					}
+				//printItem(&item->deviceParams);
 			
-					if (block)
-					    udev_device_unref(block);
-					    
-				} else if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_REMOVED) == 0) {
-					WaitForDeviceHandled();
-		            		DeviceRemoved(udev_device_get_devnode(dev));
-				}
-			}			
-						
-			udev_device_unref(dev);
+				DeviceAdded(udev_device_get_devnode(dev), item);
+			}
+	
+			if (block)
+			    udev_device_unref(block);
+			    
+		} else if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_REMOVED) == 0) {
+			DeviceRemoved(udev_device_get_devnode(dev));
 		}
-		//else {
-		//	printf("No Device from receive_device(). An error occured.\n");
-		//}					
 	}
-	usleep(250*1000);
-	//printf(".");
-	//fflush(stdout);
-    
-    
-        /* Make the call to receive the device.
-           select() ensured that this will not block. */
-           
-           /*
-        dev = udev_monitor_receive_device(mon);
+}
 
-        if (dev)
+
+/* Kernel uevents arrive before udev created the device node and ran its
+   rules, so everything is read from sysfs. Partitions that are not below a
+   USB device, or that are not watched, end here. */
+void HandleUevent(const Uevent_t* event)
+{
+    if (strcmp(event->subsystem, "block") != 0 ||
+        event->devtype == NULL || strcmp(event->devtype, DEVICE_TYPE_PARTITION) != 0 ||
+        event->devname == NULL)
+    {
+        return;
+    }
+
+    std::string devNode = std::string("/dev/") + event->devname;
+
+    if (strcmp(event->action, DEVICE_ACTION_ADDED) == 0)
+    {
+        DeviceItem_t* item = SysfsReadUsbBlockDevice(sysfsRoot, event->devpath, event->devname);
+
+        if (item == NULL)
         {
-        
-            if (udev_device_get_devtype(dev) && strcmp(udev_device_get_devtype(dev), DEVICE_TYPE_DEVICE) == 0)
+            return;
+        }
+
+        if (!IsVendorWatched(item->deviceParams.vendorId) ||
+            !MatchesMonitorFilter(item->deviceParams.vendorId, item->deviceParams.productId))
+        {
+            monitorCounters.filtered++;
+            delete item;
+            return;
+        }
+
+        ResolveMountPath(devNode.c_str(), false, &item->deviceParams);
+        DeviceAdded(devNode.c_str(), item);
+    }
+    else if (strcmp(event->action, DEVICE_ACTION_REMOVED) == 0 && IsItemAlreadyStored((char *) devNode.c_str()))
+    {
+        DeviceRemoved(devNode.c_str());
+    }
+}
+
+/* Recorded in the format of the kernel, so a replay goes through the same
+   path whichever source it was recorded from */
+void RecordMonitorDevice(struct udev_device* dev)
+{
+    std::string             message = std::string(udev_device_get_action(dev)) + "@" + udev_device_get_devpath(dev);
+    struct udev_list_entry* entry;
+
+    message += '\0';
+    udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev))
+    {
+        const char* name  = udev_list_entry_get_name(entry);
+        const char* value = udev_list_entry_get_value(entry);
+
+        if (value == NULL)
+        {
+            value = "";
+        }
+
+        // The kernel names the node relative to /dev
+        if (strcmp(name, "DEVNAME") == 0 && strncmp(value, "/dev/", 5) == 0)
+        {
+            value += 5;
+        }
+
+        message += std::string(name) + "=" + value;
+        message += '\0';
+    }
+
+    UeventRecorderWrite(&recorder, uv_hrtime(), message.data(), message.size(), sysfsRoot);
+}
+
+void DrainMonitor()
+{
+    if (ueventFd >= 0)
+    {
+        ssize_t  length;
+        Uevent_t event;
+
+        while ((length = UeventReceive(ueventFd, ueventBuffer, sizeof(ueventBuffer))) != 0)
+        {
+            // Reported once, the socket goes on with what it still has
+            if (length < 0)
             {
-            	
-                if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_ADDED) == 0)
+                if (errno != ENOBUFS)
                 {
-                    DeviceItem_t* item = new DeviceItem_t();
-		    GetProperties(dev, &item->deviceParams);
-		    
-                    WaitForDeviceHandled();
-                    DeviceAdded(udev_device_get_devnode(dev), item);
+                    break;
                 }
+                QueueMonitorOverrun();
+                continue;
+            }
 
-                else if (strcmp(udev_device_get_action(dev), DEVICE_ACTION_REMOVED) == 0)
-                {
-                    WaitForDeviceHandled();
-                    DeviceRemoved(udev_device_get_devnode(dev));
-                }
+            MarkEventReceived();
+            monitorCounters.received++;
+            UeventRecorderWrite(&recorder, uv_hrtime(), ueventBuffer, length, sysfsRoot);
+            if (UeventParse(ueventBuffer, length, &event))
+            {
+                HandleUevent(&event);
             }
-            
-            if (udev_device_get_devtype(dev) 
-            	&& !strcmp(udev_device_get_devtype(dev), DEVICE_TYPE_PARTITION) 
-            	&& (strcmp(udev_device_get_action(dev), DEVICE_ACTION_ADDED) == 0 || strcmp(udev_device_get_action(dev), DEVICE_ACTION_REMOVED) == 0))
-		{
-		   GetMountPath2(dev, currentItem);
-		}        
-
-            udev_device_unref(dev);
         }
-        */
+        return;
+    }
+
+    /* The monitor socket is non-blocking, so drain everything that
+       queued up: a burst of events is handled with a single wakeup. */
+    while (true)
+    {
+        errno = 0;
+        dev   = udev_monitor_receive_device(mon);
+        if (dev == NULL)
+        {
+            if (errno != ENOBUFS)
+            {
+                break;
+            }
+            QueueMonitorOverrun();
+            continue;
+        }
+
+        MarkEventReceived();
+        monitorCounters.received++;
+        if (recorder.file != NULL)
+        {
+            RecordMonitorDevice(dev);
+        }
+        HandleMonitorDevice(dev);
+        udev_device_unref(dev);
+    }
+}
+
+void OnMountResolved(const std::string& devNode, const std::string& mountPath)
+{
+    DeviceItem_t* item = GetItemFromList((char *) devNode.c_str());
+
+    if (item == NULL)
+    {
+        return;
+    }
+
+    // The mount table was read already, the event starts here
+    MarkEventReceived();
+    MarkEventEnriched();
+    item->deviceParams.mountPath = mountPath;
+    RefreshItemInList(item);
+    QueueDeviceEvent(DeviceEvent_Mounted, item->record);
+}
+
+/* The mount table is only watched while devices wait for their mount, so
+   mounts elsewhere on the system cost no wakeups otherwise. */
+void WatchMountTable()
+{
+    int  timeout = MountWatchNextTimeoutMs(&mountWatch);
+    bool watch   = timeout >= 0 && mountWatch.fd >= 0;
+
+    if (monitorMode == MonitorMode_Thread)
+    {
+        if (watch && !isMountTableWatched)
+        {
+            isMountTableWatched = MonitorWaitAddFd(&monitorWait, mountWatch.fd, EPOLLPRI);
+        }
+        else if (!watch && isMountTableWatched)
+        {
+            MonitorWaitRemoveFd(&monitorWait, mountWatch.fd);
+            isMountTableWatched = false;
+        }
+        return;
+    }
+
+    if (!watch)
+    {
+        if (mountWatch.fd >= 0)
+        {
+            uv_poll_stop(&mountPoll);
+        }
+        uv_timer_stop(&mountTimer);
+        return;
+    }
+
+#ifdef HAVE_UV_PRIORITIZED
+    uv_poll_start(&mountPoll, UV_PRIORITIZED, OnMountTableChanged);
+#else
+    if (timeout > MOUNT_RECHECK_MS)
+    {
+        timeout = MOUNT_RECHECK_MS;
+    }
+#endif
+    uv_timer_start(&mountTimer, (uv_timer_cb) OnMountTimer, timeout, 0);
+}
+
+void OnMonitorReadable(uv_poll_t* handle, int status, int events)
+{
+    if (status < 0 || !isRunning)
+    {
+        return;
+    }
+
+    monitorCounters.wakeups++;
+    DrainMonitor();
+    WatchMountTable();
+}
+
+void OnMountTableChanged(uv_poll_t* handle, int status, int events)
+{
+    MountWatchCheck(&mountWatch, true, OnMountResolved);
+    WatchMountTable();
+}
+
+void OnMountTimer(uv_timer_t* handle)
+{
+#ifdef HAVE_UV_PRIORITIZED
+    MountWatchCheck(&mountWatch, false, OnMountResolved);
+#else
+    MountWatchCheck(&mountWatch, true, OnMountResolved);
+#endif
+    WatchMountTable();
+}
+
+void* ThreadFunc(void* ptr)
+{
+    int readyFds[MONITOR_WAIT_MAX_FDS];
+
+    WatchMountTable();
+
+    while (isRunning)
+    {
+        /* Sleep until the monitor socket has data, the mount table changed
+           or Stop() wakes us up. The only timeout is the deadline of a
+           pending mount, so an idle bus costs no wakeups at all. */
+        int  ready        = MonitorWaitNext(&monitorWait, MountWatchNextTimeoutMs(&mountWatch), readyFds, MONITOR_WAIT_MAX_FDS);
+        bool tableChanged = false;
+
+        if (ready == MONITOR_WAIT_SHUTDOWN || ready < 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            if (readyFds[i] == fd)
+            {
+                monitorCounters.wakeups++;
+                DrainMonitor();
+            }
+            else if (readyFds[i] == mountWatch.fd)
+            {
+                tableChanged = true;
+            }
+        }
+
+        MountWatchCheck(&mountWatch, tableChanged, OnMountResolved);
+        WatchMountTable();
     }
-    
-    udev_unref(udev);
 
     return NULL;
 }
@@ -30,23 +30,9 @@ CFRunLoopSourceRef runLoopSource;
 
 static pthread_t lookupThread;
 
-pthread_mutex_t notify_mutex;
-pthread_cond_t notifyNewDevice;
-pthread_cond_t notifyDeviceHandled;
-
-bool newDeviceAvailable = false;
-bool deviceHandled = true;
-
-ListResultItem_t* notify_item;
-bool isAdded = false;
 bool isRunning = false;
 bool intialDeviceImport = true;
 
-void WaitForDeviceHandled();
-void SignalDeviceHandled();
-void WaitForNewDevice();
-void SignalDeviceAvailable();
-
 //================================================================================================
 //
 //  DeviceRemoved
@@ -62,6 +48,7 @@ void DeviceRemoved(void *refCon, io_service_t service, natural_t messageType, vo
 	DeviceItem_t* deviceItem = deviceListItem->deviceItem;
 
 	if(messageType == kIOMessageServiceIsTerminated) {
+		MarkEventReceived();
 		if(deviceListItem->deviceInterface) {
 			kr = (*deviceListItem->deviceInterface)->Release(deviceListItem->deviceInterface);
 		}
@@ -69,21 +56,21 @@ void DeviceRemoved(void *refCon, io_service_t service, natural_t messageType, vo
 		kr = IOObjectRelease(deviceListItem->notification);
 
 
-		ListResultItem_t* item = NULL;
+		DeviceRecord_t record;
+		MarkEventEnriched();
 		if(deviceItem) {
-			item = CopyElement(&deviceItem->deviceParams);
+			// Outlives the item, the snapshots and the event still hold it
+			record = deviceItem->record;
 			RemoveItemFromList(deviceItem);
 			delete deviceItem;
 		}
 		else {
-			item = new ListResultItem_t();
+			record = std::make_shared<ListResultItem_t>();
 		}
 
-		WaitForDeviceHandled();
-		notify_item = item;
-		isAdded = false;
-		SignalDeviceAvailable();
-
+		if(isRunning) {
+			QueueDeviceEvent(DeviceEvent_Removed, record);
+		}
 	}
 }
 
@@ -118,6 +105,7 @@ void DeviceAdded(void *refCon, io_iterator_t iterator) {
 
 		DeviceItem_t* deviceItem = new DeviceItem_t();
 
+		MarkEventReceived();
 		// Get the USB device's name.
 		kr = IORegistryEntryGetName(usbDevice, deviceName);
 		if(KERN_SUCCESS != kr) {
@@ -278,14 +266,13 @@ void DeviceAdded(void *refCon, io_iterator_t iterator) {
 			CFRelease(deviceNameAsCFString);
 		}
 
+		MarkEventEnriched();
 		AddItemToList(cPathName, deviceItem);
 		deviceListItem->deviceItem = deviceItem;
 
-		if(intialDeviceImport == false) {
-			WaitForDeviceHandled();
-			notify_item = &deviceItem->deviceParams;
-			isAdded = true;
-			SignalDeviceAvailable();
+		if(intialDeviceImport == false && isRunning) {
+			// JS gets the record the list just published
+			QueueDeviceEvent(DeviceEvent_Added, deviceItem->record);
 		}
 
 		// Register for an interest notification of this device being removed. Use a reference to our
@@ -309,39 +296,6 @@ void DeviceAdded(void *refCon, io_iterator_t iterator) {
 }
 
 
-void WaitForDeviceHandled() {
-	pthread_mutex_lock(&notify_mutex);
-	if(deviceHandled == false) {
-		pthread_cond_wait(&notifyDeviceHandled, &notify_mutex);
-	}
-	deviceHandled = false;
-	pthread_mutex_unlock(&notify_mutex);
-}
-
-void SignalDeviceHandled() {
-	pthread_mutex_lock(&notify_mutex);
-	deviceHandled = true;
-	pthread_cond_signal(&notifyDeviceHandled);
-	pthread_mutex_unlock(&notify_mutex);
-}
-
-void WaitForNewDevice() {
-	pthread_mutex_lock(&notify_mutex);
-	if(newDeviceAvailable == false) {
-		pthread_cond_wait(&notifyNewDevice, &notify_mutex);
-	}
-	newDeviceAvailable = false;
-	pthread_mutex_unlock(&notify_mutex);
-}
-
-void SignalDeviceAvailable() {
-	pthread_mutex_lock(&notify_mutex);
-	newDeviceAvailable = true;
-	pthread_cond_signal(&notifyNewDevice);
-	pthread_mutex_unlock(&notify_mutex);
-}
-
-
 void *RunLoop(void * arg) {
 
 	runLoopSource = IONotificationPortGetRunLoopSource(gNotifyPort);
@@ -358,40 +312,16 @@ void *RunLoop(void * arg) {
 	return NULL;
 }
 
-void NotifyAsync(uv_work_t* req) {
-	WaitForNewDevice();
-}
-
-void NotifyFinished(uv_work_t* req) {
-	if(isRunning) {
-		if(isAdded) {
-			NotifyAdded(notify_item);
-		}
-		else {
-			NotifyRemoved(notify_item);
-		}
-	}
-
-	// Delete Item in case of removal
-	if(isAdded == false) {
-		delete notify_item;
-	}
-
-	if(isRunning) {
-		uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-	}
-	SignalDeviceHandled();
-}
-
 void Start() {
 	isRunning = true;
 }
 
 void Stop() {
 	isRunning = false;
-	pthread_mutex_lock(&notify_mutex);
-	pthread_cond_signal(&notifyNewDevice);
-	pthread_mutex_unlock(&notify_mutex);
+}
+
+// The matching dictionary stays the same, ids are matched when the events are queued
+void UpdateMonitorFilter() {
 }
 
 void InitDetection() {
@@ -434,24 +364,20 @@ void InitDetection() {
 	}
 
 	// Iterate once to get already-present devices and arm the notification
+	BeginListUpdate();
 	DeviceAdded(NULL, gAddedIter);
+	EndListUpdate();
 	intialDeviceImport = false;
 
 
-	pthread_mutex_init(&notify_mutex, NULL);
-	pthread_cond_init(&notifyNewDevice, NULL);
-	pthread_cond_init(&notifyDeviceHandled, NULL);
-
 	int rc = pthread_create(&lookupThread, NULL, RunLoop, NULL);
 	if (rc) {
 		 printf("ERROR; return code from pthread_create() is %d\n", rc);
 		 exit(-1);
 	}
 
-	uv_work_t* req = new uv_work_t();
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-
 	Start();
+	NotifyReady();
 }
 
 void EIO_Find(uv_work_t* req) {
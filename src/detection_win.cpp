@@ -14,6 +14,7 @@
 
 #include "detection.h"
 #include "deviceList.h"
+#include "monitorHost.h"
 
 using namespace std;
 
@@ -60,7 +61,7 @@ HANDLE threadHandle;
 HANDLE deviceChangedRegisteredEvent;
 HANDLE deviceChangedSentEvent;
 
-ListResultItem_t* currentDevice;
+DeviceRecord_t currentDevice;
 bool isAdded;
 bool isRunning = false;
 
@@ -106,23 +107,14 @@ void NotifyAsync(uv_work_t* req) {
 
 void NotifyFinished(uv_work_t* req) {
 	if (isRunning) {
-		if(isAdded) {
-			NotifyAdded(currentDevice);
-		}
-		else {
-			NotifyRemoved(currentDevice);
-		}
-	}
-
-	// Delete Item in case of removal
-	if(isAdded == false) {
-		delete currentDevice;
+		// Through the event queue like on the other platforms, which numbers
+		// the events for the subscriptions and handles batch mode
+		QueueDeviceEvent(isAdded ? DeviceEvent_Added : DeviceEvent_Removed, currentDevice);
 	}
 
+	currentDevice.reset();
 	SetEvent(deviceChangedSentEvent);
-
-	currentDevice = NULL;
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
+	uv_queue_work(MonitorHostLoop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
 }
 
 void LoadFunctions() {
@@ -169,6 +161,10 @@ void Stop() {
 	SetEvent(deviceChangedRegisteredEvent);
 }
 
+// Device notifications can't be narrowed down, ids are matched before notifying JS
+void UpdateMonitorFilter() {
+}
+
 void InitDetection() {
 
 	LoadFunctions();
@@ -176,7 +172,9 @@ void InitDetection() {
 	deviceChangedRegisteredEvent = CreateEvent(NULL, false /* auto-reset event */, false /* non-signalled state */, "");
 	deviceChangedSentEvent = CreateEvent(NULL, false /* auto-reset event */, true /* non-signalled state */, "");
 
+	BeginListUpdate();
 	BuildInitialDeviceList();
+	EndListUpdate();
 
 	threadHandle = CreateThread(
 			NULL,				// default security attributes
@@ -188,9 +186,10 @@ void InitDetection() {
 		);
 
 	uv_work_t* req = new uv_work_t();
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
+	uv_queue_work(MonitorHostLoop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
 
 	Start();
+	NotifyReady();
 }
 
 
@@ -344,6 +343,8 @@ void BuildInitialDeviceList() {
 
 		AddItemToList(buf, item);
 		ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, &item->deviceParams);
+		// The list published the item before its info was known
+		RefreshItemInList(item);
 	}
 
 	if(pspDevInfoData) {
@@ -430,28 +431,31 @@ void UpdateDevice(PDEV_BROADCAST_DEVICEINTERFACE pDevInf, WPARAM wParam, DeviceS
 
 				AddItemToList(buf, device);
 				ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, &device->deviceParams);
+				RefreshItemInList(device);
 
-				currentDevice = &device->deviceParams;
+				currentDevice = device->record;
 				isAdded = true;
 			}
 			else {
 
-				ListResultItem_t* item = NULL;
+				DeviceRecord_t record;
 				if(IsItemAlreadyStored(buf)) {
 					DeviceItem_t* deviceItem = GetItemFromList(buf);
 					if(deviceItem)
 					{
-						item = CopyElement(&deviceItem->deviceParams);
+						// Outlives the item, the snapshots still hold it
+						record = deviceItem->record;
 					}
 					RemoveItemFromList(deviceItem);
 					delete deviceItem;
 				}
 
-				if(item == NULL) {
-					item = new ListResultItem_t();
-					ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, item);
+				if(!record) {
+					std::shared_ptr<ListResultItem_t> item = std::make_shared<ListResultItem_t>();
+					ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, item.get());
+					record = item;
 				}
-				currentDevice = item;
+				currentDevice = record;
 				isAdded = false;
 			}
 
@@ -1,25 +1,396 @@
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "deviceList.h"
 
 
 using namespace std;
 
-map<string, DeviceItem_t*> deviceMap;
+#define SNAPSHOT_READER_SLOTS 128
+// More changes than this since the last snapshot and the next one is built from scratch
+#define SNAPSHOT_MAX_PATCHED_CHANGES 32
+// Changes kept for CreateChangeList(), older ones need a resync
+#define CHANGE_LOG_CAPACITY 1024
+
+// The changes one snapshot was published with, shared by the following ones
+typedef struct {
+	uint64_t version;
+	vector<ListChange_t> changes;
+} ChangeBatch_t;
+
+/* Published to the readers, never changed after that. The records are
+   shared with the following snapshots as long as the device stays. Sorted
+   vectors instead of hash indexes: a snapshot is built in one go, without
+   an allocation per device. */
+typedef struct {
+	uint64_t version;
+	// Value of the epoch when it got replaced, see Reclaim()
+	uint64_t retiredEpoch;
+	// By vendor id and product id, a vendor and a vendor/product are each one range
+	vector<DeviceRecord_t> records;
+	// Devices with a serial number, by serial number
+	vector<DeviceRecord_t> serials;
+	// The last CHANGE_LOG_CAPACITY changes at most, oldest first. They go
+	// back to `changeLogStart`, the version before the first of them.
+	vector<shared_ptr<const ChangeBatch_t> > changeLog;
+	uint64_t changeLogStart;
+} DeviceSnapshot_t;
+
+typedef vector<DeviceRecord_t>::const_iterator RecordIterator_t;
+
+
+/* Epoch based reclamation. A reader puts the current epoch into a free slot
+   before it loads the snapshot and clears the slot when it is done. The
+   writer bumps the epoch whenever it replaces a snapshot and frees the old
+   ones that are older than every occupied slot. It never waits: what can't
+   be freed yet is looked at again on the next publish. */
+static atomic<DeviceSnapshot_t*> currentSnapshot(NULL);
+static atomic<uint64_t> globalEpoch(1);
+static atomic<uint64_t> readerSlots[SNAPSHOT_READER_SLOTS];
+
+// Only touched by the writer
+unordered_map<string, DeviceItem_t*> deviceMap;
+unordered_map<string, DeviceItem_t*> syspathIndex;
+static vector<DeviceSnapshot_t*> retiredSnapshots;
+// Since the last snapshot, in order
+static vector<ListChange_t> pendingChanges;
+static uint64_t snapshotVersion = 0;
+static int updateDepth = 0;
+static bool isDirty = false;
+
+// Entries never move or go away, InternedString_t points right at them
+static mutex internedStringsLock;
+
+static unordered_set<string>& InternedStrings() {
+	// Also used by static constructors in other files, so created on first use
+	static unordered_set<string>* strings = new unordered_set<string>();
+	return *strings;
+}
+
+// The empty string is NULL, it is the value of most of the fields anyway
+static const string* Intern(const char* value) {
+	if (value == NULL || value[0] == '\0') {
+		return NULL;
+	}
+
+	lock_guard<mutex> lock(internedStringsLock);
+	return &*InternedStrings().insert(string(value)).first;
+}
+
+static const string* Intern(const string& value) {
+	if (value.empty()) {
+		return NULL;
+	}
+
+	lock_guard<mutex> lock(internedStringsLock);
+	return &*InternedStrings().insert(value).first;
+}
+
+static uint64_t VendorProductKey(int vid, int pid) {
+	return ((uint64_t) (uint32_t) vid << 32) | (uint32_t) pid;
+}
+
+static bool CompareRecords(const DeviceRecord_t& a, const DeviceRecord_t& b) {
+	return VendorProductKey(a->vendorId, a->productId) < VendorProductKey(b->vendorId, b->productId);
+}
+
+static bool CompareSerials(const DeviceRecord_t& a, const DeviceRecord_t& b) {
+	return a->serialNumber < b->serialNumber;
+}
+
+// Compare records with a key from VendorProductKey(), for lower_bound/upper_bound
+static bool RecordBefore(const DeviceRecord_t& record, uint64_t key) {
+	return VendorProductKey(record->vendorId, record->productId) < key;
+}
+
+static bool RecordAfter(uint64_t key, const DeviceRecord_t& record) {
+	return key < VendorProductKey(record->vendorId, record->productId);
+}
+
+static bool SerialBefore(const DeviceRecord_t& record, const char* serialNumber) {
+	return record->serialNumber.compare(serialNumber) < 0;
+}
+
+static int EnterReader() {
+	while (true) {
+		for (int i = 0; i < SNAPSHOT_READER_SLOTS; i++) {
+			uint64_t idle = 0;
+
+			// A stale epoch only keeps snapshots around a little longer
+			if (readerSlots[i].load() == 0 && readerSlots[i].compare_exchange_strong(idle, globalEpoch.load())) {
+				return i;
+			}
+		}
+
+		// More concurrent readers than slots, they only ever wait on each other
+		this_thread::yield();
+	}
+}
+
+static void LeaveReader(int slot) {
+	readerSlots[slot].store(0);
+}
+
+static void Reclaim() {
+	uint64_t oldest = UINT64_MAX;
+
+	for (int i = 0; i < SNAPSHOT_READER_SLOTS; i++) {
+		uint64_t epoch = readerSlots[i].load();
+
+		if (epoch != 0 && epoch < oldest) {
+			oldest = epoch;
+		}
+	}
+
+	// Readers that entered after a snapshot was retired can't have loaded it
+	size_t kept = 0;
+	for (size_t i = 0; i < retiredSnapshots.size(); i++) {
+		if (retiredSnapshots[i]->retiredEpoch < oldest) {
+			delete retiredSnapshots[i];
+		}
+		else {
+			retiredSnapshots[kept++] = retiredSnapshots[i];
+		}
+	}
+	retiredSnapshots.resize(kept);
+}
+
+static void BuildSnapshot(DeviceSnapshot_t* snapshot) {
+	snapshot->records.reserve(deviceMap.size());
+
+	for (unordered_map<string, DeviceItem_t*>::iterator it = deviceMap.begin(); it != deviceMap.end(); ++it) {
+		snapshot->records.push_back(it->second->record);
+
+		if (!it->second->record->serialNumber.empty()) {
+			snapshot->serials.push_back(it->second->record);
+		}
+	}
+
+	sort(snapshot->records.begin(), snapshot->records.end(), CompareRecords);
+	sort(snapshot->serials.begin(), snapshot->serials.end(), CompareSerials);
+}
+
+/* A hotplug event changes one or two records. Copying the sorted vectors
+   and patching them costs a lot less than sorting everything again. */
+static void PatchSnapshot(const DeviceSnapshot_t* previous, DeviceSnapshot_t* snapshot) {
+	vector<DeviceRecord_t>& records = snapshot->records;
+	vector<DeviceRecord_t>& serials = snapshot->serials;
+
+	records = previous->records;
+	serials = previous->serials;
+
+	for (size_t i = 0; i < pendingChanges.size(); i++) {
+		const DeviceRecord_t& record = pendingChanges[i].record;
+		uint64_t key = VendorProductKey(record->vendorId, record->productId);
+		bool hasSerial = !record->serialNumber.empty();
+
+		if (pendingChanges[i].isAdded) {
+			records.insert(upper_bound(records.begin(), records.end(), key, RecordAfter), record);
+			if (hasSerial) {
+				serials.insert(upper_bound(serials.begin(), serials.end(), record, CompareSerials), record);
+			}
+			continue;
+		}
+
+		vector<DeviceRecord_t>::iterator it = lower_bound(records.begin(), records.end(), key, RecordBefore);
+		while (it != records.end() && *it != record) {
+			++it;
+		}
+		if (it != records.end()) {
+			records.erase(it);
+		}
+
+		if (hasSerial) {
+			vector<DeviceRecord_t>::iterator serial = lower_bound(serials.begin(), serials.end(), record, CompareSerials);
+			while (serial != serials.end() && *serial != record) {
+				++serial;
+			}
+			if (serial != serials.end()) {
+				serials.erase(serial);
+			}
+		}
+	}
+}
+
+// Takes over pendingChanges
+static void AppendChangeLog(const DeviceSnapshot_t* previous, DeviceSnapshot_t* snapshot) {
+	size_t logged = pendingChanges.size();
+	size_t first = 0;
+
+	if (previous) {
+		snapshot->changeLog = previous->changeLog;
+		snapshot->changeLogStart = previous->changeLogStart;
+		for (size_t i = 0; i < snapshot->changeLog.size(); i++) {
+			logged += snapshot->changeLog[i]->changes.size();
+		}
+	}
+	else {
+		snapshot->changeLogStart = 0;
+	}
+
+	// Whole batches go, a reader gets all changes of a version or none
+	while (first < snapshot->changeLog.size() && logged > CHANGE_LOG_CAPACITY) {
+		logged -= snapshot->changeLog[first]->changes.size();
+		snapshot->changeLogStart = snapshot->changeLog[first]->version;
+		first++;
+	}
+	snapshot->changeLog.erase(snapshot->changeLog.begin(), snapshot->changeLog.begin() + first);
+
+	if (logged > CHANGE_LOG_CAPACITY) {
+		// Like the initial enumeration, more than the whole log
+		snapshot->changeLogStart = snapshot->version;
+		pendingChanges.clear();
+		return;
+	}
+
+	shared_ptr<ChangeBatch_t> batch = make_shared<ChangeBatch_t>();
+	batch->version = snapshot->version;
+	batch->changes.swap(pendingChanges);
+	snapshot->changeLog.push_back(batch);
+}
+
+static void Publish() {
+	DeviceSnapshot_t* snapshot = new DeviceSnapshot_t();
+	const DeviceSnapshot_t* latest = currentSnapshot.load();
+
+	snapshot->version = ++snapshotVersion;
+	snapshot->retiredEpoch = 0;
+
+	if (latest && pendingChanges.size() <= SNAPSHOT_MAX_PATCHED_CHANGES) {
+		PatchSnapshot(latest, snapshot);
+	}
+	else {
+		BuildSnapshot(snapshot);
+	}
+	AppendChangeLog(latest, snapshot);
+
+	DeviceSnapshot_t* previous = currentSnapshot.exchange(snapshot);
+	if (previous) {
+		previous->retiredEpoch = globalEpoch.fetch_add(1);
+		retiredSnapshots.push_back(previous);
+	}
+
+	Reclaim();
+}
+
+static void Changed(bool isAdded, const DeviceRecord_t& record) {
+	ListChange_t change;
+
+	change.isAdded = isAdded;
+	change.record = record;
+	pendingChanges.push_back(change);
+
+	if (updateDepth > 0) {
+		isDirty = true;
+		return;
+	}
+
+	Publish();
+}
+
+static void ShareRecords(const DeviceSnapshot_t* snapshot, uint64_t first, uint64_t last, vector<DeviceRecord_t>* filteredList) {
+	RecordIterator_t begin = lower_bound(snapshot->records.begin(), snapshot->records.end(), first, RecordBefore);
+	RecordIterator_t end = upper_bound(begin, snapshot->records.end(), last, RecordAfter);
+
+	filteredList->insert(filteredList->end(), begin, end);
+}
+
+InternedString_t::InternedString_t(const char* value) {
+	this->value = Intern(value);
+}
+
+InternedString_t::InternedString_t(const string& value) {
+	this->value = Intern(value);
+}
+
+InternedString_t& InternedString_t::operator=(const char* value) {
+	this->value = Intern(value);
+	return *this;
+}
+
+InternedString_t& InternedString_t::operator=(const string& value) {
+	this->value = Intern(value);
+	return *this;
+}
+
+const string& InternedString_t::str() const {
+	static const string empty;
+	return this->value ? *this->value : empty;
+}
 
 void AddItemToList(char* key, DeviceItem_t * item) {
 	item->SetKey(key);
-	deviceMap.insert(pair<string, DeviceItem_t*>(item->GetKey(), item));
+
+	// Same as before the snapshots: a key that is already stored keeps its item
+	if (!deviceMap.insert(pair<string, DeviceItem_t*>(item->GetKey(), item)).second) {
+		return;
+	}
+
+	if (!item->syspath.empty()) {
+		syspathIndex[item->syspath] = item;
+	}
+
+	item->record = CreateDeviceRecord(&item->deviceParams);
+	Changed(true, item->record);
 }
 
 void RemoveItemFromList(DeviceItem_t* item) {
-	deviceMap.erase(item->GetKey());
+	unordered_map<string, DeviceItem_t*>::iterator it = deviceMap.find(item->GetKey());
+
+	if (it == deviceMap.end()) {
+		return;
+	}
+
+	// The stored item goes, even if `item` is a duplicate of its key
+	DeviceItem_t* stored = it->second;
+	deviceMap.erase(it);
+
+	unordered_map<string, DeviceItem_t*>::iterator syspath = syspathIndex.find(stored->syspath);
+	if (syspath != syspathIndex.end() && syspath->second == stored) {
+		syspathIndex.erase(syspath);
+	}
+
+	Changed(false, stored->record);
+}
+
+void RefreshItemInList(DeviceItem_t* item) {
+	if (GetItemFromList(item->GetKey()) != item) {
+		return;
+	}
+
+	// Snapshots that hold the old record keep it alive
+	BeginListUpdate();
+	Changed(false, item->record);
+	item->record = CreateDeviceRecord(&item->deviceParams);
+	Changed(true, item->record);
+	EndListUpdate();
+}
+
+void BeginListUpdate() {
+	updateDepth++;
+}
+
+void EndListUpdate() {
+	if (--updateDepth == 0 && isDirty) {
+		isDirty = false;
+		Publish();
+	}
 }
 
 DeviceItem_t* GetItemFromList(char* key) {
-	map<string, DeviceItem_t*>::iterator it;
+	unordered_map<string, DeviceItem_t*>::iterator it;
+
+	if (key == NULL) {
+		return NULL;
+	}
 
 	it = deviceMap.find(key);
 	if(it == deviceMap.end()) {
@@ -30,21 +401,27 @@ DeviceItem_t* GetItemFromList(char* key) {
 	}
 }
 
-bool IsItemAlreadyStored(char* key) {
-	map<string, DeviceItem_t*>::iterator it;
+DeviceItem_t* GetItemBySyspath(const char* syspath) {
+	unordered_map<string, DeviceItem_t*>::iterator it;
 
-	it = deviceMap.find(key);
-	if(it == deviceMap.end()) {
-		return false;
+	it = syspathIndex.find(syspath);
+	if(it == syspathIndex.end()) {
+		return NULL;
 	}
 	else {
-		return true;
+		return it->second;
 	}
+}
 
-	return true;
+bool IsItemAlreadyStored(char* key) {
+	return deviceMap.find(key) != deviceMap.end();
 }
 
-ListResultItem_t* CopyElement(ListResultItem_t* item) {
+size_t GetListSize() {
+	return deviceMap.size();
+}
+
+ListResultItem_t* CopyElement(const ListResultItem_t* item) {
     ListResultItem_t* dst = new ListResultItem_t();
     dst->locationId     =   item->locationId;
     dst->vendorId       =   item->vendorId;
@@ -59,19 +436,86 @@ ListResultItem_t* CopyElement(ListResultItem_t* item) {
     return dst;
 }
 
-void CreateFilteredList(list<ListResultItem_t*> *filteredList, int vid, int pid) {
-	map<string, DeviceItem_t*>::iterator it;
+DeviceRecord_t CreateDeviceRecord(const ListResultItem_t* item) {
+	return make_shared<ListResultItem_t>(*item);
+}
+
+void CreateFilteredList(vector<DeviceRecord_t> *filteredList, int vid, int pid, uint64_t* version) {
+	int slot = EnterReader();
+	const DeviceSnapshot_t* snapshot = currentSnapshot.load();
+
+	if (version) {
+		*version = snapshot ? snapshot->version : 0;
+	}
 
-	for (it = deviceMap.begin(); it != deviceMap.end(); ++it) {
-    	DeviceItem_t* item = it->second;
+	if (snapshot == NULL) {
+		// Nothing was ever published
+	}
+	else if (vid != 0 && pid != 0) {
+		ShareRecords(snapshot, VendorProductKey(vid, pid), VendorProductKey(vid, pid), filteredList);
+	}
+	else if (vid != 0) {
+		ShareRecords(snapshot, VendorProductKey(vid, 0), VendorProductKey(vid, -1), filteredList);
+	}
+	// A product id without a vendor id never matched anything
+	else if (pid == 0) {
+		filteredList->insert(filteredList->end(), snapshot->records.begin(), snapshot->records.end());
+	}
+
+	LeaveReader(slot);
+}
+
+void CreateSerialList(vector<DeviceRecord_t> *filteredList, const char* serialNumber) {
+	int slot = EnterReader();
+	const DeviceSnapshot_t* snapshot = currentSnapshot.load();
+
+	if (snapshot) {
+		RecordIterator_t it = lower_bound(snapshot->serials.begin(), snapshot->serials.end(), serialNumber, SerialBefore);
+		for (; it != snapshot->serials.end() && (*it)->serialNumber == serialNumber; ++it) {
+			filteredList->push_back(*it);
+		}
+	}
+
+	LeaveReader(slot);
+}
+
+bool CreateChangeList(vector<ListChange_t>* changes, uint64_t since, uint64_t* version, vector<DeviceRecord_t>* devices) {
+	int slot = EnterReader();
+	const DeviceSnapshot_t* snapshot = currentSnapshot.load();
+	bool isComplete = true;
+
+	*version = snapshot ? snapshot->version : 0;
+
+	if (snapshot == NULL) {
+		// Nothing was ever published, so nothing changed either
+		isComplete = since == 0;
+	}
+	else if (since < snapshot->changeLogStart || since > snapshot->version) {
+		isComplete = false;
+		devices->insert(devices->end(), snapshot->records.begin(), snapshot->records.end());
+	}
+	else {
+		const vector<shared_ptr<const ChangeBatch_t> >& log = snapshot->changeLog;
+
+		// Versions only go up, so the batches are sorted by them
+		size_t first = log.size();
+		while (first > 0 && log[first - 1]->version > since) {
+			first--;
+		}
+		for (size_t i = first; i < log.size(); i++) {
+			changes->insert(changes->end(), log[i]->changes.begin(), log[i]->changes.end());
+		}
+	}
+
+	LeaveReader(slot);
+	return isComplete;
+}
 
-        if (
-        	((	vid != 0 && pid != 0) && (vid == item->deviceParams.vendorId && pid == item->deviceParams.productId))
-        	|| 	((vid != 0 && pid == 0) && vid == item->deviceParams.vendorId)
-        	||	(vid == 0 && pid == 0)
-    	) {
-        	(*filteredList).push_back(CopyElement(&item->deviceParams));
-        }
+uint64_t GetListVersion() {
+	int slot = EnterReader();
+	const DeviceSnapshot_t* snapshot = currentSnapshot.load();
+	uint64_t version = snapshot ? snapshot->version : 0;
 
-    }
+	LeaveReader(slot);
+	return version;
 }
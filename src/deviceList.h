@@ -1,22 +1,72 @@
 #ifndef _DEVICE_LIST_H
 #define _DEVICE_LIST_H
 
+#include <stdint.h>
+#include <string.h>
 #include <string>
 #include <list>
+#include <vector>
+#include <memory>
+
+/* A string out of a process wide table that is never shrunk. Meant for
+   the values many devices have in common, like the manufacturer: copies
+   share one std::string instead of allocating their own. Assigning to it
+   takes a lock, copying and reading it don't. */
+class InternedString_t {
+	public:
+		InternedString_t() : value(NULL) {}
+		InternedString_t(const char* value);
+		InternedString_t(const std::string& value);
+
+		InternedString_t& operator=(const char* value);
+		InternedString_t& operator=(const std::string& value);
+
+		const std::string& str() const;
+
+		const char* c_str() const {
+			return this->value ? this->value->c_str() : "";
+		}
+
+		bool empty() const {
+			return this->value == NULL;
+		}
+
+		// Equal strings are the same entry of the table
+		bool operator==(const InternedString_t& other) const {
+			return this->value == other.value;
+		}
+
+		bool operator!=(const InternedString_t& other) const {
+			return this->value != other.value;
+		}
+
+	private:
+		const std::string* value;
+};
 
 typedef struct {
 	public:
 		int locationId;
 		int vendorId;
 		int productId;
-		std::string deviceName;
-		std::string manufacturer;
+		InternedString_t deviceName;
+		InternedString_t manufacturer;
 		std::string serialNumber;
 		int deviceAddress;
 		std::string devNode;
 		std::string mountPath;
 } ListResultItem_t;
 
+/* Immutable once created. The snapshots, find() results and device events
+   all hold the same record instead of copies of their own. */
+typedef std::shared_ptr<const ListResultItem_t> DeviceRecord_t;
+
+// One entry of the change log, a refreshed item is a remove and an add
+typedef struct {
+	bool isAdded;
+	DeviceRecord_t record;
+} ListChange_t;
+
 typedef enum  _DeviceState_t {
 	DeviceState_Connect,
 	DeviceState_Disconnect,
@@ -25,6 +75,10 @@ typedef enum  _DeviceState_t {
 typedef struct _DeviceItem_t {
 	ListResultItem_t deviceParams;
 	DeviceState_t deviceState;
+	// Linux: sysfs path of the block device, indexed when set
+	std::string syspath;
+	// What readers see of the item in the published snapshots
+	DeviceRecord_t record;
 
 	private:
 		char* key;
@@ -55,11 +109,37 @@ typedef struct _DeviceItem_t {
 } DeviceItem_t;
 
 
+/* Writers: one thread at a time (the detection thread, or the loop thread
+   before it starts). Every change publishes a new immutable snapshot of
+   the list, unless it is made between BeginListUpdate() and
+   EndListUpdate(), which publish once for the whole burst. */
 void AddItemToList(char* key, DeviceItem_t * item);
 void RemoveItemFromList(DeviceItem_t* item);
+// Publishes the deviceParams of a stored item again, after they changed
+void RefreshItemInList(DeviceItem_t* item);
+void BeginListUpdate();
+void EndListUpdate();
 bool IsItemAlreadyStored(char* identifier);
 DeviceItem_t* GetItemFromList(char* key);
-ListResultItem_t* CopyElement(ListResultItem_t* item);
-void CreateFilteredList(std::list<ListResultItem_t*>* filteredList, int vid, int pid);
+DeviceItem_t* GetItemBySyspath(const char* syspath);
+size_t GetListSize();
+
+ListResultItem_t* CopyElement(const ListResultItem_t* item);
+// One allocation for the record and its reference count
+DeviceRecord_t CreateDeviceRecord(const ListResultItem_t* item);
+
+/* Readers: any thread, never blocked by the writer. They take references
+   to the records of the latest snapshot, which is freed once no reader is
+   left in it. */
+// The matching records, costs O(matches) through the vendor and vendor/product indexes.
+// `version` is set to the one of the snapshot they come from.
+void CreateFilteredList(std::vector<DeviceRecord_t>* filteredList, int vid, int pid, uint64_t* version = NULL);
+void CreateSerialList(std::vector<DeviceRecord_t>* filteredList, const char* serialNumber);
+// Incremented by every published snapshot
+uint64_t GetListVersion();
+/* The changes of the versions after `since` up to the latest one, which
+   `version` is set to. Returns false when the change log does not go back
+   to `since` anymore: `devices` is then the whole latest list instead. */
+bool CreateChangeList(std::vector<ListChange_t>* changes, uint64_t since, uint64_t* version, std::vector<DeviceRecord_t>* devices);
 
 #endif
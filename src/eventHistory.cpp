@@ -0,0 +1,55 @@
+#include "eventHistory.h"
+
+
+void EventHistoryInit(EventHistory_t* history, size_t capacity) {
+	history->slots.clear();
+	history->slots.resize(capacity > 0 ? capacity : 1);
+	history->nextSeq = 1;
+	history->oldestSeq = 1;
+}
+
+void EventHistoryResize(EventHistory_t* history, size_t capacity) {
+	std::vector<HistoryEntry_t> kept;
+	uint64_t oldest = history->oldestSeq;
+
+	if(capacity == 0) {
+		capacity = 1;
+	}
+	if(history->nextSeq - oldest > capacity) {
+		oldest = history->nextSeq - capacity;
+	}
+
+	kept.resize(capacity);
+	for(uint64_t seq = oldest; seq < history->nextSeq; seq++) {
+		kept[seq % capacity] = history->slots[seq % history->slots.size()];
+	}
+	history->slots.swap(kept);
+	history->oldestSeq = oldest;
+}
+
+uint64_t EventHistoryAppend(EventHistory_t* history, DeviceEventType_t type, const DeviceRecord_t& record) {
+	uint64_t seq = history->nextSeq++;
+	HistoryEntry_t* entry = &history->slots[seq % history->slots.size()];
+
+	// Lets go of the record of the event it replaces
+	entry->seq = seq;
+	entry->type = type;
+	entry->record = record;
+
+	if(history->nextSeq - history->oldestSeq > history->slots.size()) {
+		history->oldestSeq = history->nextSeq - history->slots.size();
+	}
+
+	return seq;
+}
+
+uint64_t EventHistoryOldestSeq(const EventHistory_t* history) {
+	return history->oldestSeq;
+}
+
+const HistoryEntry_t* EventHistoryGet(const EventHistory_t* history, uint64_t seq) {
+	if(seq < EventHistoryOldestSeq(history) || seq >= history->nextSeq) {
+		return NULL;
+	}
+	return &history->slots[seq % history->slots.size()];
+}
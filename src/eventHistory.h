@@ -0,0 +1,38 @@
+#ifndef _EVENT_HISTORY_H
+#define _EVENT_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "eventQueue.h"
+
+typedef struct {
+	uint64_t seq;
+	DeviceEventType_t type;
+	DeviceRecord_t record;
+} HistoryEntry_t;
+
+/**********************************
+ * The last `capacity` device events, numbered from 1 in the order they
+ * reached the loop thread. Only used on the loop thread. The entries
+ * share the device records, keeping them costs no copies.
+ **********************************/
+typedef struct {
+	std::vector<HistoryEntry_t> slots;
+	// Sequence number the next event gets
+	uint64_t nextSeq;
+	// Oldest one still kept, growing the history does not bring older back
+	uint64_t oldestSeq;
+} EventHistory_t;
+
+void EventHistoryInit(EventHistory_t* history, size_t capacity);
+// Keeps the newest entries that still fit
+void EventHistoryResize(EventHistory_t* history, size_t capacity);
+uint64_t EventHistoryAppend(EventHistory_t* history, DeviceEventType_t type, const DeviceRecord_t& record);
+// Sequence number of the oldest event still kept, nextSeq when there is none
+uint64_t EventHistoryOldestSeq(const EventHistory_t* history);
+// NULL when `seq` is not kept (anymore)
+const HistoryEntry_t* EventHistoryGet(const EventHistory_t* history, uint64_t seq);
+
+#endif
@@ -0,0 +1,296 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "debounce.h"
+#include "eventQueue.h"
+
+/* How long a blocked producer waits for room before it drops the event.
+   The backend is shared by every environment, so one that stopped taking
+   its events must not hold it up for longer. */
+#define EVENT_QUEUE_BLOCK_TIMEOUT_MS 1000
+
+struct _EventQueueOverflow_t {
+	std::mutex mutex;
+	// With a window of 0, only its merge rules are used
+	Debouncer_t events;
+
+	// EventQueuePolicy_Block: the producer waits here for a pop
+	std::mutex waitMutex;
+	std::condition_variable hasRoom;
+};
+
+
+static bool TryPush(EventQueue_t* queue, DeviceEventType_t type, const DeviceRecord_t& record, const EventTimes_t& times) {
+	size_t tail = queue->tail.load(std::memory_order_relaxed);
+	EventQueueSlot_t* slot = &queue->slots[tail & queue->mask];
+
+	// Full, or the consumer is still taking the event out of it
+	if(slot->sequence.load(std::memory_order_acquire) != tail) {
+		return false;
+	}
+
+	slot->event.type = type;
+	slot->event.record = record;
+	slot->event.times = times;
+	slot->sequence.store(tail + 1, std::memory_order_release);
+	queue->tail.store(tail + 1, std::memory_order_release);
+
+	queue->pushed.fetch_add(1, std::memory_order_relaxed);
+	size_t head = queue->head.load(std::memory_order_relaxed);
+	size_t depth = tail + 1 > head ? tail + 1 - head : 0;
+	if(depth > queue->highWaterMark.load(std::memory_order_relaxed)) {
+		queue->highWaterMark.store(depth, std::memory_order_relaxed);
+	}
+
+	return true;
+}
+
+// `event` NULL drops it
+static bool TryPop(EventQueue_t* queue, DeviceEvent_t* event) {
+	size_t head = queue->head.load(std::memory_order_relaxed);
+
+	while(true) {
+		EventQueueSlot_t* slot = &queue->slots[head & queue->mask];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+		if(sequence == head + 1) {
+			if(!queue->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+				continue;
+			}
+
+			if(event != NULL) {
+				event->type = slot->event.type;
+				event->record = std::move(slot->event.record);
+				event->seq = 0;
+				event->times = slot->event.times;
+			}
+			else {
+				slot->event.record.reset();
+			}
+			slot->sequence.store(head + queue->capacity, std::memory_order_release);
+			return true;
+		}
+
+		// Not filled yet, the ring is empty
+		if(sequence == head) {
+			return false;
+		}
+
+		// Another one claimed it meanwhile
+		head = queue->head.load(std::memory_order_relaxed);
+	}
+}
+
+// False when the consumer emptied the overflow meanwhile, the event goes to the ring then
+static bool PushOverflow(EventQueue_t* queue, DeviceEventType_t type, const DeviceRecord_t& record, const EventTimes_t& times, bool isStarting) {
+	std::lock_guard<std::mutex> lock(queue->overflow->mutex);
+	Debouncer_t* events = &queue->overflow->events;
+
+	if(!isStarting && !queue->hasOverflow.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	DeviceEvent_t event;
+	event.type = type;
+	event.record = record;
+	event.seq = 0;
+	event.times = times;
+
+	uint64_t suppressed = events->suppressed;
+	DebouncerPush(events, event, 0);
+	queue->coalesced.fetch_add(events->suppressed - suppressed, std::memory_order_relaxed);
+
+	if(events->heldCount > queue->capacity) {
+		DebouncerDropNewest(events);
+		queue->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	else {
+		queue->pushed.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	queue->hasOverflow.store(events->heldCount > 0, std::memory_order_release);
+	return true;
+}
+
+static bool PopOverflow(EventQueue_t* queue, DeviceEvent_t* event) {
+	std::lock_guard<std::mutex> lock(queue->overflow->mutex);
+	Debouncer_t* events = &queue->overflow->events;
+
+	bool isPopped = DebouncerPop(events, event, UINT64_MAX);
+	queue->hasOverflow.store(events->heldCount > 0, std::memory_order_release);
+
+	return isPopped;
+}
+
+/* EventQueuePolicy_Block. The flag is set before the ring is looked at
+   again and read by the consumer after it freed a slot, with a full fence
+   on both sides, so either the producer sees the room or the consumer
+   sees it waiting. Once it timed out it does not wait again until the
+   consumer popped something. */
+static bool WaitForRoom(EventQueue_t* queue, DeviceEventType_t type, const DeviceRecord_t& record, const EventTimes_t& times) {
+	if(queue->isStalled.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	queue->blocked.fetch_add(1, std::memory_order_relaxed);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(EVENT_QUEUE_BLOCK_TIMEOUT_MS);
+	std::unique_lock<std::mutex> lock(queue->overflow->waitMutex);
+	bool isPushed = false;
+
+	queue->isProducerWaiting.store(true, std::memory_order_relaxed);
+	while(queue->mayBlock.load(std::memory_order_acquire)) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(TryPush(queue, type, record, times)) {
+			isPushed = true;
+			break;
+		}
+
+		if(queue->overflow->hasRoom.wait_until(lock, deadline) == std::cv_status::timeout) {
+			isPushed = TryPush(queue, type, record, times);
+			if(!isPushed) {
+				queue->isStalled.store(true, std::memory_order_relaxed);
+			}
+			break;
+		}
+	}
+	queue->isProducerWaiting.store(false, std::memory_order_relaxed);
+
+	return isPushed;
+}
+
+// Wakes a producer waiting with EventQueuePolicy_Block after a pop
+static void NotifyRoom(EventQueue_t* queue) {
+	if(queue->isStalled.load(std::memory_order_relaxed)) {
+		queue->isStalled.store(false, std::memory_order_relaxed);
+	}
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(queue->isProducerWaiting.load(std::memory_order_relaxed)) {
+		// Taken so the notification can't fall between its check and its wait
+		std::lock_guard<std::mutex> lock(queue->overflow->waitMutex);
+		queue->overflow->hasRoom.notify_one();
+	}
+}
+
+void EventQueueInit(EventQueue_t* queue, size_t capacity) {
+	size_t size = 1;
+	while(size < capacity) {
+		size <<= 1;
+	}
+
+	queue->slots = new EventQueueSlot_t[size];
+	for(size_t i = 0; i < size; i++) {
+		queue->slots[i].sequence.store(i);
+	}
+	queue->capacity = size;
+	queue->mask = size - 1;
+	queue->head.store(0);
+	queue->tail.store(0);
+	queue->policy.store(EventQueuePolicy_DropNewest);
+	queue->mayBlock.store(true);
+	queue->isProducerWaiting.store(false);
+	queue->isStalled.store(false);
+	queue->overflow = new EventQueueOverflow_t();
+	DebouncerInit(&queue->overflow->events, 0);
+	queue->hasOverflow.store(false);
+	queue->highWaterMark.store(0);
+	queue->pushed.store(0);
+	queue->dropped.store(0);
+	queue->coalesced.store(0);
+	queue->blocked.store(0);
+}
+
+void EventQueueFree(EventQueue_t* queue) {
+	delete[] queue->slots;
+	queue->slots = NULL;
+	queue->capacity = 0;
+	delete queue->overflow;
+	queue->overflow = NULL;
+}
+
+bool EventQueuePush(EventQueue_t* queue, DeviceEventType_t type, const DeviceRecord_t& record, const EventTimes_t& times) {
+	// Behind the events held aside, whatever the policy is by now
+	if(queue->hasOverflow.load(std::memory_order_acquire) && PushOverflow(queue, type, record, times, false)) {
+		return true;
+	}
+
+	if(TryPush(queue, type, record, times)) {
+		return true;
+	}
+
+	switch(queue->policy.load(std::memory_order_relaxed)) {
+		case EventQueuePolicy_DropOldest: {
+			bool isDropped = false;
+
+			/* One is dropped per event. When the consumer is still taking
+			   the oldest out of the slot the tail is at, that slot is
+			   waited for rather than dropping more. */
+			while(!TryPush(queue, type, record, times)) {
+				if(!isDropped && TryPop(queue, NULL)) {
+					queue->dropped.fetch_add(1, std::memory_order_relaxed);
+					isDropped = true;
+				}
+				else {
+					std::this_thread::yield();
+				}
+			}
+			return true;
+		}
+
+		case EventQueuePolicy_Coalesce:
+			return PushOverflow(queue, type, record, times, true);
+
+		case EventQueuePolicy_Block:
+			if(WaitForRoom(queue, type, record, times)) {
+				return true;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	queue->dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+bool EventQueuePop(EventQueue_t* queue, DeviceEvent_t* event) {
+	if(TryPop(queue, event)) {
+		NotifyRoom(queue);
+		return true;
+	}
+
+	if(!queue->hasOverflow.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	/* Only once the ring is empty, the events held aside are newer. It
+	   can have filled up since it was looked at, and nothing is pushed to
+	   it while events are held aside. */
+	return TryPop(queue, event) || PopOverflow(queue, event);
+}
+
+void EventQueueSetMayBlock(EventQueue_t* queue, bool mayBlock) {
+	queue->mayBlock.store(mayBlock, std::memory_order_release);
+	if(!mayBlock) {
+		std::lock_guard<std::mutex> lock(queue->overflow->waitMutex);
+		queue->overflow->hasRoom.notify_all();
+	}
+}
+
+size_t EventQueueDepth(EventQueue_t* queue) {
+	size_t head = queue->head.load(std::memory_order_acquire);
+	size_t tail = queue->tail.load(std::memory_order_acquire);
+	// The consumer can claim a slot before the producer moved the tail past it
+	size_t depth = tail > head ? tail - head : 0;
+
+	if(queue->hasOverflow.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(queue->overflow->mutex);
+		depth += queue->overflow->events.heldCount;
+	}
+
+	return depth;
+}
@@ -0,0 +1,120 @@
+#ifndef _EVENT_QUEUE_H
+#define _EVENT_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "deviceList.h"
+
+typedef enum _DeviceEventType_t {
+	DeviceEvent_Added,
+	DeviceEvent_Removed,
+	// The mount of an already reported device showed up
+	DeviceEvent_Mounted,
+} DeviceEventType_t;
+
+/* uv_hrtime() at each stage of the event, see the latency stats in
+   detection.cpp. A stage the backend does not mark has the time of the
+   next one. */
+typedef struct {
+	// Read from the monitor or notified by the OS
+	uint64_t receivedNs;
+	// The device was read: sysfs/libudev lookups and the mount path
+	uint64_t enrichedNs;
+	// In the device list and pushed to the queue
+	uint64_t queuedNs;
+	// Taken off the queue on the loop thread
+	uint64_t poppedNs;
+} EventTimes_t;
+
+typedef struct {
+	DeviceEventType_t type;
+	// Shared with the device list, a slot lets go of it when it is popped
+	DeviceRecord_t record;
+	// Set on the loop thread, see eventHistory.h
+	uint64_t seq;
+	EventTimes_t times;
+} DeviceEvent_t;
+
+/* What a full queue does with the next event */
+typedef enum {
+	// Refuses it, the default
+	EventQueuePolicy_DropNewest,
+	// Lets go of the oldest queued event to make room for it
+	EventQueuePolicy_DropOldest,
+	// Holds it aside, where the events of the same device are merged with
+	// the rules of debounce.h, until the consumer caught up
+	EventQueuePolicy_Coalesce,
+	// The producer waits for the consumer to make room, for a second at
+	// most, see `mayBlock`
+	EventQueuePolicy_Block,
+} EventQueuePolicy_t;
+
+typedef struct {
+	DeviceEvent_t event;
+	// The position it is free for, or that position + 1 once it is filled
+	std::atomic<size_t> sequence;
+} EventQueueSlot_t;
+
+// The events held aside by EventQueuePolicy_Coalesce, see eventQueue.cpp
+typedef struct _EventQueueOverflow_t EventQueueOverflow_t;
+
+/**********************************
+ * Bounded lock-free ring with a single producer.
+ *
+ * The backend thread (or the host loop) is the only producer, the JS
+ * thread the consumer. Every slot carries a sequence number like in
+ * Vyukov's bounded queue, so the producer can also take the oldest event
+ * off the ring when it drops it for a new one. Pushing only blocks with
+ * EventQueuePolicy_Block, the events a full queue cannot take are counted.
+ *
+ * With EventQueuePolicy_Coalesce the events that do not fit go to an
+ * overflow list behind a mutex. Once it has any, every event goes there
+ * until the consumer emptied it, so the order is kept. It is bounded by
+ * the capacity too.
+ **********************************/
+typedef struct {
+	EventQueueSlot_t* slots;
+	size_t capacity;
+	size_t mask;
+
+	// Claimed by the consumer, and by the producer when it drops the oldest
+	std::atomic<size_t> head;
+	// Written by the producer only
+	std::atomic<size_t> tail;
+
+	// EventQueuePolicy_t, set by the consumer
+	std::atomic<int> policy;
+	// Cleared with EventQueueSetMayBlock() to let a waiting
+	// EventQueuePolicy_Block producer go, which then drops the event instead
+	std::atomic<bool> mayBlock;
+	// The producer waits for a pop to wake it up
+	std::atomic<bool> isProducerWaiting;
+	// The producer timed out, and drops the events rather than waiting
+	// again until the consumer popped one
+	std::atomic<bool> isStalled;
+	EventQueueOverflow_t* overflow;
+	std::atomic<bool> hasOverflow;
+
+	std::atomic<size_t> highWaterMark;
+	std::atomic<uint64_t> pushed;
+	std::atomic<uint64_t> dropped;
+	// Merged into an event held aside, or cancelled out with one
+	std::atomic<uint64_t> coalesced;
+	// Times the producer had to wait for room
+	std::atomic<uint64_t> blocked;
+} EventQueue_t;
+
+// `capacity` is rounded up to the next power of two
+void EventQueueInit(EventQueue_t* queue, size_t capacity);
+// Lets go of the slots, nobody may push or pop anymore
+void EventQueueFree(EventQueue_t* queue);
+// False when the event was dropped
+bool EventQueuePush(EventQueue_t* queue, DeviceEventType_t type, const DeviceRecord_t& record, const EventTimes_t& times);
+bool EventQueuePop(EventQueue_t* queue, DeviceEvent_t* event);
+// Lets a waiting EventQueuePolicy_Block producer go at once when cleared
+void EventQueueSetMayBlock(EventQueue_t* queue, bool mayBlock);
+size_t EventQueueDepth(EventQueue_t* queue);
+
+#endif
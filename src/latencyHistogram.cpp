@@ -0,0 +1,70 @@
+#include "latencyHistogram.h"
+
+
+static size_t BucketIndex(uint64_t value) {
+	if(value < LATENCY_SUB_BUCKETS) {
+		return (size_t) value;
+	}
+
+	int exponent = 63;
+	while(!(value >> exponent)) {
+		exponent--;
+	}
+
+	// The top LATENCY_SUB_BUCKET_BITS + 1 bits pick the bucket
+	int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+	return (size_t) (shift + 1) * LATENCY_SUB_BUCKETS + (size_t) (value >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+static uint64_t BucketMiddle(size_t index) {
+	if(index < LATENCY_SUB_BUCKETS) {
+		return index;
+	}
+
+	int shift = (int) (index / LATENCY_SUB_BUCKETS) - 1;
+	uint64_t lowest = (uint64_t) (index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+	return lowest + (((uint64_t) 1 << shift) >> 1);
+}
+
+void LatencyHistogramReset(LatencyHistogram_t* histogram) {
+	for(size_t i = 0; i < LATENCY_BUCKETS; i++) {
+		histogram->counts[i].store(0, std::memory_order_relaxed);
+	}
+	histogram->count.store(0, std::memory_order_relaxed);
+	histogram->sumNs.store(0, std::memory_order_relaxed);
+	histogram->maxNs.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogramRecord(LatencyHistogram_t* histogram, uint64_t valueNs) {
+	histogram->counts[BucketIndex(valueNs)].fetch_add(1, std::memory_order_relaxed);
+	histogram->count.fetch_add(1, std::memory_order_relaxed);
+	histogram->sumNs.fetch_add(valueNs, std::memory_order_relaxed);
+
+	uint64_t maxNs = histogram->maxNs.load(std::memory_order_relaxed);
+	while(valueNs > maxNs && !histogram->maxNs.compare_exchange_weak(maxNs, valueNs, std::memory_order_relaxed)) {
+	}
+}
+
+uint64_t LatencyHistogramPercentile(const LatencyHistogram_t* histogram, double percentile) {
+	uint64_t count = histogram->count.load(std::memory_order_relaxed);
+	if(count == 0) {
+		return 0;
+	}
+
+	// The rank of the value, 1 based: p50 of 2 values is the first
+	uint64_t rank = (uint64_t) (percentile / 100.0 * count + 0.5);
+	if(rank < 1) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for(size_t i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += histogram->counts[i].load(std::memory_order_relaxed);
+		if(seen >= rank) {
+			return BucketMiddle(i);
+		}
+	}
+
+	// Counts recorded after `count` was read
+	return histogram->maxNs.load(std::memory_order_relaxed);
+}
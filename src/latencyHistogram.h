@@ -0,0 +1,33 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**********************************
+ * Log-linear latency histogram, in the spirit of HdrHistogram.
+ *
+ * Every power of two is split into LATENCY_SUB_BUCKETS linear buckets, so
+ * a recorded value is off by at most 1/LATENCY_SUB_BUCKETS (6%) whatever
+ * its magnitude, from nanoseconds to minutes, in a fixed 8 KB. Recording
+ * is one relaxed increment, any thread may record while another reads.
+ **********************************/
+#define LATENCY_SUB_BUCKET_BITS         4
+#define LATENCY_SUB_BUCKETS             (1 << LATENCY_SUB_BUCKET_BITS)
+// Up to the bucket of the largest uint64_t
+#define LATENCY_BUCKETS                 ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct {
+	std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sumNs;
+	std::atomic<uint64_t> maxNs;
+} LatencyHistogram_t;
+
+void LatencyHistogramReset(LatencyHistogram_t* histogram);
+void LatencyHistogramRecord(LatencyHistogram_t* histogram, uint64_t valueNs);
+// Middle of the bucket the percentile falls into, 0 when nothing was recorded
+uint64_t LatencyHistogramPercentile(const LatencyHistogram_t* histogram, double percentile);
+
+#endif
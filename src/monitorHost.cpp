@@ -0,0 +1,129 @@
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+
+#include "detection.h"
+#include "monitorHost.h"
+
+
+static uv_loop_t hostLoop;
+static uv_thread_t hostThread;
+static uv_async_t hostWake;
+static uv_sem_t hostInitialized;
+static bool isHostStarted = false;
+// Set once the wake handle can be used
+static std::atomic<bool> isHostReady(false);
+
+// Guards the requests of the environments below, the host applies them
+static std::mutex hostMutex;
+static int monitoringCount = 0;
+static bool isSubsystemsChanged = false;
+static std::vector<std::string> pendingSubsystems;
+
+// Only touched on the host thread
+static bool isHostMonitoring = false;
+
+// Brings the backend in line with what the environments asked for
+static void OnHostWake(uv_async_t* handle) {
+	bool isMonitoringWanted;
+	bool isFilterChanged;
+
+	{
+		std::lock_guard<std::mutex> lock(hostMutex);
+
+		isMonitoringWanted = monitoringCount > 0;
+		isFilterChanged = isSubsystemsChanged;
+		if(isSubsystemsChanged) {
+			monitorSubsystems.swap(pendingSubsystems);
+			isSubsystemsChanged = false;
+		}
+	}
+
+	if(isFilterChanged) {
+		UpdateMonitorFilter();
+	}
+
+	if(isMonitoringWanted != isHostMonitoring) {
+		isHostMonitoring = isMonitoringWanted;
+		if(isMonitoringWanted) {
+			Start();
+		}
+		else {
+			Stop();
+		}
+	}
+}
+
+static void HostThreadFunc(void* arg) {
+	uv_loop_init(&hostLoop);
+	uv_async_init(&hostLoop, &hostWake, (uv_async_cb) OnHostWake);
+
+	// The backends start monitoring right away, like the module always did
+	InitDetection();
+	isHostMonitoring = true;
+	uv_sem_post(&hostInitialized);
+
+	// Nobody may want events anymore by now, or somebody else too
+	OnHostWake(&hostWake);
+
+	// The wake handle is never closed, the host runs until the process exits
+	uv_run(&hostLoop, UV_RUN_DEFAULT);
+}
+
+void MonitorHostAcquire() {
+	/* Held until the host is initialized, so other environments loading
+	   meanwhile wait for it too. The host thread takes the lock only after
+	   it posted the semaphore. */
+	std::lock_guard<std::mutex> lock(hostMutex);
+
+	if(isHostStarted) {
+		return;
+	}
+	isHostStarted = true;
+
+	uv_sem_init(&hostInitialized, 0);
+	if(uv_thread_create(&hostThread, HostThreadFunc, NULL) != 0) {
+		printf("Can't start the device monitor thread\n");
+		// Nobody would tell the environments, find() answers with an empty list
+		NotifyReady();
+		return;
+	}
+
+	uv_sem_wait(&hostInitialized);
+	isHostReady = true;
+}
+
+uv_loop_t* MonitorHostLoop() {
+	return &hostLoop;
+}
+
+static void WakeHost() {
+	// Not ready yet, HostThreadFunc() looks at the requests after init
+	if(isHostReady.load()) {
+		uv_async_send(&hostWake);
+	}
+}
+
+void MonitorHostSetMonitoring(bool isMonitoring) {
+	{
+		std::lock_guard<std::mutex> lock(hostMutex);
+		monitoringCount += isMonitoring ? 1 : -1;
+	}
+
+	WakeHost();
+}
+
+void MonitorHostSetSubsystems(const std::vector<std::string>& subsystems) {
+	{
+		std::lock_guard<std::mutex> lock(hostMutex);
+		pendingSubsystems = subsystems;
+		isSubsystemsChanged = true;
+	}
+
+	WakeHost();
+}
+
+int MonitorHostMonitoringCount() {
+	std::lock_guard<std::mutex> lock(hostMutex);
+	return monitoringCount;
+}
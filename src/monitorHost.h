@@ -0,0 +1,29 @@
+#ifndef _MONITOR_HOST_H
+#define _MONITOR_HOST_H
+
+#include <string>
+#include <uv.h>
+#include <vector>
+
+/**********************************
+ * The platform backend is shared by every Node environment of the
+ * process, the main thread and the worker_threads alike: one monitor, one
+ * enumeration and one device list. It runs on a thread and loop of its
+ * own, the host, so it does not depend on any of the environments staying
+ * around. InitDetection(), Start(), Stop() and UpdateMonitorFilter() are
+ * only called on the host thread.
+ **********************************/
+
+// Starts the host on the first call, returns once InitDetection() ran
+void MonitorHostAcquire();
+// The loop of the host thread, for the uv handles and work items of the backend
+uv_loop_t* MonitorHostLoop();
+// One more or one less environment that wants device events, the monitor
+// runs while there is any
+void MonitorHostSetMonitoring(bool isMonitoring);
+// Hands the subsystems the environments asked for to the backend, see monitorSubsystems
+void MonitorHostSetSubsystems(const std::vector<std::string>& subsystems);
+// Environments that want device events right now
+int MonitorHostMonitoringCount();
+
+#endif
@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "monitorWait_linux.h"
+
+
+bool MonitorWaitInit(MonitorWait_t* wait)
+{
+    wait->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wait->wakeFd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (wait->epollFd < 0 || wait->wakeFd < 0)
+    {
+        MonitorWaitClose(wait);
+        return false;
+    }
+
+    return MonitorWaitAddFd(wait, wait->wakeFd, EPOLLIN);
+}
+
+bool MonitorWaitAddFd(MonitorWait_t* wait, int fd, uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events  = events;
+    ev.data.fd = fd;
+
+    return epoll_ctl(wait->epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void MonitorWaitRemoveFd(MonitorWait_t* wait, int fd)
+{
+    epoll_ctl(wait->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int MonitorWaitNext(MonitorWait_t* wait, int timeoutMs, int* readyFds, int maxFds)
+{
+    struct epoll_event events[MONITOR_WAIT_MAX_FDS];
+    int                ready;
+    int                count = 0;
+
+    if (maxFds > MONITOR_WAIT_MAX_FDS)
+    {
+        maxFds = MONITOR_WAIT_MAX_FDS;
+    }
+
+    do
+    {
+        ready = epoll_wait(wait->epollFd, events, maxFds, timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+
+    for (int i = 0; i < ready; i++)
+    {
+        // The wake fd is never read, so once it fired every later wait
+        // reports the shutdown as well
+        if (events[i].data.fd == wait->wakeFd)
+        {
+            return MONITOR_WAIT_SHUTDOWN;
+        }
+
+        readyFds[count++] = events[i].data.fd;
+    }
+
+    return ready < 0 ? -1 : count;
+}
+
+void MonitorWaitWake(MonitorWait_t* wait)
+{
+    uint64_t one = 1;
+
+    if (wait->wakeFd >= 0)
+    {
+        ssize_t written = write(wait->wakeFd, &one, sizeof(one));
+        (void) written;
+    }
+}
+
+void MonitorWaitClose(MonitorWait_t* wait)
+{
+    if (wait->epollFd >= 0)
+    {
+        close(wait->epollFd);
+    }
+
+    if (wait->wakeFd >= 0)
+    {
+        close(wait->wakeFd);
+    }
+
+    wait->epollFd = -1;
+    wait->wakeFd  = -1;
+}
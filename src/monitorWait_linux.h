@@ -0,0 +1,31 @@
+#ifndef _MONITOR_WAIT_LINUX_H
+#define _MONITOR_WAIT_LINUX_H
+
+#include <stdint.h>
+
+/**********************************
+ * Blocking wait on the monitor fds.
+ *
+ * The monitor thread sleeps in epoll_wait() until one of the registered
+ * fds becomes readable, so there are no wakeups while the bus is idle.
+ * An eventfd is registered next to them and is used to interrupt the wait
+ * on shutdown.
+ **********************************/
+#define MONITOR_WAIT_SHUTDOWN           -2
+#define MONITOR_WAIT_MAX_FDS            8
+
+typedef struct {
+    int epollFd;
+    int wakeFd;
+} MonitorWait_t;
+
+bool MonitorWaitInit(MonitorWait_t* wait);
+bool MonitorWaitAddFd(MonitorWait_t* wait, int fd, uint32_t events);
+void MonitorWaitRemoveFd(MonitorWait_t* wait, int fd);
+/* Returns the number of ready fds stored in readyFds, 0 on timeout,
+   MONITOR_WAIT_SHUTDOWN once MonitorWaitWake() was called and -1 on error. */
+int  MonitorWaitNext(MonitorWait_t* wait, int timeoutMs, int* readyFds, int maxFds);
+void MonitorWaitWake(MonitorWait_t* wait);
+void MonitorWaitClose(MonitorWait_t* wait);
+
+#endif
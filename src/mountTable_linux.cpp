@@ -0,0 +1,210 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mountTable_linux.h"
+
+/**********************************
+ * Local defines
+ **********************************/
+#define MOUNTINFO_FIELD_DEVICE          2
+#define MOUNTINFO_FIELD_MOUNT_POINT     4
+#define MOUNTINFO_MAX_FIELDS            32
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+static uint64_t DeviceKey(unsigned int major, unsigned int minor)
+{
+    return ((uint64_t) major << 32) | minor;
+}
+
+/* mountinfo escapes blanks, tabs, newlines and backslashes as \ooo */
+static std::string Unescape(const char* field)
+{
+    std::string result;
+
+    while (*field)
+    {
+        if (field[0] == '\\' &&
+            field[1] >= '0' && field[1] <= '7' &&
+            field[2] >= '0' && field[2] <= '7' &&
+            field[3] >= '0' && field[3] <= '7')
+        {
+            result += (char) (((field[1] - '0') << 6) | ((field[2] - '0') << 3) | (field[3] - '0'));
+            field  += 4;
+        }
+        else
+        {
+            result += *field++;
+        }
+    }
+
+    return result;
+}
+
+/* "36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw"
+   The optional fields after the mount options end with a lone "-",
+   followed by the filesystem type and the mount source. */
+static void ParseLine(MountTable_t* table, char* line)
+{
+    char*        fields[MOUNTINFO_MAX_FIELDS];
+    int          count     = 0;
+    int          separator = -1;
+    char*        save      = NULL;
+    unsigned int major;
+    unsigned int minor;
+
+    for (char* field = strtok_r(line, " \n", &save); field && count < MOUNTINFO_MAX_FIELDS; field = strtok_r(NULL, " \n", &save))
+    {
+        if (separator < 0 && count > MOUNTINFO_FIELD_MOUNT_POINT && strcmp(field, "-") == 0)
+        {
+            separator = count;
+        }
+        fields[count++] = field;
+    }
+
+    if (separator < 0 || separator + 2 >= count)
+    {
+        return;
+    }
+
+    std::string mountPoint = Unescape(fields[MOUNTINFO_FIELD_MOUNT_POINT]);
+
+    // Later entries shadow earlier ones on the same device or source
+    if (sscanf(fields[MOUNTINFO_FIELD_DEVICE], "%u:%u", &major, &minor) == 2 && major != 0)
+    {
+        table->byDevice[DeviceKey(major, minor)] = mountPoint;
+    }
+    table->bySource[Unescape(fields[separator + 2])] = mountPoint;
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+bool MountTableInit(MountTable_t* table, const char* path)
+{
+    table->path     = path;
+    table->fd       = open(path, O_RDONLY | O_CLOEXEC);
+    table->isStale  = true;
+    table->rebuilds = 0;
+    table->byDevice.clear();
+    table->bySource.clear();
+
+    return MountTableRefresh(table);
+}
+
+void MountTableClose(MountTable_t* table)
+{
+    if (table->fd >= 0)
+    {
+        close(table->fd);
+    }
+
+    table->fd      = -1;
+    table->isStale = true;
+    table->byDevice.clear();
+    table->bySource.clear();
+}
+
+void MountTableInvalidate(MountTable_t* table)
+{
+    table->isStale = true;
+}
+
+bool MountTableRefresh(MountTable_t* table)
+{
+    struct pollfd pfd;
+    FILE         *fp;
+    char         *line     = NULL;
+    size_t        capacity = 0;
+
+    if (table->fd >= 0)
+    {
+        // Acknowledges the change before reading, so a mount that shows up
+        // while parsing marks the index stale again
+        pfd.fd      = table->fd;
+        pfd.events  = POLLPRI;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLPRI))
+        {
+            table->isStale = true;
+        }
+    }
+    else
+    {
+        table->isStale = true;
+    }
+
+    if (!table->isStale)
+    {
+        return true;
+    }
+
+    if ((fp = fopen(table->path.c_str(), "re")) == NULL)
+    {
+        printf("Can't open mounted filesystems\n");
+        return false;
+    }
+
+    table->byDevice.clear();
+    table->bySource.clear();
+    while (getline(&line, &capacity, fp) >= 0)
+    {
+        ParseLine(table, line);
+    }
+
+    free(line);
+    fclose(fp);
+
+    table->isStale = false;
+    table->rebuilds++;
+
+    return true;
+}
+
+bool MountTableFindDevice(MountTable_t* table, unsigned int major, unsigned int minor, std::string* mountPath)
+{
+    MountsByDevice_t::iterator it = table->byDevice.find(DeviceKey(major, minor));
+
+    if (it == table->byDevice.end())
+    {
+        return false;
+    }
+
+    *mountPath = it->second;
+    return true;
+}
+
+bool MountTableFindSource(MountTable_t* table, const char* source, bool matchPrefix, std::string* mountPath)
+{
+    MountsBySource_t::iterator it;
+    size_t                     length = strlen(source);
+
+    if (!matchPrefix)
+    {
+        it = table->bySource.find(source);
+    }
+    else
+    {
+        // Sources sharing the prefix are adjacent in the sorted map
+        it = table->bySource.lower_bound(source);
+        if (it != table->bySource.end() && it->first.compare(0, length, source) != 0)
+        {
+            it = table->bySource.end();
+        }
+    }
+
+    if (it == table->bySource.end())
+    {
+        return false;
+    }
+
+    *mountPath = it->second;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _MOUNT_TABLE_LINUX_H
+#define _MOUNT_TABLE_LINUX_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/**********************************
+ * Indexed copy of the mount table.
+ *
+ * /proc/self/mountinfo is parsed once into a hash keyed by the device
+ * number (major:minor) and a sorted map keyed by the mount source. The
+ * index is only rebuilt after the kernel reported a mount table change,
+ * which is checked with a zero timeout poll() for POLLPRI on a private fd,
+ * so lookups between two changes never touch the file.
+ **********************************/
+#define MOUNT_TABLE_PATH                "/proc/self/mountinfo"
+
+typedef std::unordered_map<uint64_t, std::string>       MountsByDevice_t;
+typedef std::map<std::string, std::string>              MountsBySource_t;
+
+typedef struct {
+    std::string      path;
+    // Polled for POLLPRI, -1 when the file does not signal changes
+    int              fd;
+    bool             isStale;
+    uint64_t         rebuilds;
+    MountsByDevice_t byDevice;
+    MountsBySource_t bySource;
+} MountTable_t;
+
+bool MountTableInit(MountTable_t* table, const char* path);
+void MountTableClose(MountTable_t* table);
+// Forces a rebuild on the next refresh
+void MountTableInvalidate(MountTable_t* table);
+/* Rebuilds the index when it is stale. Without a change signal (fd < 0)
+   every call rebuilds. Returns false when the file could not be read. */
+bool MountTableRefresh(MountTable_t* table);
+
+bool MountTableFindDevice(MountTable_t* table, unsigned int major, unsigned int minor, std::string* mountPath);
+/* With matchPrefix every source starting with `source` matches, so the
+   partitions of a whole disk are found as well (/dev/sdb -> /dev/sdb1). */
+bool MountTableFindSource(MountTable_t* table, const char* source, bool matchPrefix, std::string* mountPath);
+
+#endif
@@ -0,0 +1,131 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mountWatch_linux.h"
+
+
+bool MountWatchInit(MountWatch_t* watch)
+{
+    watch->fd = open(MOUNT_TABLE_PATH, O_RDONLY | O_CLOEXEC);
+    watch->pending.clear();
+
+    return MountTableInit(&watch->table, MOUNT_TABLE_PATH) && watch->fd >= 0;
+}
+
+void MountWatchClose(MountWatch_t* watch)
+{
+    if (watch->fd >= 0)
+    {
+        close(watch->fd);
+    }
+
+    watch->fd = -1;
+    watch->pending.clear();
+    MountTableClose(&watch->table);
+}
+
+uint64_t MountWatchNowMs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool LookupMountPath(MountWatch_t* watch, const char* devNode, bool matchPrefix, std::string* mountPath)
+{
+    struct stat st;
+
+    if (!MountTableRefresh(&watch->table))
+    {
+        return false;
+    }
+
+    // The device number also finds mounts made through a symlink such as
+    // /dev/disk/by-uuid/...
+    if (stat(devNode, &st) == 0 && S_ISBLK(st.st_mode) &&
+        MountTableFindDevice(&watch->table, major(st.st_rdev), minor(st.st_rdev), mountPath))
+    {
+        return true;
+    }
+
+    return MountTableFindSource(&watch->table, devNode, matchPrefix, mountPath);
+}
+
+void MountWatchAdd(MountWatch_t* watch, const char* devNode, bool matchPrefix, int timeoutMs)
+{
+    PendingMount_t pending;
+
+    pending.devNode     = devNode;
+    pending.matchPrefix = matchPrefix;
+    pending.deadlineMs  = MountWatchNowMs() + (timeoutMs > 0 ? timeoutMs : 0);
+
+    MountWatchRemove(watch, devNode);
+    watch->pending.push_back(pending);
+}
+
+void MountWatchRemove(MountWatch_t* watch, const char* devNode)
+{
+    std::list<PendingMount_t>::iterator it = watch->pending.begin();
+
+    while (it != watch->pending.end())
+    {
+        if (it->devNode == devNode)
+        {
+            it = watch->pending.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void MountWatchCheck(MountWatch_t* watch, bool tableChanged, MountResolvedFunc_t resolved)
+{
+    uint64_t                            now = MountWatchNowMs();
+    std::list<PendingMount_t>::iterator it  = watch->pending.begin();
+
+    while (it != watch->pending.end())
+    {
+        std::string mountPath;
+
+        if (tableChanged && LookupMountPath(watch, it->devNode.c_str(), it->matchPrefix, &mountPath))
+        {
+            std::string devNode = it->devNode;
+
+            it = watch->pending.erase(it);
+            resolved(devNode, mountPath);
+        }
+        else if (it->deadlineMs <= now)
+        {
+            it = watch->pending.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+int MountWatchNextTimeoutMs(MountWatch_t* watch)
+{
+    uint64_t                            now     = MountWatchNowMs();
+    int                                 timeout = -1;
+    std::list<PendingMount_t>::iterator it;
+
+    for (it = watch->pending.begin(); it != watch->pending.end(); ++it)
+    {
+        int remaining = it->deadlineMs > now ? (int) (it->deadlineMs - now) : 0;
+
+        if (timeout < 0 || remaining < timeout)
+        {
+            timeout = remaining;
+        }
+    }
+
+    return timeout;
+}
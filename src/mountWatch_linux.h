@@ -0,0 +1,50 @@
+#ifndef _MOUNT_WATCH_LINUX_H
+#define _MOUNT_WATCH_LINUX_H
+
+#include <stdint.h>
+#include <list>
+#include <string>
+
+#include "mountTable_linux.h"
+
+/**********************************
+ * Non-blocking mount resolution.
+ *
+ * A freshly added block device is usually mounted a moment after udev
+ * reports it. Instead of sleeping before reading the mount table, devices
+ * without a mount are parked here and checked again every time the kernel
+ * signals a mount table change (POLLPRI on /proc/self/mountinfo), until
+ * their deadline passes.
+ **********************************/
+typedef struct {
+	std::string devNode;
+	// Also accept mounts of partitions of devNode (/dev/sdb -> /dev/sdb1)
+	bool matchPrefix;
+	uint64_t deadlineMs;
+} PendingMount_t;
+
+typedef struct {
+	// Polled for POLLPRI, never read. The table polls its own fd, so
+	// both see every change.
+	int fd;
+	MountTable_t table;
+	std::list<PendingMount_t> pending;
+} MountWatch_t;
+
+typedef void (*MountResolvedFunc_t)(const std::string& devNode, const std::string& mountPath);
+
+bool MountWatchInit(MountWatch_t* watch);
+void MountWatchClose(MountWatch_t* watch);
+
+uint64_t MountWatchNowMs();
+bool LookupMountPath(MountWatch_t* watch, const char* devNode, bool matchPrefix, std::string* mountPath);
+
+void MountWatchAdd(MountWatch_t* watch, const char* devNode, bool matchPrefix, int timeoutMs);
+void MountWatchRemove(MountWatch_t* watch, const char* devNode);
+/* Resolves the pending devices against the mount table when it changed and
+   drops the ones whose deadline passed. */
+void MountWatchCheck(MountWatch_t* watch, bool tableChanged, MountResolvedFunc_t resolved);
+// Milliseconds until the closest deadline, -1 when nothing is pending
+int  MountWatchNextTimeoutMs(MountWatch_t* watch);
+
+#endif
@@ -0,0 +1,133 @@
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "detection.h"
+#include "syntheticEvents.h"
+
+// Events are queued in bursts every tick to keep the pacing cheap
+#define SYNTHETIC_TICK_MS 10
+
+typedef struct {
+	unsigned int count;
+	unsigned int ratePerSecond;
+	MonitorFilter_t filter;
+	EventQueue_t* queue;
+	uv_async_t* async;
+} SyntheticRun_t;
+
+static uv_thread_t syntheticThread;
+static std::atomic<bool> isSyntheticRunning(false);
+static std::atomic<bool> isSyntheticCancelled(false);
+// The queue of the current or last run
+static std::atomic<EventQueue_t*> syntheticQueue(NULL);
+// Only touched by the environments, under the lock
+static std::mutex syntheticMutex;
+static bool hasSyntheticThread = false;
+
+DeviceRecord_t CreateSyntheticRecord(unsigned int index) {
+	char devNode[32];
+	snprintf(devNode, sizeof(devNode), "/dev/synthetic%u", index / 2);
+
+	std::shared_ptr<ListResultItem_t> item = std::make_shared<ListResultItem_t>();
+	item->locationId = 0;
+	item->vendorId = 0x1000 + (index / 2) % 16;
+	item->productId = (index / 2) % 256;
+	item->deviceName = "Synthetic device";
+	item->manufacturer = "usb-detection";
+	item->serialNumber = "";
+	item->deviceAddress = 0;
+	item->devNode = devNode;
+	item->mountPath = "";
+
+	return item;
+}
+
+static void SyntheticThreadFunc(void* arg) {
+	SyntheticRun_t* run = (SyntheticRun_t*) arg;
+	unsigned int perTick = run->ratePerSecond * SYNTHETIC_TICK_MS / 1000;
+	uint64_t start = uv_hrtime();
+
+	if(perTick == 0) {
+		perTick = 1;
+	}
+
+	for(unsigned int i = 0, tick = 1; i < run->count && !isSyntheticCancelled.load(); tick++) {
+		for(unsigned int n = 0; n < perTick && i < run->count; n++, i++) {
+			// Nothing to receive or read, only the queue and the loop are timed
+			uint64_t nowNs = uv_hrtime();
+			EventTimes_t times = { nowNs, nowNs, nowNs, 0 };
+			DeviceRecord_t record = CreateSyntheticRecord(i);
+
+			if(!MonitorFilterMatches(&run->filter, record->vendorId, record->productId)) {
+				monitorCounters.filtered++;
+				continue;
+			}
+
+			if(EventQueuePush(run->queue, i % 2 == 0 ? DeviceEvent_Added : DeviceEvent_Removed, record, times)) {
+				uv_async_send(run->async);
+			}
+		}
+
+		// Sleep until the next tick is due
+		uint64_t due = start + (uint64_t) tick * SYNTHETIC_TICK_MS * 1000000ULL;
+		uint64_t now = uv_hrtime();
+		if(due > now) {
+#ifdef _WIN32
+			Sleep((DWORD) ((due - now) / 1000000ULL));
+#else
+			usleep((useconds_t) ((due - now) / 1000ULL));
+#endif
+		}
+	}
+
+	delete run;
+	isSyntheticRunning.store(false);
+}
+
+bool StartSyntheticEvents(unsigned int count, unsigned int ratePerSecond, const MonitorFilter_t& filter, EventQueue_t* queue, uv_async_t* async) {
+	std::lock_guard<std::mutex> lock(syntheticMutex);
+
+	if(isSyntheticRunning.exchange(true)) {
+		return false;
+	}
+
+	// Reap the previous run, it has already finished
+	if(hasSyntheticThread) {
+		uv_thread_join(&syntheticThread);
+	}
+	hasSyntheticThread = true;
+
+	SyntheticRun_t* run = new SyntheticRun_t();
+	run->count = count;
+	run->ratePerSecond = ratePerSecond > 0 ? ratePerSecond : 1;
+	run->filter = filter;
+	run->queue = queue;
+	run->async = async;
+	isSyntheticCancelled.store(false);
+	syntheticQueue.store(queue);
+
+	if(uv_thread_create(&syntheticThread, SyntheticThreadFunc, run) != 0) {
+		delete run;
+		hasSyntheticThread = false;
+		isSyntheticRunning.store(false);
+		return false;
+	}
+
+	return true;
+}
+
+void StopSyntheticEvents(EventQueue_t* queue) {
+	std::lock_guard<std::mutex> lock(syntheticMutex);
+
+	if(!hasSyntheticThread || syntheticQueue.load() != queue) {
+		return;
+	}
+
+	isSyntheticCancelled.store(true);
+	uv_thread_join(&syntheticThread);
+	hasSyntheticThread = false;
+}
@@ -0,0 +1,24 @@
+#ifndef _SYNTHETIC_EVENTS_H
+#define _SYNTHETIC_EVENTS_H
+
+#include <uv.h>
+
+#include "detection.h"
+#include "deviceList.h"
+#include "eventQueue.h"
+
+/**********************************
+ * Synthetic device events, used by the benchmarks to drive the event
+ * hand-off without real hardware. A helper thread queues `count`
+ * alternating add/remove events at `ratePerSecond` into the queue of one
+ * environment and wakes it through `async`. The events `filter` does not
+ * match are dropped and counted like the ones of the backend. Returns
+ * false while a previous run is still going.
+ **********************************/
+bool StartSyntheticEvents(unsigned int count, unsigned int ratePerSecond, const MonitorFilter_t& filter, EventQueue_t* queue, uv_async_t* async);
+// Cuts a run into `queue` short and waits for its thread, the queue is going away
+void StopSyntheticEvents(EventQueue_t* queue);
+// The device of the `index`th synthetic event, an add and its remove share one
+DeviceRecord_t CreateSyntheticRecord(unsigned int index);
+
+#endif
@@ -0,0 +1,288 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+
+#include "sysfsEnum_linux.h"
+
+/**********************************
+ * Local defines
+ **********************************/
+#define SYSFS_USB_DEVICES               "bus/usb/devices"
+#define SYSFS_CLASS_BLOCK               "class/block"
+#define SYSFS_BLOCK_DIR                 "/block/"
+#define SYSFS_SCSI_DISK_DIR             "/scsi_disk"
+#define SYSFS_DEVNAME_KEY               "DEVNAME="
+#define SYSFS_ATTRIBUTE_MAX             4096
+
+
+/**********************************
+ * Local typedefs
+ **********************************/
+typedef struct {
+    std::string name;
+    // Relative to the sysfs root: "devices/pci0000:00/..."
+    std::string target;
+} SysfsLink_t;
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+/* Links in bus/ and class/ point into devices/ through "../../" */
+static const char* StripParentDirs(const char* target)
+{
+    while (strncmp(target, "../", 3) == 0)
+    {
+        target += 3;
+    }
+
+    return target;
+}
+
+static bool ReadLinks(int rootFd, const char* dirPath, std::vector<SysfsLink_t>* links)
+{
+    struct dirent *entry;
+    DIR           *dir;
+    char           target[PATH_MAX];
+    int            dirFd = openat(rootFd, dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dirFd < 0)
+    {
+        return false;
+    }
+
+    if ((dir = fdopendir(dirFd)) == NULL)
+    {
+        close(dirFd);
+        return false;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        SysfsLink_t link;
+        ssize_t     length;
+
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        length = readlinkat(dirFd, entry->d_name, target, sizeof(target) - 1);
+        if (length <= 0)
+        {
+            continue;
+        }
+        target[length] = '\0';
+
+        link.name   = entry->d_name;
+        link.target = StripParentDirs(target);
+        links->push_back(link);
+    }
+
+    // Also closes dirFd
+    closedir(dir);
+    return true;
+}
+
+static bool ReadAttribute(int rootFd, const std::string& path, std::string* value)
+{
+    char    buffer[SYSFS_ATTRIBUTE_MAX];
+    ssize_t length;
+    int     fd = openat(rootFd, path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    length = read(fd, buffer, sizeof(buffer));
+    close(fd);
+
+    if (length < 0)
+    {
+        return false;
+    }
+
+    // Same as libudev: without the trailing newline
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\r'))
+    {
+        length--;
+    }
+
+    value->assign(buffer, length);
+    return true;
+}
+
+/* The node name comes from the uevent file, like udev_device_get_devnode() */
+static std::string GetDevNode(int rootFd, const SysfsLink_t& block)
+{
+    std::string uevent;
+    size_t      start;
+
+    if (ReadAttribute(rootFd, block.target + "/uevent", &uevent) &&
+        (start = uevent.find(SYSFS_DEVNAME_KEY)) != std::string::npos &&
+        (start == 0 || uevent[start - 1] == '\n'))
+    {
+        start += strlen(SYSFS_DEVNAME_KEY);
+        return "/dev/" + uevent.substr(start, uevent.find('\n', start) - start);
+    }
+
+    return "/dev/" + block.name;
+}
+
+/* Returns NULL when `usb` has no vendor and product id */
+static DeviceItem_t* ReadUsbDevice(int rootFd, const std::string& usb, const std::string& devNode)
+{
+    std::string  idVendor;
+    std::string  idProduct;
+    std::string  value;
+    DeviceItem_t *item;
+
+    if (!ReadAttribute(rootFd, usb + "/idVendor", &idVendor) ||
+        !ReadAttribute(rootFd, usb + "/idProduct", &idProduct))
+    {
+        return NULL;
+    }
+
+    item = new DeviceItem_t();
+    item->deviceParams.devNode   = devNode;
+    item->deviceParams.vendorId  = strtol(idVendor.c_str(), NULL, 16);
+    item->deviceParams.productId = strtol(idProduct.c_str(), NULL, 16);
+
+    if (ReadAttribute(rootFd, usb + "/product", &value))
+    {
+        item->deviceParams.deviceName = value;
+    }
+
+    if (ReadAttribute(rootFd, usb + "/manufacturer", &value))
+    {
+        item->deviceParams.manufacturer = value;
+    }
+
+    if (ReadAttribute(rootFd, usb + "/serial", &value))
+    {
+        item->deviceParams.serialNumber = value;
+    }
+
+    item->deviceParams.deviceAddress = 0;
+    item->deviceParams.locationId    = 0;
+    item->deviceState                = DeviceState_Connect;
+
+    return item;
+}
+
+static DeviceItem_t* ReadMassStorage(int rootFd, const std::set<std::string>& usbDevices, const SysfsLink_t& block)
+{
+    std::string usb;
+    size_t      blockDir = block.target.rfind(SYSFS_BLOCK_DIR);
+
+    // Partitions live below their disk: ".../block/sdb/sdb1"
+    if (blockDir == std::string::npos || block.target.compare(blockDir + strlen(SYSFS_BLOCK_DIR), std::string::npos, block.name) != 0)
+    {
+        return NULL;
+    }
+
+    // The parent of block/ is the SCSI device, it has to be a disk
+    std::string scsi = block.target.substr(0, blockDir);
+    if (faccessat(rootFd, (scsi + SYSFS_SCSI_DISK_DIR).c_str(), F_OK, 0) != 0)
+    {
+        return NULL;
+    }
+
+    // Closest USB device above it, what libudev calls the usb/usb_device parent
+    for (size_t slash = scsi.rfind('/'); slash != std::string::npos && slash > 0; slash = scsi.rfind('/', slash - 1))
+    {
+        if (usbDevices.count(scsi.substr(0, slash)))
+        {
+            usb = scsi.substr(0, slash);
+            break;
+        }
+    }
+
+    if (usb.empty())
+    {
+        return NULL;
+    }
+
+    return ReadUsbDevice(rootFd, usb, GetDevNode(rootFd, block));
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+bool SysfsEnumerateMassStorage(const char* sysfsRoot, std::vector<DeviceItem_t*>* items)
+{
+    std::vector<SysfsLink_t> usbLinks;
+    std::vector<SysfsLink_t> blockLinks;
+    std::set<std::string>    usbDevices;
+    int                      rootFd = open(sysfsRoot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (rootFd < 0)
+    {
+        return false;
+    }
+
+    // Without a USB controller or block devices the lists stay empty
+    ReadLinks(rootFd, SYSFS_USB_DEVICES, &usbLinks);
+    ReadLinks(rootFd, SYSFS_CLASS_BLOCK, &blockLinks);
+
+    // Interfaces are named "1-1:1.0", devices have no colon
+    for (size_t i = 0; i < usbLinks.size(); i++)
+    {
+        if (usbLinks[i].name.find(':') == std::string::npos)
+        {
+            usbDevices.insert(usbLinks[i].target);
+        }
+    }
+
+    for (size_t i = 0; i < blockLinks.size(); i++)
+    {
+        DeviceItem_t* item = ReadMassStorage(rootFd, usbDevices, blockLinks[i]);
+
+        if (item)
+        {
+            item->syspath = std::string(sysfsRoot) + "/" + blockLinks[i].target;
+            items->push_back(item);
+        }
+    }
+
+    close(rootFd);
+    return true;
+}
+
+DeviceItem_t* SysfsReadUsbBlockDevice(const char* sysfsRoot, const char* devpath, const char* devName)
+{
+    DeviceItem_t* item   = NULL;
+    std::string   path   = devpath[0] == '/' ? devpath + 1 : devpath;
+    int           rootFd = open(sysfsRoot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (rootFd < 0)
+    {
+        return NULL;
+    }
+
+    // USB interfaces have no idVendor, the first ancestor with one is the device
+    for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+    {
+        std::string parent = path.substr(0, slash);
+
+        if (faccessat(rootFd, (parent + "/idVendor").c_str(), F_OK, 0) == 0)
+        {
+            item = ReadUsbDevice(rootFd, parent, std::string("/dev/") + devName);
+            if (item)
+            {
+                item->syspath = std::string(sysfsRoot) + "/" + path;
+            }
+            break;
+        }
+    }
+
+    close(rootFd);
+    return item;
+}
@@ -0,0 +1,27 @@
+#ifndef _SYSFS_ENUM_LINUX_H
+#define _SYSFS_ENUM_LINUX_H
+
+#include <vector>
+
+#include "deviceList.h"
+
+/**********************************
+ * Mass storage enumeration straight from sysfs.
+ *
+ * Instead of one libudev enumeration per SCSI device and per child lookup,
+ * bus/usb/devices and class/block are each listed once and their links are
+ * resolved with readlinkat(). Only the attributes of the matching USB
+ * devices are read. The root is a parameter, so the enumerator can run
+ * against a generated tree.
+ **********************************/
+#define SYSFS_DEFAULT_ROOT              "/sys"
+
+/* Appends one item per USB disk (the whole disk, not its partitions) in the
+   same shape the libudev enumeration produces, without the mount path.
+   Returns false when the root can't be opened. */
+bool SysfsEnumerateMassStorage(const char* sysfsRoot, std::vector<DeviceItem_t*>* items);
+/* Item for the block device at `devpath` ("/devices/.../block/sdb/sdb1"),
+   NULL when it is not below a USB device */
+DeviceItem_t* SysfsReadUsbBlockDevice(const char* sysfsRoot, const char* devpath, const char* devName);
+
+#endif
@@ -0,0 +1,101 @@
+#include "topicRoutes.h"
+
+
+typedef struct {
+	TopicType_t type;
+	TopicLevel_t level;
+} TopicMatch_t;
+
+static const TopicMatch_t addedTopics[] = {
+	{ Topic_Add, TopicLevel_Product },
+	{ Topic_Insert, TopicLevel_Product },
+	{ Topic_Add, TopicLevel_Vendor },
+	{ Topic_Insert, TopicLevel_Vendor },
+	{ Topic_Add, TopicLevel_Type },
+	{ Topic_Insert, TopicLevel_Type },
+	{ Topic_Change, TopicLevel_Product },
+	{ Topic_Change, TopicLevel_Vendor },
+	{ Topic_Change, TopicLevel_Type },
+};
+
+static const TopicMatch_t removedTopics[] = {
+	{ Topic_Remove, TopicLevel_Product },
+	{ Topic_Remove, TopicLevel_Vendor },
+	{ Topic_Remove, TopicLevel_Type },
+	{ Topic_Change, TopicLevel_Product },
+	{ Topic_Change, TopicLevel_Vendor },
+	{ Topic_Change, TopicLevel_Type },
+};
+
+static const TopicMatch_t mountedTopics[] = {
+	{ Topic_Mount, TopicLevel_Product },
+	{ Topic_Mount, TopicLevel_Vendor },
+	{ Topic_Mount, TopicLevel_Type },
+};
+
+// The ids a level does not name are left out of the key
+static uint64_t TopicKey(TopicType_t type, TopicLevel_t level, int vendorId, int productId) {
+	uint64_t key = (uint64_t) type << 40 | (uint64_t) level << 32;
+
+	if(level >= TopicLevel_Vendor) {
+		key |= (uint64_t) (vendorId & 0xFFFF) << 16;
+	}
+	if(level >= TopicLevel_Product) {
+		key |= (uint64_t) (productId & 0xFFFF);
+	}
+
+	return key;
+}
+
+bool TopicRoutesSet(TopicRoutes_t* topicRoutes, TopicType_t type, TopicLevel_t level, int vendorId, int productId, uint32_t routeId) {
+	if(vendorId < 0 || vendorId > 0xFFFF || productId < 0 || productId > 0xFFFF) {
+		return false;
+	}
+
+	uint64_t key = TopicKey(type, level, vendorId, productId);
+	if(routeId == 0) {
+		topicRoutes->routes.erase(key);
+	}
+	else {
+		topicRoutes->routes[key] = routeId;
+	}
+
+	return true;
+}
+
+size_t TopicRoutesMatch(const TopicRoutes_t* topicRoutes, DeviceEventType_t eventType, int vendorId, int productId, uint32_t routeIds[TOPIC_ROUTES_MAX_MATCHES]) {
+	const TopicMatch_t* topics = mountedTopics;
+	size_t topicCount = sizeof(mountedTopics) / sizeof(mountedTopics[0]);
+	size_t matchCount = 0;
+
+	// Nobody listens to anything, the common case for the batch and subscribe users
+	if(topicRoutes->routes.empty()) {
+		return 0;
+	}
+
+	if(eventType == DeviceEvent_Added) {
+		topics = addedTopics;
+		topicCount = sizeof(addedTopics) / sizeof(addedTopics[0]);
+	}
+	else if(eventType == DeviceEvent_Removed) {
+		topics = removedTopics;
+		topicCount = sizeof(removedTopics) / sizeof(removedTopics[0]);
+	}
+
+	// Ids that cannot be in a topic only match the topics without them
+	bool hasUsbIds = vendorId >= 0 && vendorId <= 0xFFFF && productId >= 0 && productId <= 0xFFFF;
+
+	for(size_t i = 0; i < topicCount; i++) {
+		if(!hasUsbIds && topics[i].level != TopicLevel_Type) {
+			continue;
+		}
+
+		std::unordered_map<uint64_t, uint32_t>::const_iterator it = topicRoutes->routes.find(TopicKey(topics[i].type, topics[i].level, vendorId, productId));
+
+		if(it != topicRoutes->routes.end()) {
+			routeIds[matchCount++] = it->second;
+		}
+	}
+
+	return matchCount;
+}
@@ -0,0 +1,45 @@
+#ifndef _TOPIC_ROUTES_H
+#define _TOPIC_ROUTES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "eventQueue.h"
+
+// The event names of index.js, `insert` is the old name of `add`
+typedef enum _TopicType_t {
+	Topic_Add,
+	Topic_Insert,
+	Topic_Remove,
+	Topic_Change,
+	Topic_Mount,
+	Topic_Count,
+} TopicType_t;
+
+// `add`, `add:vid` and `add:vid:pid`
+typedef enum _TopicLevel_t {
+	TopicLevel_Type,
+	TopicLevel_Vendor,
+	TopicLevel_Product,
+} TopicLevel_t;
+
+// An added device matches the most topics: add, insert and change, at each level
+#define TOPIC_ROUTES_MAX_MATCHES 9
+
+/**********************************
+ * The topics somebody listens to, keyed by (type, level, vid, pid). The
+ * route id is whatever the JS side uses to find the topic again, so a
+ * device event turns into the ids of its listened-to topics without
+ * building any of the topic strings. Only used on the loop thread.
+ **********************************/
+typedef struct {
+	std::unordered_map<uint64_t, uint32_t> routes;
+} TopicRoutes_t;
+
+// `routeId` 0 removes the route. False when the ids do not fit a USB id
+bool TopicRoutesSet(TopicRoutes_t* topicRoutes, TopicType_t type, TopicLevel_t level, int vendorId, int productId, uint32_t routeId);
+// Fills `routeIds` in the order index.js used to emit the topics, returns how many
+size_t TopicRoutesMatch(const TopicRoutes_t* topicRoutes, DeviceEventType_t eventType, int vendorId, int productId, uint32_t routeIds[TOPIC_ROUTES_MAX_MATCHES]);
+
+#endif
@@ -0,0 +1,401 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ueventReplay_linux.h"
+#include "ueventSocket_linux.h"
+
+/**********************************
+ * Local defines
+ **********************************/
+#define REPLAY_ACTION_ADD               "add@"
+#define REPLAY_SPEED_MAX                "max"
+#define REPLAY_SLEEP_SLICE_NS           (100 * 1000000ULL)
+
+// What the sysfs reader looks at, see ReadUsbDevice() in sysfsEnum_linux.cpp
+static const char* recordedAttributes[] = { "idVendor", "idProduct", "product", "manufacturer", "serial" };
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+static uint64_t NowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool ReadFile(const std::string& path, std::string* value)
+{
+    char    buffer[4096];
+    ssize_t length;
+    int     fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    length = read(fd, buffer, sizeof(buffer));
+    close(fd);
+
+    if (length < 0)
+    {
+        return false;
+    }
+
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\r'))
+    {
+        length--;
+    }
+
+    value->assign(buffer, length);
+    return true;
+}
+
+static bool WriteFile(const std::string& path, const std::string& value)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fp, "%s\n", value.c_str());
+    return fclose(fp) == 0;
+}
+
+static void MakeDirs(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    mkdir(path.c_str(), 0755);
+}
+
+/* The attributes of the closest USB device above `devpath`, the same one
+   SysfsReadUsbBlockDevice() settles on */
+static std::string RecordAttributes(const char* sysfsRoot, const char* devpath)
+{
+    std::string attributes;
+    std::string path = devpath[0] == '/' ? devpath + 1 : devpath;
+    std::string value;
+
+    for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+    {
+        std::string parent = path.substr(0, slash);
+
+        if (access((std::string(sysfsRoot) + "/" + parent + "/idVendor").c_str(), F_OK) != 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < sizeof(recordedAttributes) / sizeof(recordedAttributes[0]); i++)
+        {
+            if (ReadFile(std::string(sysfsRoot) + "/" + parent + "/" + recordedAttributes[i], &value))
+            {
+                attributes += UEVENT_ATTRS_KEY + parent + "/" + recordedAttributes[i] + "}=" + value;
+                attributes += '\0';
+            }
+        }
+        break;
+    }
+
+    return attributes;
+}
+
+static bool WriteAll(FILE* fp, const void* data, size_t size)
+{
+    return fwrite(data, 1, size, fp) == size;
+}
+
+static void StoreLittleEndian(unsigned char* bytes, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        bytes[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint64_t LoadLittleEndian(const unsigned char* bytes, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = size - 1; i >= 0; i--)
+    {
+        value = (value << 8) | bytes[i];
+    }
+
+    return value;
+}
+
+/* In slices, so a replay with long pauses can still be stopped right away */
+static void SleepUntil(UeventReplay_t* replay, uint64_t dueNs)
+{
+    uint64_t now;
+
+    while ((now = NowNs()) < dueNs && !replay->isCancelled.load())
+    {
+        uint64_t        sleepNs = dueNs - now < REPLAY_SLEEP_SLICE_NS ? dueNs - now : REPLAY_SLEEP_SLICE_NS;
+        struct timespec ts;
+
+        ts.tv_sec  = (time_t) (sleepNs / 1000000000ULL);
+        ts.tv_nsec = (long) (sleepNs % 1000000000ULL);
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* ReplayThreadFunc(void* ptr)
+{
+    UeventReplay_t* replay = (UeventReplay_t*) ptr;
+    uint64_t        start  = NowNs();
+
+    for (size_t i = 0; i < replay->records.size() && !replay->isCancelled.load(); i++)
+    {
+        const UeventRecord_t& record = replay->records[i];
+
+        if (replay->speed > 0)
+        {
+            SleepUntil(replay, start + (uint64_t) (record.timeNs / replay->speed));
+        }
+
+        replay->sentNs[i] = NowNs();
+        // Blocks while the consumer is behind, nothing is dropped
+        while (send(replay->fds[1], record.message.data(), record.message.size(), MSG_NOSIGNAL) < 0 && errno == EINTR)
+        {
+        }
+        replay->sent++;
+    }
+
+    return NULL;
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+bool UeventRecorderOpen(UeventRecorder_t* recorder, const char* path)
+{
+    recorder->file    = fopen(path, "wb");
+    recorder->firstNs = 0;
+
+    if (recorder->file == NULL)
+    {
+        return false;
+    }
+
+    if (!WriteAll(recorder->file, UEVENT_RECORDING_MAGIC, UEVENT_RECORDING_MAGIC_SIZE))
+    {
+        UeventRecorderClose(recorder);
+        return false;
+    }
+
+    return true;
+}
+
+void UeventRecorderWrite(UeventRecorder_t* recorder, uint64_t timeNs, const char* message, size_t length, const char* sysfsRoot)
+{
+    unsigned char header[12];
+    std::string   attributes;
+
+    if (recorder->file == NULL)
+    {
+        return;
+    }
+
+    if (recorder->firstNs == 0)
+    {
+        recorder->firstNs = timeNs;
+    }
+
+    if (sysfsRoot != NULL && length > strlen(REPLAY_ACTION_ADD) && strncmp(message, REPLAY_ACTION_ADD, strlen(REPLAY_ACTION_ADD)) == 0)
+    {
+        attributes = RecordAttributes(sysfsRoot, message + strlen(REPLAY_ACTION_ADD));
+    }
+
+    StoreLittleEndian(header, timeNs - recorder->firstNs, 8);
+    StoreLittleEndian(header + 8, length + attributes.size(), 4);
+
+    WriteAll(recorder->file, header, sizeof(header));
+    WriteAll(recorder->file, message, length);
+    WriteAll(recorder->file, attributes.data(), attributes.size());
+    // A recording is usually cut short with Ctrl+C
+    fflush(recorder->file);
+}
+
+void UeventRecorderClose(UeventRecorder_t* recorder)
+{
+    if (recorder->file != NULL)
+    {
+        fclose(recorder->file);
+        recorder->file = NULL;
+    }
+}
+
+bool UeventRecordingLoad(const char* path, std::vector<UeventRecord_t>* records)
+{
+    char          magic[UEVENT_RECORDING_MAGIC_SIZE];
+    unsigned char header[12];
+    FILE*         fp = fopen(path, "rb");
+
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, UEVENT_RECORDING_MAGIC, sizeof(magic)) != 0)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    // A recording that was cut short in the middle of an event ends before it
+    while (fread(header, 1, sizeof(header), fp) == sizeof(header))
+    {
+        UeventRecord_t record;
+        size_t         length = (size_t) LoadLittleEndian(header + 8, 4);
+
+        if (length == 0 || length >= UEVENT_BUFFER_SIZE)
+        {
+            break;
+        }
+
+        record.timeNs = LoadLittleEndian(header, 8);
+        record.message.resize(length);
+        if (fread(&record.message[0], 1, length, fp) != length)
+        {
+            break;
+        }
+
+        records->push_back(record);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+bool UeventRecordingWriteAttributes(const std::vector<UeventRecord_t>& records, const char* sysfsRoot)
+{
+    bool isWritten = true;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const std::string& message = records[i].message;
+        size_t             end;
+
+        for (size_t field = 0; field < message.size(); field = end + 1)
+        {
+            end = message.find('\0', field);
+            if (end == std::string::npos)
+            {
+                end = message.size();
+            }
+
+            if (message.compare(field, strlen(UEVENT_ATTRS_KEY), UEVENT_ATTRS_KEY) != 0)
+            {
+                continue;
+            }
+
+            size_t pathStart = field + strlen(UEVENT_ATTRS_KEY);
+            size_t pathEnd   = message.find("}=", pathStart);
+
+            // Recorded below the root, never outside of it
+            if (pathEnd == std::string::npos || pathEnd > end ||
+                message.compare(pathStart, pathEnd - pathStart, "..") == 0 ||
+                message.substr(pathStart, pathEnd - pathStart).find("/..") != std::string::npos)
+            {
+                continue;
+            }
+
+            std::string path = std::string(sysfsRoot) + "/" + message.substr(pathStart, pathEnd - pathStart);
+
+            MakeDirs(path.substr(0, path.rfind('/')));
+            isWritten = WriteFile(path, message.substr(pathEnd + 2, end - pathEnd - 2)) && isWritten;
+        }
+    }
+
+    return isWritten;
+}
+
+double UeventReplayParseSpeed(const char* speed)
+{
+    double factor;
+
+    if (speed == NULL)
+    {
+        return 1;
+    }
+
+    if (strcmp(speed, REPLAY_SPEED_MAX) == 0)
+    {
+        return 0;
+    }
+
+    factor = strtod(speed, NULL);
+    return factor > 0 ? factor : 1;
+}
+
+bool UeventReplayStart(UeventReplay_t* replay, const char* path, double speed, const char* sysfsRoot)
+{
+    replay->records.clear();
+
+    if (!UeventRecordingLoad(path, &replay->records))
+    {
+        return false;
+    }
+
+    UeventRecordingWriteAttributes(replay->records, sysfsRoot);
+
+    return UeventReplayStartRecords(replay, speed);
+}
+
+bool UeventReplayStartRecords(UeventReplay_t* replay, double speed)
+{
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, replay->fds) != 0)
+    {
+        return false;
+    }
+
+    // The same filter as the kernel socket, the consumer sees what it would see
+    if (!UeventAttachFilter(replay->fds[0]) || fcntl(replay->fds[0], F_SETFL, O_NONBLOCK) != 0)
+    {
+        close(replay->fds[0]);
+        close(replay->fds[1]);
+        return false;
+    }
+    UeventSetReceiveBuffer(replay->fds[0], UEVENT_RECEIVE_BUFFER_SIZE);
+
+    replay->speed = speed;
+    replay->isCancelled.store(false);
+    replay->sentNs.assign(replay->records.size(), 0);
+    replay->sent.store(0);
+
+    if (pthread_create(&replay->thread, NULL, ReplayThreadFunc, replay) != 0)
+    {
+        close(replay->fds[0]);
+        close(replay->fds[1]);
+        return false;
+    }
+
+    return true;
+}
+
+void UeventReplayStop(UeventReplay_t* replay)
+{
+    replay->isCancelled.store(true);
+    // Wakes up a send() that waits for the consumer
+    shutdown(replay->fds[1], SHUT_RDWR);
+    pthread_join(replay->thread, NULL);
+
+    close(replay->fds[0]);
+    close(replay->fds[1]);
+}
@@ -0,0 +1,78 @@
+#ifndef _UEVENT_REPLAY_LINUX_H
+#define _UEVENT_REPLAY_LINUX_H
+
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**********************************
+ * Recorded uevent streams, to load test the pipeline without hardware.
+ *
+ * A recording is the uevents of a source in the kernel format
+ * ("<action>@<devpath>\0KEY=value\0..."), each with the time it arrived
+ * at. Add events also carry the attributes of their USB device that the
+ * sysfs reader needs, as "ATTRS{<path below the sysfs root>}=value" keys.
+ *
+ * A replay writes the attributes into a sysfs root of its own, then sends
+ * the events through a socket pair at the recorded pace, N times faster
+ * or as fast as the consumer reads them. The consumer end takes the place
+ * of the kernel uevent socket, so the events go through the same filter,
+ * parser and sysfs reads as live kernel events.
+ *
+ * File format, little endian:
+ *   "USBDUEV1"
+ *   per event: uint64 nanoseconds since the first event, uint32 length,
+ *              the message
+ **********************************/
+#define UEVENT_RECORDING_MAGIC          "USBDUEV1"
+#define UEVENT_RECORDING_MAGIC_SIZE     8
+#define UEVENT_ATTRS_KEY                "ATTRS{"
+
+typedef struct {
+    uint64_t    timeNs;
+    std::string message;
+} UeventRecord_t;
+
+typedef struct {
+    FILE*    file;
+    uint64_t firstNs;
+} UeventRecorder_t;
+
+typedef struct {
+    std::vector<UeventRecord_t> records;
+    // 1 is the recorded pace, 0 as fast as the consumer reads
+    double                      speed;
+    // [0] is read by the consumer, [1] is written by the replay thread
+    int                         fds[2];
+    pthread_t                   thread;
+    std::atomic<bool>           isCancelled;
+    // When each event was sent, written before it is sent
+    std::vector<uint64_t>       sentNs;
+    std::atomic<size_t>         sent;
+} UeventReplay_t;
+
+bool UeventRecorderOpen(UeventRecorder_t* recorder, const char* path);
+/* Appends one message. With a `sysfsRoot`, the attributes of the USB
+   device of an add event are read from there and recorded with it. */
+void UeventRecorderWrite(UeventRecorder_t* recorder, uint64_t timeNs, const char* message, size_t length, const char* sysfsRoot);
+void UeventRecorderClose(UeventRecorder_t* recorder);
+
+bool UeventRecordingLoad(const char* path, std::vector<UeventRecord_t>* records);
+// Creates the recorded attribute files below `sysfsRoot`
+bool UeventRecordingWriteAttributes(const std::vector<UeventRecord_t>& records, const char* sysfsRoot);
+// "max" is 0, anything else a factor of the recorded pace, 1 by default
+double UeventReplayParseSpeed(const char* speed);
+
+/* Loads `path`, writes its attributes below `sysfsRoot` and starts sending.
+   fds[0] is non-blocking and has the uevent socket filter attached. The
+   write end stays open until UeventReplayStop(), so the consumer only sees
+   the replay end by the lack of events. */
+bool UeventReplayStart(UeventReplay_t* replay, const char* path, double speed, const char* sysfsRoot);
+// Same with events that are already loaded
+bool UeventReplayStartRecords(UeventReplay_t* replay, double speed);
+void UeventReplayStop(UeventReplay_t* replay);
+
+#endif
@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ueventSocket_linux.h"
+
+/**********************************
+ * Local defines
+ **********************************/
+#define UEVENT_KERNEL_GROUP             1
+
+#define UEVENT_KEY_ACTION               "ACTION="
+#define UEVENT_KEY_DEVPATH              "DEVPATH="
+#define UEVENT_KEY_SUBSYSTEM            "SUBSYSTEM="
+#define UEVENT_KEY_DEVTYPE              "DEVTYPE="
+#define UEVENT_KEY_DEVNAME              "DEVNAME="
+#define UEVENT_KEY_PRODUCT              "PRODUCT="
+
+#define BPF_STATEMENT(code, k)          { (unsigned short) (code), 0, 0, (unsigned int) (k) }
+#define BPF_JUMP_IF(code, k, jt, jf)    { (unsigned short) (code), (unsigned char) (jt), (unsigned char) (jf), (unsigned int) (k) }
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+/* Absolute and indexed loads read in network byte order */
+static unsigned int Word(const char* text)
+{
+    return ((unsigned int) (unsigned char) text[0] << 24) |
+           ((unsigned int) (unsigned char) text[1] << 16) |
+           ((unsigned int) (unsigned char) text[2] << 8) |
+           (unsigned int) (unsigned char) text[3];
+}
+
+static unsigned int HalfWord(const char* text)
+{
+    return ((unsigned int) (unsigned char) text[0] << 8) | (unsigned char) text[1];
+}
+
+static const char* MatchKey(const char* field, const char* key)
+{
+    size_t length = strlen(key);
+
+    return strncmp(field, key, length) == 0 ? field + length : NULL;
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+int UeventSocketOpen()
+{
+    struct sockaddr_nl address;
+    int                fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = UEVENT_KERNEL_GROUP;
+
+    // The filter goes on before bind(), so nothing unfiltered gets queued
+    if (!UeventAttachFilter(fd) || bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Bursts (a hub with many disks) must not overflow the default buffer
+    UeventSetReceiveBuffer(fd, UEVENT_RECEIVE_BUFFER_SIZE);
+
+    return fd;
+}
+
+int UeventSetReceiveBuffer(int fd, int size)
+{
+    socklen_t length = sizeof(size);
+
+    // SO_RCVBUFFORCE needs CAP_NET_ADMIN, SO_RCVBUF is capped by net.core.rmem_max
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &length) != 0)
+    {
+        return 0;
+    }
+
+    return size;
+}
+
+/* The message starts with "<action>@<devpath>". Accepts "add@" and
+   "remove@" followed by "/devices/", but not "/devices/virtual/". */
+bool UeventAttachFilter(int fd)
+{
+    struct sock_filter code[] = {
+        /*  0 */ BPF_STATEMENT(BPF_LD  | BPF_W   | BPF_ABS, 0),
+        /*  1 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("add@"), 7, 0),
+        /*  2 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("remo"), 0, 18),
+        /*  3 */ BPF_STATEMENT(BPF_LD  | BPF_H   | BPF_ABS, 4),
+        /*  4 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, HalfWord("ve"), 0, 16),
+        /*  5 */ BPF_STATEMENT(BPF_LD  | BPF_B   | BPF_ABS, 6),
+        /*  6 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, '@', 0, 14),
+        /*  7 */ BPF_STATEMENT(BPF_LDX | BPF_W   | BPF_IMM, 7),
+        /*  8 */ BPF_STATEMENT(BPF_JMP | BPF_JA,  1),
+        /*  9 */ BPF_STATEMENT(BPF_LDX | BPF_W   | BPF_IMM, 4),
+        // X is the offset of the devpath
+        /* 10 */ BPF_STATEMENT(BPF_LD  | BPF_W   | BPF_IND, 0),
+        /* 11 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("/dev"), 0, 9),
+        /* 12 */ BPF_STATEMENT(BPF_LD  | BPF_W   | BPF_IND, 4),
+        /* 13 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("ices"), 0, 7),
+        /* 14 */ BPF_STATEMENT(BPF_LD  | BPF_B   | BPF_IND, 8),
+        /* 15 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, '/', 0, 5),
+        /* 16 */ BPF_STATEMENT(BPF_LD  | BPF_W   | BPF_IND, 9),
+        /* 17 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("virt"), 0, 2),
+        /* 18 */ BPF_STATEMENT(BPF_LD  | BPF_W   | BPF_IND, 13),
+        /* 19 */ BPF_JUMP_IF(BPF_JMP   | BPF_JEQ | BPF_K, Word("ual/"), 1, 0),
+        /* 20 */ BPF_STATEMENT(BPF_RET | BPF_K,   0xffffffff),
+        /* 21 */ BPF_STATEMENT(BPF_RET | BPF_K,   0),
+    };
+    struct sock_fprog program;
+
+    program.len    = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0;
+}
+
+ssize_t UeventReceive(int fd, char* buffer, size_t size)
+{
+    struct sockaddr_nl sender;
+    socklen_t          senderLength;
+    ssize_t            length;
+
+    while (true)
+    {
+        senderLength = sizeof(sender);
+        memset(&sender, 0, sizeof(sender));
+
+        length = recvfrom(fd, buffer, size - 1, 0, (struct sockaddr*) &sender, &senderLength);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+
+        // Only the kernel sends from port 0, anything else is forged
+        if (sender.nl_family == AF_NETLINK && sender.nl_pid != 0)
+        {
+            continue;
+        }
+
+        buffer[length] = '\0';
+        return length;
+    }
+}
+
+bool UeventParse(char* buffer, size_t length, Uevent_t* event)
+{
+    const char* value;
+    size_t      offset = strlen(buffer) + 1;
+
+    memset(event, 0, sizeof(*event));
+
+    // Skip the "<action>@<devpath>" header, the same data follows as keys
+    while (offset < length)
+    {
+        const char* field = buffer + offset;
+
+        if ((value = MatchKey(field, UEVENT_KEY_ACTION)))
+        {
+            event->action = value;
+        }
+        else if ((value = MatchKey(field, UEVENT_KEY_DEVPATH)))
+        {
+            event->devpath = value;
+        }
+        else if ((value = MatchKey(field, UEVENT_KEY_SUBSYSTEM)))
+        {
+            event->subsystem = value;
+        }
+        else if ((value = MatchKey(field, UEVENT_KEY_DEVTYPE)))
+        {
+            event->devtype = value;
+        }
+        else if ((value = MatchKey(field, UEVENT_KEY_DEVNAME)))
+        {
+            event->devname = value;
+        }
+        else if ((value = MatchKey(field, UEVENT_KEY_PRODUCT)))
+        {
+            event->product = value;
+        }
+
+        offset += strlen(field) + 1;
+    }
+
+    return event->action && event->devpath && event->subsystem;
+}
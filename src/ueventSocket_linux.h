@@ -0,0 +1,45 @@
+#ifndef _UEVENT_SOCKET_LINUX_H
+#define _UEVENT_SOCKET_LINUX_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**********************************
+ * Kernel uevents without udevd in between.
+ *
+ * A NETLINK_KOBJECT_UEVENT socket receives the events straight from the
+ * kernel. A classic BPF filter attached to it drops everything but
+ * add/remove events of real devices below /devices/ before they are
+ * queued, so bind/unbind/change events and virtual devices (loop, dm,
+ * veth, ...) never wake the process up. The filter can only look at fixed
+ * offsets, so subsystems and vendor ids are matched after UeventParse().
+ **********************************/
+#define UEVENT_BUFFER_SIZE              8192
+#define UEVENT_RECEIVE_BUFFER_SIZE      (1024 * 1024)
+
+/* Fields point into the received buffer */
+typedef struct {
+    const char* action;
+    const char* devpath;
+    const char* subsystem;
+    const char* devtype;
+    const char* devname;
+    const char* product;
+} Uevent_t;
+
+/* Non-blocking socket bound to the kernel group with the filter attached,
+   -1 on error */
+int     UeventSocketOpen();
+// Works on any socket type, the benchmark attaches it to a socketpair
+bool    UeventAttachFilter(int fd);
+/* Forced past the system limit when allowed to, returns the size the
+   kernel granted, which counts its bookkeeping too */
+int     UeventSetReceiveBuffer(int fd, int size);
+/* Returns the length of the next message, 0 when none is queued and -1
+   with errno set on errors, ENOBUFS when messages were lost because the
+   receive buffer was full. Messages that were not sent by the kernel are
+   skipped. */
+ssize_t UeventReceive(int fd, char* buffer, size_t size);
+bool    UeventParse(char* buffer, size_t length, Uevent_t* event);
+
+#endif
@@ -7,9 +7,12 @@ var expect = require('chai').expect;
 var chaiAsPromised = require('chai-as-promised');
 chai.use(chaiAsPromised);
 var chalk = require('chalk');
+var childProcess = require('child_process');
 
 // The plugin to test
 var usbDetect = require('../');
+// Raw binding, to drive synthetic device events
+var detection = require('bindings')('detection.node');
 
 //usbDetect.on('log', function(msg) {
 //	console.log(chalk.black.bgCyan("msg: " + msg));
@@ -51,6 +54,27 @@ describe('usb-detection', function() {
 			.that.is.an('object');
 	};
 	
+	describe('loading', function() {
+		// The backend runs on a thread of its own, where a V8 call crashes the process
+		it('should load and start monitoring in a fresh process', function() {
+			this.timeout(15000);
+
+			var result = childProcess.spawnSync(process.execPath, [
+				'-e',
+				'var usbDetect = require(' + JSON.stringify(require.resolve('../')) + ');' +
+				'usbDetect.on("log", function() {});' +
+				'usbDetect.startMonitoring();' +
+				'usbDetect.ready.then(function() {' +
+				'	usbDetect.stopMonitoring();' +
+				'});'
+			], { timeout: 10000 });
+
+			expect(result.signal).to.equal(null);
+			expect(result.status).to.equal(0);
+		});
+	});
+
+
 	/*	
 	describe('`.find`', function() {
 
@@ -81,6 +105,415 @@ describe('usb-detection', function() {
 	*/
 
 
+	describe('`.ready`', function() {
+		it('should resolve once the initial device list is complete', function() {
+			return expect(usbDetect.ready).to.eventually.be.fulfilled;
+		});
+
+		it('should let `find` answer from the initial device list', function() {
+			return expect(usbDetect.find()
+				.then(function(devices) {
+					expect(devices).to.be.an('array');
+					devices.forEach(testDeviceShape);
+				}))
+				.to.eventually.be.fulfilled;
+		});
+	});
+
+	describe('`.findSync`', function() {
+		it('should return the same devices as `find`', function() {
+			return usbDetect.find().then(function(devices) {
+				var syncDevices = usbDetect.findSync();
+				expect(syncDevices).to.deep.equal(devices);
+				syncDevices.forEach(testDeviceShape);
+			});
+		});
+
+		it('should filter by vendor and product id', function() {
+			return usbDetect.find().then(function(devices) {
+				devices.forEach(function(device) {
+					if(!device.vendorId) {
+						return;
+					}
+
+					usbDetect.findSync(device.vendorId).forEach(function(match) {
+						expect(match.vendorId).to.equal(device.vendorId);
+					});
+					expect(usbDetect.findSync(device.vendorId, device.productId)).to.deep.include(device);
+				});
+			});
+		});
+	});
+
+	describe('`.findBinary`', function() {
+		it('should decode to the same devices as `findSync`', function() {
+			return usbDetect.ready.then(function() {
+				var view = new usbDetect.DeviceListView(usbDetect.findBinary());
+
+				expect(view.listVersion).to.be.a('number');
+				expect(view.toArray()).to.deep.equal(usbDetect.findSync());
+			});
+		});
+
+		it('should reject buffers in another format', function() {
+			expect(function() {
+				new usbDetect.DeviceListView(new ArrayBuffer(32));
+			}).to.throw(Error);
+		});
+	});
+
+
+	describe('`.changesSince`', function() {
+		it('should have nothing new right after the latest generation', function() {
+			return usbDetect.ready.then(function() {
+				var generation = usbDetect.changesSince(0).generation;
+				var result = usbDetect.changesSince(generation);
+
+				expect(result.resync).to.equal(false);
+				expect(result.generation).to.equal(generation);
+				expect(result.changes).to.deep.equal([]);
+			});
+		});
+
+		it('should ask for a resync from a generation it never handed out', function() {
+			return usbDetect.ready.then(function() {
+				var result = usbDetect.changesSince(-1);
+
+				expect(result.resync).to.equal(true);
+				expect(result.devices).to.deep.equal(usbDetect.findSync());
+			});
+		});
+	});
+
+
+	describe('synthetic events', function() {
+		// Synthetic events need the event queue to themselves
+		before(function() {
+			usbDetect.stopMonitoring();
+		});
+
+		after(function() {
+			usbDetect.startMonitoring();
+		});
+
+
+		describe('`.registerBatch`', function() {
+			after(function() {
+				usbDetect.registerBatch(null);
+			});
+
+			it('should deliver queued events as arrays of records', function(done) {
+				var records = [];
+				usbDetect.registerBatch(function(batch) {
+					expect(batch.length).to.be.at.most(4);
+					records = records.concat(batch);
+
+					if(records.length === 10) {
+						records.forEach(function(record) {
+							expect(['add', 'remove']).to.include(record.type);
+							testDeviceShape(record.device);
+						});
+						done();
+					}
+				}, { maxBatch: 4 });
+
+				detection.queueSyntheticEvents(10, 1000);
+			});
+		});
+
+
+		describe('`.subscribe`', function() {
+			it('should replay the kept events from `fromSeq` on', function(done) {
+				var seen = [];
+				var live = usbDetect.subscribe({}, function(record) {
+					seen.push(record);
+					if(seen.length < 6) {
+						return;
+					}
+					live.unsubscribe();
+
+					seen.forEach(function(record, i) {
+						expect(['add', 'remove']).to.include(record.type);
+						testDeviceShape(record.device);
+						if(i > 0) {
+							expect(record.seq).to.equal(seen[i - 1].seq + 1);
+						}
+					});
+
+					var replayed = [];
+					var replay = usbDetect.subscribe({ fromSeq: seen[2].seq }, function(record) {
+						replayed.push(record);
+						if(replayed.length === 4) {
+							replay.unsubscribe();
+							expect(replayed).to.deep.equal(seen.slice(2));
+							done();
+						}
+					});
+				});
+
+				detection.queueSyntheticEvents(6, 1000);
+			});
+		});
+
+
+		describe('`.configure({ debounceMs })`', function() {
+			before(function() {
+				usbDetect.configure({ debounceMs: 50 });
+			});
+
+			after(function() {
+				usbDetect.configure({ debounceMs: 0 });
+			});
+
+			it('should cancel an add and a remove of the same device', function(done) {
+				var suppressed = usbDetect.getStats().eventsSuppressed;
+				var records = [];
+				var subscription = usbDetect.subscribe({}, function(record) {
+					records.push(record);
+				});
+
+				// Every synthetic add is followed by the remove of the same device
+				detection.queueSyntheticEvents(10, 1000);
+
+				setTimeout(function() {
+					subscription.unsubscribe();
+					expect(records).to.deep.equal([]);
+					expect(usbDetect.getStats().eventsSuppressed - suppressed).to.equal(10);
+					expect(usbDetect.getStats().eventsHeld).to.equal(0);
+					done();
+				}, 300);
+			});
+		});
+
+
+		describe('`.configure({ queuePolicy })`', function() {
+			after(function() {
+				usbDetect.configure({ queuePolicy: 'drop-newest' });
+			});
+
+			// Queues 2000 synthetic events while JS is busy, twice what the queue holds
+			function overflowQueue() {
+				return new Promise(function(resolve) {
+					usbDetect.once('overflow', resolve);
+
+					detection.queueSyntheticEvents(2000, 1000000);
+					var start = Date.now();
+					while(Date.now() - start < 200) {
+						// Keep the event loop from draining the queue
+					}
+				});
+			}
+
+			it('should drop the oldest events and report them', function() {
+				var stats = usbDetect.getStats();
+				usbDetect.configure({ queuePolicy: 'drop-oldest' });
+
+				return overflowQueue().then(function(overflow) {
+					var dropped = stats.queueCapacity < 2000 ? 2000 - stats.queueCapacity : 0;
+					expect(overflow).to.deep.equal({ dropped: dropped, coalesced: 0, monitorOverruns: 0 });
+					expect(usbDetect.getStats().eventsDropped - stats.eventsDropped).to.equal(dropped);
+					expect(usbDetect.getStats().queuePolicy).to.equal('drop-oldest');
+				});
+			});
+
+			it('should coalesce what does not fit per device', function() {
+				var stats = usbDetect.getStats();
+				usbDetect.configure({ queuePolicy: 'coalesce' });
+
+				// Every synthetic add is followed by the remove of the same device
+				return overflowQueue().then(function(overflow) {
+					expect(overflow.dropped).to.equal(0);
+					expect(overflow.coalesced).to.be.above(0);
+					expect(usbDetect.getStats().eventsCoalesced - stats.eventsCoalesced).to.equal(overflow.coalesced);
+				});
+			});
+
+			it('should reject unknown policies', function() {
+				expect(function() {
+					usbDetect.configure({ queuePolicy: 'drop-everything' });
+				}).to.throw(TypeError);
+			});
+		});
+
+
+		describe('`.getStats().latency`', function() {
+			it('should time the delivered events per stage', function(done) {
+				var delivered = usbDetect.getStats().eventsDelivered;
+
+				detection.queueSyntheticEvents(10, 1000);
+
+				setTimeout(function() {
+					var stats = usbDetect.getStats();
+					expect(stats.eventsDelivered - delivered).to.equal(10);
+					['enrich', 'publish', 'queue', 'deliver', 'callback', 'total'].forEach(function(name) {
+						var stage = stats.latency[name];
+						expect(stage).to.have.all.keys('count', 'meanNs', 'p50Ns', 'p90Ns', 'p99Ns', 'p999Ns', 'maxNs');
+						expect(stage.p99Ns).to.be.at.least(stage.p50Ns);
+					});
+					expect(stats.latency.total.count).to.equal(stats.eventsDelivered);
+					expect(stats.latency.total.maxNs).to.be.above(0);
+					done();
+				}, 300);
+			});
+		});
+
+
+		describe('topic routes', function() {
+			// The first synthetic device is 4096:0, added and then removed
+			it('should emit the same topics as the legacy emits', function() {
+				var topics = ['add:4096:0', 'insert:4096', 'remove:4096:0', 'change:4096', 'change', 'mount', 'add:4097'];
+				var emitted = [];
+				var listeners = topics.map(function(topic) {
+					var listener = function(device) {
+						emitted.push(topic + ' ' + device.devNode);
+					};
+					usbDetect.on(topic, listener);
+					return listener;
+				});
+
+				detection.routeSyntheticEvents(2, false);
+				var routed = emitted;
+				emitted = [];
+				detection.routeSyntheticEvents(2, true);
+
+				topics.forEach(function(topic, i) {
+					usbDetect.off(topic, listeners[i]);
+				});
+
+				expect(routed).to.deep.equal(emitted);
+				expect(routed).to.deep.equal([
+					'add:4096:0 /dev/synthetic0',
+					'insert:4096 /dev/synthetic0',
+					'change:4096 /dev/synthetic0',
+					'change /dev/synthetic0',
+					'remove:4096:0 /dev/synthetic0',
+					'change:4096 /dev/synthetic0',
+					'change /dev/synthetic0'
+				]);
+			});
+		});
+	});
+
+
+	describe('device objects', function() {
+		it('should look the same as the ones built without the template', function() {
+			var devices = detection.marshalSyntheticDevices(4, false);
+			var legacyDevices = detection.marshalSyntheticDevices(4, true);
+
+			expect(devices).to.deep.equal(legacyDevices);
+			devices.forEach(function(device, i) {
+				testDeviceShape(device);
+				expect(Object.keys(device)).to.deep.equal(Object.keys(legacyDevices[i]));
+			});
+		});
+	});
+
+
+	describe('worker threads', function() {
+		var workerThreads;
+		try {
+			workerThreads = require('worker_threads');
+		}
+		catch(err) {
+			return;
+		}
+
+		it('should share the device list with the main thread', function() {
+			return usbDetect.ready.then(function() {
+				var worker = new workerThreads.Worker(
+					'var usbDetect = require(' + JSON.stringify(require.resolve('../')) + ');' +
+					'usbDetect.ready.then(function() {' +
+					'	require("worker_threads").parentPort.postMessage(usbDetect.findSync());' +
+					'	usbDetect.stopMonitoring();' +
+					'});',
+					{ eval: true }
+				);
+
+				return new Promise(function(resolve, reject) {
+					worker.once('message', resolve);
+					worker.once('error', reject);
+				})
+					.then(function(devices) {
+						expect(devices).to.deep.equal(usbDetect.findSync());
+						return worker.terminate();
+					})
+					.then(function() {
+						// The main thread keeps monitoring
+						expect(usbDetect.getStats().monitoringEnvironments).to.equal(1);
+					});
+			});
+		});
+	});
+
+
+	describe('`.startMonitoring(options)`', function() {
+		after(function() {
+			// Back to the default filter
+			usbDetect.startMonitoring({});
+		});
+
+		// Synthetic devices 0 to 4 have the vendor ids 4096 to 4100
+		it('should replace the filter while monitoring', function(done) {
+			usbDetect.startMonitoring({ vendorId: 4096, productId: 0 });
+			usbDetect.startMonitoring({ vendorId: 4097, subsystems: ['usb'] });
+			// Stopping keeps the filter, the synthetic events below go through it
+			usbDetect.stopMonitoring();
+
+			var filtered = usbDetect.getStats().monitorEventsFiltered;
+			var records = [];
+			var subscription = usbDetect.subscribe({}, function(record) {
+				records.push(record.type + ' ' + record.device.devNode);
+			});
+
+			detection.queueSyntheticEvents(10, 1000);
+
+			setTimeout(function() {
+				subscription.unsubscribe();
+				usbDetect.startMonitoring();
+
+				expect(records).to.deep.equal(['add /dev/synthetic1', 'remove /dev/synthetic1']);
+				expect(usbDetect.getStats().monitorEventsFiltered - filtered).to.equal(8);
+				done();
+			}, 300);
+		});
+
+		// Swapping the udev filter stops and restarts the monitor thread
+		it('should resume monitoring after the subsystems changed', function(done) {
+			var stats = usbDetect.getStats();
+			if(!stats.monitorRunning || process.env.USB_DETECTION_MONITOR_SOURCE) {
+				this.skip();
+			}
+			this.timeout(5000);
+
+			var waitForFilterUpdate = function(updates, callback) {
+				var stats = usbDetect.getStats();
+				if(stats.monitorFilterUpdates > updates) {
+					callback(stats);
+					return;
+				}
+				setTimeout(waitForFilterUpdate, 20, updates, callback);
+			};
+
+			usbDetect.startMonitoring({ subsystems: ['tty'] });
+			waitForFilterUpdate(stats.monitorFilterUpdates, function(stats) {
+				expect(stats.monitorRunning).to.equal(true);
+
+				usbDetect.startMonitoring({});
+				waitForFilterUpdate(stats.monitorFilterUpdates, function(stats) {
+					expect(stats.monitorRunning).to.equal(true);
+					done();
+				});
+			});
+		});
+
+		it('should reject subsystems that are not an array', function() {
+			expect(function() {
+				usbDetect.startMonitoring({ subsystems: 'block' });
+			}).to.throw(TypeError);
+		});
+	});
+
+
 	describe('Events `.on`', function() {
 
 		it('should listen to device add/insert', function(done) {